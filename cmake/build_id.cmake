@@ -0,0 +1,23 @@
+# Writes OUTPUT, a header defining VV_BUILD_ID as a hash of the compiler and
+# every source file under SOURCE_DIR, so code cached by one build of Vivaldi is
+# never loaded by a different one (see src/vm/bytecode_cache.h)
+
+file(GLOB_RECURSE sources "${SOURCE_DIR}/*.cpp" "${SOURCE_DIR}/*.h")
+list(SORT sources)
+
+set(contents "${COMPILER}")
+foreach(source ${sources})
+  file(SHA1 "${source}" source_hash)
+  set(contents "${contents} ${source_hash}")
+endforeach()
+string(SHA1 build_id "${contents}")
+string(SUBSTRING "${build_id}" 0 16 build_id)
+
+set(header "#define VV_BUILD_ID 0x${build_id}ull\n")
+# Left alone if it's the same, so nothing including it is rebuilt needlessly
+if(EXISTS "${OUTPUT}")
+  file(READ "${OUTPUT}" old_header)
+endif()
+if(NOT header STREQUAL old_header)
+  file(WRITE "${OUTPUT}" "${header}")
+endif()
@@ -1,17 +1,23 @@
 #include "assignment.h"
 
-#include "vm/instruction.h"
+#include "vm/emitter.h"
 
 using namespace vv;
 
 ast::assignment::assignment(symbol name, std::unique_ptr<expression>&& value)
-  : m_name  {name},
-    m_value {move(value)}
+  : m_name    {name},
+    m_value   {move(value)},
+    m_address {address::kind::global, nullptr, 0}
 { }
 
-std::vector<vm::command> ast::assignment::generate() const
+void ast::assignment::resolve(resolver& scope)
 {
-  auto vec = m_value->generate();
-  vec.emplace_back(vm::instruction::write, m_name);
-  return vec;
+  m_value->resolve(scope);
+  m_address = scope.lookup(m_name);
+}
+
+void ast::assignment::generate(vm::emitter& out) const
+{
+  m_value->generate(out);
+  out.emit(m_address.write(m_name));
 }
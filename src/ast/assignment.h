@@ -3,6 +3,8 @@
 
 #include "expression.h"
 
+#include "ast/resolver.h"
+
 namespace vv {
 
 namespace ast {
@@ -11,11 +13,13 @@ class assignment : public expression {
 public:
   assignment(symbol name, std::unique_ptr<expression>&& value);
 
-  std::vector<vm::command> generate() const override;
+  void resolve(resolver& scope) override;
+  void generate(vm::emitter& out) const override;
 
 private:
   symbol m_name;
   std::unique_ptr<expression> m_value;
+  address m_address;
 };
 
 }
@@ -0,0 +1,51 @@
+#include "binary_operator.h"
+
+#include "vm/emitter.h"
+
+#include <unordered_map>
+
+using namespace vv;
+
+ast::binary_operator::binary_operator(std::unique_ptr<ast::expression>&& left,
+                                      vv::symbol method,
+                                      std::unique_ptr<ast::expression>&& right)
+  : m_left   {move(left)},
+    m_method {method},
+    m_right  {move(right)}
+{ }
+
+void ast::binary_operator::resolve(resolver& scope)
+{
+  m_right->resolve(scope);
+  m_left->resolve(scope);
+}
+
+void ast::binary_operator::generate(vm::emitter& out) const
+{
+  static const std::unordered_map<symbol, vm::instruction> instructions{
+    { {"add"},            vm::instruction::add },
+    { {"subtract"},       vm::instruction::sub },
+    { {"times"},          vm::instruction::mul },
+    { {"divides"},        vm::instruction::div },
+    { {"modulo"},         vm::instruction::mod },
+    { {"equals"},         vm::instruction::eq  },
+    { {"unequal"},        vm::instruction::neq },
+    { {"less"},           vm::instruction::lt  },
+    { {"greater"},        vm::instruction::gt  },
+    { {"less_equals"},    vm::instruction::le  },
+    { {"greater_equals"}, vm::instruction::ge  }
+  };
+
+  m_right->generate(out);
+  out.emit(vm::instruction::push_arg);
+  m_left->generate(out);
+
+  auto cache = out.constants().add(vm::member_cache{m_method});
+  auto instr = instructions.find(m_method);
+  if (instr != end(instructions)) {
+    out.emit(instr->second, cache);
+  } else {
+    out.emit(vm::instruction::readm, cache);
+    out.emit(vm::instruction::call, 1);
+  }
+}
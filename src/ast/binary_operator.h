@@ -0,0 +1,32 @@
+#ifndef VV_AST_BINARY_OPERATOR_H
+#define VV_AST_BINARY_OPERATOR_H
+
+#include "expression.h"
+
+namespace vv {
+
+namespace ast {
+
+// A binary operator, e.g. 'a + b'. Semantically this is just a method call
+// ('a.add(b)'), but arithmetic and comparisons get instructions of their own,
+// which skip the call entirely when both sides are numbers.
+class binary_operator : public expression {
+public:
+  binary_operator(std::unique_ptr<ast::expression>&& left,
+                  vv::symbol method,
+                  std::unique_ptr<ast::expression>&& right);
+
+  void resolve(resolver& scope) override;
+  void generate(vm::emitter& out) const override;
+
+private:
+  std::unique_ptr<ast::expression> m_left;
+  vv::symbol m_method;
+  std::unique_ptr<ast::expression> m_right;
+};
+
+}
+
+}
+
+#endif
@@ -1,14 +1,25 @@
 #include "block.h"
 
-#include "vm/instruction.h"
+#include "ast/resolver.h"
+#include "vm/emitter.h"
 
 using namespace vv;
 
 ast::block::block(std::vector<std::unique_ptr<expression>>&& subexpressions)
-  : m_subexpressions {move(subexpressions)}
+  : m_subexpressions {move(subexpressions)},
+    m_dynamic        {true}
 { }
 
-std::vector<vm::command> ast::block::generate() const
+void ast::block::resolve(resolver& scope)
+{
+  m_dynamic = !scope.in_function();
+  scope.enter_block();
+  for (const auto& i : m_subexpressions)
+    i->resolve(scope);
+  m_variables = scope.leave_block();
+}
+
+void ast::block::generate(vm::emitter& out) const
 {
   // Conceptually, *every* block statement consists of
   //   eblk
@@ -21,16 +32,18 @@ std::vector<vm::command> ast::block::generate() const
   // But since the only time the push_nil is actually used is when there are no
   // expressions, and since in that case the e/lblk don't change any semantics,
   // there's no reason not to special-case it
-  if (!m_subexpressions.size())
-    return { {vm::instruction::push_nil} };
+  if (!m_subexpressions.size()) {
+    out.emit(vm::instruction::push_nil);
+    return;
+  }
 
-  std::vector<vm::command> vec{ {vm::instruction::eblk} };
+  if (m_dynamic)
+    out.emit(vm::instruction::eblk);
+  make_cells(out, m_variables);
 
-  for (const auto& i : m_subexpressions) {
-    auto subexpr = i->generate();
-    copy(begin(subexpr), end(subexpr), back_inserter(vec));
-  }
+  for (const auto& i : m_subexpressions)
+    i->generate(out);
 
-  vec.push_back(vm::instruction::lblk);
-  return vec;
+  if (m_dynamic)
+    out.emit(vm::instruction::lblk);
 }
@@ -2,6 +2,7 @@
 #define VV_AST_BLOCK_H
 
 #include "expression.h"
+#include "ast/resolver.h"
 
 namespace vv {
 
@@ -11,10 +12,16 @@ class block : public expression {
 public:
   block(std::vector<std::unique_ptr<expression>>&& subexpressions);
 
-  std::vector<vm::command> generate() const override;
+  void resolve(resolver& scope) override;
+  void generate(vm::emitter& out) const override;
 
 private:
   std::vector<std::unique_ptr<expression>> m_subexpressions;
+  block_variables m_variables;
+  // Whether the block needs a scope at runtime, for the types declared in it
+  // (which are always looked up by name) not to outlast it. Only at the top
+  // level; types declared inside a function last as long as its call
+  bool m_dynamic;
 };
 
 }
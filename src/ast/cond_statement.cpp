@@ -1,8 +1,7 @@
 #include "cond_statement.h"
 
 #include "lang_utils.h"
-#include "value/nil.h"
-#include "vm/instruction.h"
+#include "vm/emitter.h"
 
 using namespace vv;
 
@@ -12,31 +11,27 @@ ast::cond_statement::cond_statement(
   : m_body {move(body)}
 { }
 
-std::vector<vm::command> ast::cond_statement::generate() const
+void ast::cond_statement::resolve(resolver& scope)
 {
-  std::vector<vm::command> vec;
-  std::vector<size_t> jump_to_end_idxs;
-
   for (const auto& i : m_body) {
-    auto test = i.first->generate();
-    copy(begin(test), end(test), back_inserter(vec));
-    vec.emplace_back(vm::instruction::jmp_false);
-    auto jump_to_next_test_idx = vec.size() - 1;
-
-    auto body = i.second->generate();
-    copy(begin(body), end(body), back_inserter(vec));
-    vec.emplace_back(vm::instruction::jmp);
-    jump_to_end_idxs.push_back(vec.size() - 1);
-
-    auto jump_sz = static_cast<int>(vec.size() - jump_to_next_test_idx);
-    vec[jump_to_next_test_idx].arg = jump_sz;
+    i.first->resolve(scope);
+    i.second->resolve(scope);
   }
+}
 
-  vec.emplace_back(vm::instruction::push_nil);
-  for (auto i : jump_to_end_idxs) {
-    auto jump_sz = static_cast<int>(vec.size() - i);
-    vec[i].arg = jump_sz;
+void ast::cond_statement::generate(vm::emitter& out) const
+{
+  auto end = out.make_label();
+
+  for (const auto& i : m_body) {
+    auto next_test = out.make_label();
+    i.first->generate(out);
+    out.emit(vm::instruction::jmp_false, next_test);
+    i.second->generate(out);
+    out.emit(vm::instruction::jmp, end);
+    out.place(next_test);
   }
 
-  return vec;
+  out.emit(vm::instruction::push_nil);
+  out.place(end);
 }
@@ -12,7 +12,8 @@ public:
   cond_statement(std::vector<std::pair<std::unique_ptr<expression>,
                                        std::unique_ptr<expression>>>&& body);
 
-  std::vector<vm::command> generate() const override;
+  void resolve(resolver& scope) override;
+  void generate(vm::emitter& out) const override;
 
 private:
   std::vector<std::pair<std::unique_ptr<expression>,
@@ -1,6 +1,6 @@
 #include "dictionary.h"
 
-#include "vm/instruction.h"
+#include "vm/emitter.h"
 
 using namespace vv;
 
@@ -8,17 +8,18 @@ ast::dictionary::dictionary(std::vector<std::unique_ptr<ast::expression>>&& memb
   : m_members  {move(members)}
 { }
 
-std::vector<vm::command> ast::dictionary::generate() const
+void ast::dictionary::resolve(resolver& scope)
 {
-  std::vector<vm::command> vec;
+  for (const auto& i : m_members)
+    i->resolve(scope);
+}
 
+void ast::dictionary::generate(vm::emitter& out) const
+{
   for (const auto& i : m_members) {
-    auto arg = i->generate();
-    copy(begin(arg), end(arg), back_inserter(vec));
-    vec.emplace_back(vm::instruction::push);
+    i->generate(out);
+    out.emit(vm::instruction::push);
   }
 
-  vec.emplace_back(vm::instruction::make_dict,
-                   static_cast<int>(m_members.size()));
-  return vec;
+  out.emit(vm::instruction::make_dict, static_cast<int>(m_members.size()));
 }
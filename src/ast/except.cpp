@@ -1,6 +1,6 @@
 #include "except.h"
 
-#include "vm/instruction.h"
+#include "vm/emitter.h"
 
 using namespace vv;
 
@@ -8,9 +8,13 @@ ast::except::except(std::unique_ptr<expression>&& value)
   : m_value {move(value)}
 { }
 
-std::vector<vm::command> ast::except::generate() const
+void ast::except::resolve(resolver& scope)
 {
-  auto vec = m_value->generate();
-  vec.emplace_back(vm::instruction::except);
-  return vec;
+  m_value->resolve(scope);
+}
+
+void ast::except::generate(vm::emitter& out) const
+{
+  m_value->generate(out);
+  out.emit(vm::instruction::except);
 }
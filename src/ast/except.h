@@ -11,7 +11,8 @@ class except : public expression {
 public:
   except(std::unique_ptr<expression>&& value);
 
-  std::vector<vm::command> generate() const override;
+  void resolve(resolver& scope) override;
+  void generate(vm::emitter& out) const override;
 
 private:
   std::unique_ptr<expression> m_value;
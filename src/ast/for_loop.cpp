@@ -1,6 +1,6 @@
 #include "for_loop.h"
 
-#include "vm/instruction.h"
+#include "vm/emitter.h"
 
 using namespace vv;
 
@@ -9,41 +9,91 @@ ast::for_loop::for_loop(symbol iterator,
                         std::unique_ptr<expression>&& body)
   : m_iterator {iterator},
     m_range    {move(range)},
-    m_body     {move(body)}
+    m_body     {move(body)},
+    m_address  {address::kind::global, nullptr, 0},
+    m_dynamic  {true}
 { }
 
-std::vector<vm::command> ast::for_loop::generate() const
+void ast::for_loop::resolve(resolver& scope)
 {
-  auto vec = m_range->generate();
-  vec.emplace_back(vm::instruction::readm, symbol{"start"});
-  vec.emplace_back(vm::instruction::call, 0);
-
-  vec.emplace_back(vm::instruction::eblk);
-
-  auto test_idx = vec.size();
-  vec.emplace_back(vm::instruction::push);
-  vec.emplace_back(vm::instruction::readm, symbol{"at_end"});
-  vec.emplace_back(vm::instruction::call, 0);
-  vec.emplace_back(vm::instruction::jmp_true);
-  auto jmp_to_end_idx = vec.size() - 1;
-  vec.emplace_back(vm::instruction::pop);
-  vec.emplace_back(vm::instruction::push);
-  vec.emplace_back(vm::instruction::readm, symbol{"get"});
-  vec.emplace_back(vm::instruction::call, 0);
-  vec.emplace_back(vm::instruction::let, m_iterator);
-
-  auto body = m_body->generate();
-  copy(begin(body), end(body), back_inserter(vec));
-
-  vec.emplace_back(vm::instruction::pop);
-  vec.emplace_back(vm::instruction::readm, symbol{"increment"});
-  vec.emplace_back(vm::instruction::call, 0);
-  vec.emplace_back(vm::instruction::jmp);
-  auto vec_sz = static_cast<int>(vec.size() - 1);
-  vec.back().arg = static_cast<int>(test_idx) - vec_sz;
-  vec[jmp_to_end_idx].arg = static_cast<int>(vec.size() - jmp_to_end_idx);
-  vec.emplace_back(vm::instruction::lblk);
-  vec.emplace_back(vm::instruction::push_nil);
-
-  return vec;
+  m_range->resolve(scope);
+
+  m_dynamic = !scope.in_function();
+  scope.enter_block();
+  m_address = scope.declare(m_iterator);
+  m_body->resolve(scope);
+  m_variables = scope.leave_block();
+}
+
+void ast::for_loop::generate(vm::emitter& out) const
+{
+  // Given iterator 'i', range 'r' and body 'b', generate the following VM
+  // instructions (the block only being entered at the top level):
+  //   r
+  //   eblk
+  //   iter_init body
+  //   jmp end
+  //   readm start; call 0; push
+  // test:
+  //   readm at_end; call 0; jmp_true end
+  //   pop; push; readm get; call 0
+  // body:
+  //   make_cell (for each of i, and anything else declared, that's captured)
+  //   let i
+  //   b
+  //   iter_next body
+  //   jmp end
+  //   pop; readm increment; call 0; push
+  //   jmp test
+  // end:
+  //   pop; pop
+  //   lblk
+  //   push_nil
+  // iter_init and iter_next handle Arrays, Strings and Ranges of Integers
+  // themselves; everything else goes through the method calls.
+  auto test = out.make_label();
+  auto body = out.make_label();
+  auto end = out.make_label();
+  auto call_method = [&](symbol name)
+  {
+    auto cache = out.constants().add(vm::member_cache{name});
+    out.emit(vm::instruction::readm, cache);
+    out.emit(vm::instruction::call, 0);
+  };
+
+  m_range->generate(out);
+  if (m_dynamic)
+    out.emit(vm::instruction::eblk);
+
+  out.emit(vm::instruction::iter_init, body);
+  out.emit(vm::instruction::jmp, end);
+  call_method(symbol{"start"});
+  out.emit(vm::instruction::push);
+
+  out.place(test);
+  call_method(symbol{"at_end"});
+  out.emit(vm::instruction::jmp_true, end);
+  out.emit(vm::instruction::pop);
+  out.emit(vm::instruction::push);
+  call_method(symbol{"get"});
+
+  out.place(body);
+  make_cells(out, m_variables);
+  out.emit(m_address.let(m_iterator));
+  m_body->generate(out);
+
+  out.emit(vm::instruction::iter_next, body);
+  out.emit(vm::instruction::jmp, end);
+  out.emit(vm::instruction::pop);
+  call_method(symbol{"increment"});
+  out.emit(vm::instruction::push);
+  out.emit(vm::instruction::jmp, test);
+
+  out.place(end);
+  out.emit(vm::instruction::pop);
+  out.emit(vm::instruction::pop);
+
+  if (m_dynamic)
+    out.emit(vm::instruction::lblk);
+  out.emit(vm::instruction::push_nil);
 }
@@ -3,6 +3,8 @@
 
 #include "expression.h"
 
+#include "ast/resolver.h"
+
 namespace vv {
 
 namespace ast {
@@ -13,12 +15,20 @@ public:
            std::unique_ptr<expression>&& range,
            std::unique_ptr<expression>&& body);
 
-  std::vector<vm::command> generate() const override;
+  void resolve(resolver& scope) override;
+  void generate(vm::emitter& out) const override;
 
 private:
   symbol m_iterator;
   std::unique_ptr<expression> m_range;
   std::unique_ptr<expression> m_body;
+
+  address m_address;
+  // The iterator, and anything declared directly in the body, which get new
+  // cells on every iteration
+  block_variables m_variables;
+  // See ast::block
+  bool m_dynamic;
 };
 
 }
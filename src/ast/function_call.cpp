@@ -1,6 +1,6 @@
 #include "function_call.h"
 
-#include "vm/instruction.h"
+#include "vm/emitter.h"
 
 using namespace vv;
 
@@ -11,19 +11,20 @@ ast::function_call::function_call(
     m_args     {move(args)}
 { }
 
-std::vector<vm::command> ast::function_call::generate() const
+void ast::function_call::resolve(resolver& scope)
 {
-  std::vector<vm::command> vec;
+  for (const auto& i : m_args)
+    i->resolve(scope);
+  m_function->resolve(scope);
+}
 
+void ast::function_call::generate(vm::emitter& out) const
+{
   for (const auto& i : m_args) {
-    auto arg = i->generate();
-    copy(begin(arg), end(arg), back_inserter(vec));
-    vec.emplace_back(vm::instruction::push_arg);
+    i->generate(out);
+    out.emit(vm::instruction::push_arg);
   }
 
-  auto fn = m_function->generate();
-  copy(begin(fn), end(fn), back_inserter(vec));
-
-  vec.emplace_back(vm::instruction::call, static_cast<int>(m_args.size()));
-  return vec;
+  m_function->generate(out);
+  out.emit(vm::instruction::call, static_cast<int>(m_args.size()));
 }
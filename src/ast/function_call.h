@@ -12,7 +12,8 @@ public:
   function_call(std::unique_ptr<ast::expression>&& name,
                 std::vector<std::unique_ptr<ast::expression>>&& args);
 
-  std::vector<vm::command> generate() const override;
+  void resolve(resolver& scope) override;
+  void generate(vm::emitter& out) const override;
 
 private:
   std::unique_ptr<ast::expression> m_function;
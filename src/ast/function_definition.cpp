@@ -1,37 +1,70 @@
 #include "function_definition.h"
 
-#include "gc.h"
-#include "value/function.h"
+#include "vm/emitter.h"
+#include "vm/optimizer.h"
 
 using namespace vv;
 
 ast::function_definition::function_definition(symbol name,
                                               std::unique_ptr<expression>&&body,
                                               const std::vector<symbol>& args)
-  : m_name {name},
-    m_body {move(body)},
-    m_args {args}
+  : m_name    {name},
+    m_body    {move(body)},
+    m_args    {args},
+    m_address {address::kind::global, nullptr, 0},
+    m_layout  {}
 { }
 
-std::vector<vm::command> ast::function_definition::generate() const
+void ast::function_definition::resolve(resolver& scope)
 {
-  const auto argc = static_cast<int>(m_args.size());
-  std::vector<vm::command> definition;
-  for (auto i = argc; i--;) {
-    definition.emplace_back(vm::instruction::arg, i);
-    definition.emplace_back(vm::instruction::let, m_args[i]);
+  // Declare the name first, so the function can call itself
+  if (m_name != symbol{})
+    m_address = scope.declare(m_name);
+  scope.defer([this, &scope] { resolve_function(scope); });
+}
+
+void ast::function_definition::resolve_function(resolver& scope)
+{
+  scope.enter_function();
+  scope.enter_block();
+  m_arg_addresses.clear();
+  for (auto i : m_args)
+    m_arg_addresses.push_back(scope.declare(i));
+  m_body->resolve(scope);
+  m_variables = scope.leave_block();
+  m_layout = scope.leave_function();
+}
+
+vm::function_t ast::function_definition::generate_function() const
+{
+  auto definition = m_layout;
+  definition.argc = static_cast<int>(m_args.size());
+  // The body gets its own constant pool, separate from that of the code
+  // defining it
+  vm::emitter out{definition};
+  make_cells(out, m_variables);
+  for (auto i = definition.argc; i--;) {
+    // Arguments are passed in the first slots already, so they only need to be
+    // moved if they're captured (or share a name with a later argument)
+    auto idx = static_cast<size_t>(i);
+    auto store = m_arg_addresses[idx].let(m_args[idx]);
+    if (store.instr == vm::instruction::store_local && store.as_int == i)
+      continue;
+    out.emit(vm::instruction::arg, i);
+    out.emit(store);
   }
 
-  auto body = m_body->generate();
-  copy(begin(body), end(body), back_inserter(definition));
-  definition.emplace_back(vm::instruction::ret);
+  m_body->generate(out);
+  out.emit(vm::instruction::ret);
+  vm::optimize(definition);
 
-  std::vector<vm::command> vec;
-  vec.emplace_back( vm::instruction::push_fn,
-                    vm::function_t{argc, move(definition)} );
+  return definition;
+}
 
-  if (m_name != symbol{})
-    vec.emplace_back(vm::instruction::let, m_name);
+void ast::function_definition::generate(vm::emitter& out) const
+{
+  out.emit(vm::instruction::push_fn, out.constants().add(generate_function()));
 
-  return vec;
+  if (m_name != symbol{})
+    out.emit(m_address.let(m_name));
 }
@@ -3,6 +3,9 @@
 
 #include "expression.h"
 
+#include "ast/resolver.h"
+#include "vm/instruction.h"
+
 namespace vv {
 
 namespace ast {
@@ -13,12 +16,25 @@ public:
                       std::unique_ptr<expression>&& body,
                       const std::vector<symbol>& args);
 
-  std::vector<vm::command> generate() const override;
+  void resolve(resolver& scope) override;
+  void generate(vm::emitter& out) const override;
+
+  // Resolves and generates just the function itself, without declaring it or
+  // pushing it into retval
+  void resolve_function(resolver& scope);
+  vm::function_t generate_function() const;
 
 private:
   symbol m_name;
   std::shared_ptr<expression> m_body;
   std::vector<symbol> m_args;
+
+  address m_address;
+  std::vector<address> m_arg_addresses;
+  // The arguments, and anything declared directly in the body
+  block_variables m_variables;
+  // Layout of the function's variables, as returned by resolver::leave_function
+  vm::function_t m_layout;
 };
 
 }
@@ -1,35 +1,35 @@
 #include "literal.h"
 
-#include "vm/instruction.h"
+#include "vm/emitter.h"
 
 using namespace vv;
 
-std::vector<vm::command> ast::literal::boolean::generate() const
+void ast::literal::boolean::generate(vm::emitter& out) const
 {
-  return { {vm::instruction::push_bool, m_val} };
+  out.emit(vm::instruction::push_bool, m_val);
 }
 
-std::vector<vm::command> ast::literal::floating_point::generate() const
+void ast::literal::floating_point::generate(vm::emitter& out) const
 {
-  return { {vm::instruction::push_flt, m_val} };
+  out.emit(vm::instruction::push_flt, out.constants().add(m_val));
 }
 
-std::vector<vm::command> ast::literal::integer::generate() const
+void ast::literal::integer::generate(vm::emitter& out) const
 {
-  return { {vm::instruction::push_int, m_val} };
+  out.emit(vm::instruction::push_int, m_val);
 }
 
-std::vector<vm::command> ast::literal::nil::generate() const
+void ast::literal::nil::generate(vm::emitter& out) const
 {
-  return { {vm::instruction::push_nil} };
+  out.emit(vm::instruction::push_nil);
 }
 
-std::vector<vm::command> ast::literal::string::generate() const
+void ast::literal::string::generate(vm::emitter& out) const
 {
-  return { {vm::instruction::push_str, m_val} };
+  out.emit(vm::instruction::push_str, out.constants().add(m_val));
 }
 
-std::vector<vm::command> ast::literal::symbol::generate() const
+void ast::literal::symbol::generate(vm::emitter& out) const
 {
-  return { {vm::instruction::push_sym, m_val} };
+  out.emit(vm::instruction::push_sym, m_val);
 }
@@ -12,7 +12,8 @@ namespace literal {
 class boolean : public expression {
 public:
   boolean(bool val) : m_val{val} { }
-  std::vector<vm::command> generate() const override;
+  void resolve(resolver&) override { }
+  void generate(vm::emitter& out) const override;
 private:
   bool m_val;
 };
@@ -20,7 +21,8 @@ private:
 class floating_point : public expression {
 public:
   floating_point(double val) : m_val{val} { }
-  std::vector<vm::command> generate() const override;
+  void resolve(resolver&) override { }
+  void generate(vm::emitter& out) const override;
 private:
   double m_val;
 };
@@ -28,20 +30,23 @@ private:
 class integer : public expression {
 public:
   integer(int val) : m_val{val} { }
-  std::vector<vm::command> generate() const override;
+  void resolve(resolver&) override { }
+  void generate(vm::emitter& out) const override;
 private:
   int m_val;
 };
 
 class nil : public expression {
 public:
-  std::vector<vm::command> generate() const override;
+  void resolve(resolver&) override { }
+  void generate(vm::emitter& out) const override;
 };
 
 class string : public expression {
 public:
   string(const std::string& val) : m_val{val} { }
-  std::vector<vm::command> generate() const override;
+  void resolve(resolver&) override { }
+  void generate(vm::emitter& out) const override;
 private:
   std::string m_val;
 };
@@ -49,7 +54,8 @@ private:
 class symbol : public expression {
 public:
   symbol(vv::symbol val) : m_val{val} { }
-  std::vector<vm::command> generate() const override;
+  void resolve(resolver&) override { }
+  void generate(vm::emitter& out) const override;
 private:
   vv::symbol m_val;
 };
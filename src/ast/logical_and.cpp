@@ -1,6 +1,6 @@
 #include "logical_and.h"
 
-#include "vm/instruction.h"
+#include "vm/emitter.h"
 
 using namespace vv;
 
@@ -10,28 +10,35 @@ ast::logical_and::logical_and(std::unique_ptr<expression>&& left,
     m_right {move(right)}
 { }
 
-std::vector<vm::command> ast::logical_and::generate() const
+void ast::logical_and::resolve(resolver& scope)
+{
+  m_left->resolve(scope);
+  m_right->resolve(scope);
+}
+
+void ast::logical_and::generate(vm::emitter& out) const
 {
   // Given conditions 'a' and 'b', generate the following VM instructions:
   //   a
-  //   jmp_false <false index - this index>
+  //   jmp_false false
   //   b
-  //   jmp_false 3
+  //   jmp_false false
   //   push_bool true
-  //   jmp 2
+  //   jmp end
+  // false:
   //   push_bool false
-  auto vec = m_left->generate();
-  vec.emplace_back(vm::instruction::jmp_false);
-  auto jmp_to_false_idx = vec.size() - 1;
+  // end:
+  auto short_circuit = out.make_label();
+  auto end = out.make_label();
 
-  auto right = m_right->generate();
-  copy(begin(right), end(right), back_inserter(vec));
-  vec.emplace_back(vm::instruction::jmp_false, 3);
-  vec.emplace_back(vm::instruction::push_bool, true);
-  vec.emplace_back(vm::instruction::jmp, 2);
-  vec.emplace_back(vm::instruction::push_bool, false);
+  m_left->generate(out);
+  out.emit(vm::instruction::jmp_false, short_circuit);
+  m_right->generate(out);
+  out.emit(vm::instruction::jmp_false, short_circuit);
+  out.emit(vm::instruction::push_bool, true);
+  out.emit(vm::instruction::jmp, end);
 
-  auto false_idx = vec.size() - 1;
-  vec[jmp_to_false_idx].arg = static_cast<int>(false_idx - jmp_to_false_idx);
-  return vec;
+  out.place(short_circuit);
+  out.emit(vm::instruction::push_bool, false);
+  out.place(end);
 }
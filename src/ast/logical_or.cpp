@@ -1,6 +1,6 @@
 #include "logical_or.h"
 
-#include "vm/instruction.h"
+#include "vm/emitter.h"
 
 using namespace vv;
 
@@ -10,28 +10,35 @@ ast::logical_or::logical_or(std::unique_ptr<expression>&& left,
     m_right {move(right)}
 { }
 
-std::vector<vm::command> ast::logical_or::generate() const
+void ast::logical_or::resolve(resolver& scope)
+{
+  m_left->resolve(scope);
+  m_right->resolve(scope);
+}
+
+void ast::logical_or::generate(vm::emitter& out) const
 {
   // Given conditions 'a' and 'b', generate the following VM instructions:
   //   a
-  //   jmp_true <true index - this index>
+  //   jmp_true true
   //   b
-  //   jmp_true 3
+  //   jmp_true true
   //   push_bool false
-  //   jmp 2
+  //   jmp end
+  // true:
   //   push_bool true
-  auto vec = m_left->generate();
-  vec.emplace_back(vm::instruction::jmp_true);
-  auto jmp_to_false_idx = vec.size() - 1;
+  // end:
+  auto short_circuit = out.make_label();
+  auto end = out.make_label();
 
-  auto right = m_right->generate();
-  copy(begin(right), end(right), back_inserter(vec));
-  vec.emplace_back(vm::instruction::jmp_true, 3);
-  vec.emplace_back(vm::instruction::push_bool, false);
-  vec.emplace_back(vm::instruction::jmp, 2);
-  vec.emplace_back(vm::instruction::push_bool, true);
+  m_left->generate(out);
+  out.emit(vm::instruction::jmp_true, short_circuit);
+  m_right->generate(out);
+  out.emit(vm::instruction::jmp_true, short_circuit);
+  out.emit(vm::instruction::push_bool, false);
+  out.emit(vm::instruction::jmp, end);
 
-  auto false_idx = vec.size() - 1;
-  vec[jmp_to_false_idx].arg = static_cast<int>(false_idx - jmp_to_false_idx);
-  return vec;
+  out.place(short_circuit);
+  out.emit(vm::instruction::push_bool, true);
+  out.place(end);
 }
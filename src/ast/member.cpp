@@ -1,6 +1,6 @@
 #include "member.h"
 
-#include "vm/instruction.h"
+#include "vm/emitter.h"
 
 using namespace vv;
 
@@ -9,9 +9,14 @@ ast::member::member(std::unique_ptr<ast::expression>&& object, vv::symbol name)
     m_name   {name}
 { }
 
-std::vector<vm::command> ast::member::generate() const
+void ast::member::resolve(resolver& scope)
 {
-  auto vec = m_object->generate();
-  vec.emplace_back(vm::instruction::readm, m_name);
-  return vec;
+  m_object->resolve(scope);
+}
+
+void ast::member::generate(vm::emitter& out) const
+{
+  m_object->generate(out);
+  out.emit(vm::instruction::readm,
+           out.constants().add(vm::member_cache{m_name}));
 }
@@ -11,7 +11,8 @@ class member : public expression {
 public:
   member(std::unique_ptr<ast::expression>&& object, vv::symbol name);
 
-  std::vector<vm::command> generate() const override;
+  void resolve(resolver& scope) override;
+  void generate(vm::emitter& out) const override;
 
 private:
   std::unique_ptr<ast::expression> m_object;
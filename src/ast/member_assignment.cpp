@@ -1,6 +1,6 @@
 #include "member_assignment.h"
 
-#include "vm/instruction.h"
+#include "vm/emitter.h"
 
 using namespace vv;
 
@@ -13,13 +13,17 @@ ast::member_assignment::member_assignment(
     m_value  {move(value)}
 { }
 
-std::vector<vm::command> ast::member_assignment::generate() const
+void ast::member_assignment::resolve(resolver& scope)
 {
-  auto vec = m_value->generate();
-  vec.emplace_back(vm::instruction::push);
-  auto obj = m_object->generate();
-  copy(begin(obj), end(obj), back_inserter(vec));
-  vec.emplace_back(vm::instruction::writem, m_name);
+  m_value->resolve(scope);
+  m_object->resolve(scope);
+}
 
-  return vec;
+void ast::member_assignment::generate(vm::emitter& out) const
+{
+  m_value->generate(out);
+  out.emit(vm::instruction::push);
+  m_object->generate(out);
+  out.emit(vm::instruction::writem,
+           out.constants().add(vm::member_write_cache{m_name}));
 }
@@ -13,7 +13,8 @@ public:
                     vv::symbol name,
                     std::unique_ptr<ast::expression>&& value);
 
-  std::vector<vm::command> generate() const override;
+  void resolve(resolver& scope) override;
+  void generate(vm::emitter& out) const override;
 
 private:
   std::unique_ptr<ast::expression> m_object;
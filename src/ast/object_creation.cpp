@@ -1,6 +1,6 @@
 #include "object_creation.h"
 
-#include "vm/instruction.h"
+#include "vm/emitter.h"
 
 using namespace vv;
 
@@ -11,19 +11,20 @@ ast::object_creation::object_creation(
     m_args {move(args)}
 { }
 
-std::vector<vm::command> ast::object_creation::generate() const
+void ast::object_creation::resolve(resolver& scope)
 {
-  std::vector<vm::command> vec;
+  for (const auto& i : m_args)
+    i->resolve(scope);
+  m_type->resolve(scope);
+}
 
+void ast::object_creation::generate(vm::emitter& out) const
+{
   for (const auto& i : m_args) {
-    auto arg = i->generate();
-    copy(begin(arg), end(arg), back_inserter(vec));
-    vec.emplace_back(vm::instruction::push_arg);
+    i->generate(out);
+    out.emit(vm::instruction::push_arg);
   }
 
-  auto type = m_type->generate();
-  copy(begin(type), end(type), back_inserter(vec));
-
-  vec.emplace_back(vm::instruction::new_obj, static_cast<int>(m_args.size()));
-  return vec;
+  m_type->generate(out);
+  out.emit(vm::instruction::new_obj, static_cast<int>(m_args.size()));
 }
@@ -1,6 +1,6 @@
 #include "require.h"
 
-#include "vm/instruction.h"
+#include "vm/emitter.h"
 
 using namespace vv;
 
@@ -8,7 +8,9 @@ ast::require::require(const std::string& filename)
   : m_filename {filename}
 { }
 
-std::vector<vm::command> ast::require::generate() const
+void ast::require::resolve(resolver&) { }
+
+void ast::require::generate(vm::emitter& out) const
 {
-  return std::vector<vm::command>{ {vm::instruction::req, m_filename} };
+  out.emit(vm::instruction::req, out.constants().add(m_filename));
 }
@@ -0,0 +1,172 @@
+#include "resolver.h"
+
+#include "vm/emitter.h"
+
+#include <algorithm>
+
+using namespace vv;
+
+void ast::make_cells(vm::emitter& out, const block_variables& vars)
+{
+  for (const auto& i : vars) {
+    if (i->captured)
+      out.emit(vm::instruction::make_cell, i->slot);
+  }
+}
+
+vm::command ast::address::read(symbol name) const
+{
+  switch (type) {
+  case kind::global: return {vm::instruction::read, name};
+  case kind::local:
+    if (var->captured)
+      return {vm::instruction::load_cell, var->slot};
+    return {vm::instruction::load_local, var->slot};
+  case kind::upvalue: break;
+  }
+  return {vm::instruction::load_upvalue, index};
+}
+
+vm::command ast::address::write(symbol name) const
+{
+  switch (type) {
+  case kind::global: return {vm::instruction::write, name};
+  case kind::local:
+    if (var->captured)
+      return {vm::instruction::store_cell, var->slot};
+    return {vm::instruction::store_local, var->slot};
+  case kind::upvalue: break;
+  }
+  return {vm::instruction::store_upvalue, index};
+}
+
+vm::command ast::address::let(symbol name) const
+{
+  if (type == kind::global)
+    return {vm::instruction::let, name};
+  return write(name);
+}
+
+ast::resolver::resolver()
+  : m_functions(1)
+{ }
+
+void ast::resolver::enter_function()
+{
+  m_functions.emplace_back();
+}
+
+vm::function_t ast::resolver::leave_function()
+{
+  auto function = layout(m_functions.back());
+  m_functions.pop_back();
+  return function;
+}
+
+vm::function_t ast::resolver::top_level()
+{
+  return layout(m_functions.front());
+}
+
+void ast::resolver::enter_block()
+{
+  m_functions.back().blocks.emplace_back();
+  m_functions.back().deferred.emplace_back();
+}
+
+ast::block_variables ast::resolver::leave_block()
+{
+  // Resolving a deferred function enters a new function scope, which can
+  // reallocate m_functions--- so don't hold on to any references into it
+  auto deferred = move(m_functions.back().deferred.back());
+  for (const auto& resolve : deferred)
+    resolve();
+
+  block_variables vars;
+  for (const auto& i : m_functions.back().blocks.back())
+    vars.push_back(i.second);
+  m_functions.back().blocks.pop_back();
+  m_functions.back().deferred.pop_back();
+  return vars;
+}
+
+bool ast::resolver::in_function() const
+{
+  return m_functions.size() > 1;
+}
+
+ast::address ast::resolver::declare(symbol name)
+{
+  auto& function = m_functions.back();
+  if (function.blocks.empty())
+    return { address::kind::global, nullptr, 0 };
+
+  auto& var = function.blocks.back()[name];
+  // Redeclaring a variable in the same block just reuses its slot
+  if (!var) {
+    auto slot = static_cast<int>(function.slots.size());
+    var = std::make_shared<local_variable>(local_variable{name, slot, false});
+    function.slots.push_back(var);
+  }
+  return { address::kind::local, var, 0 };
+}
+
+ast::address ast::resolver::lookup(symbol name)
+{
+  for (auto fn = m_functions.size(); fn--;) {
+    const auto& blocks = m_functions[fn].blocks;
+    for (auto i = rbegin(blocks); i != rend(blocks); ++i) {
+      auto var = i->find(name);
+      if (var == end(*i))
+        continue;
+      if (fn == m_functions.size() - 1)
+        return { address::kind::local, var->second, 0 };
+
+      // Declared in an enclosing function, so thread it through every function
+      // in between: the one directly inside the declaring function captures
+      // the declaring frame's cell, and the rest capture their creator's
+      // upvalue
+      var->second->captured = true;
+      auto index = capture(fn + 1, {name, true, var->second->slot});
+      for (auto inner = fn + 2; inner != m_functions.size(); ++inner)
+        index = capture(inner, {name, false, index});
+      return { address::kind::upvalue, nullptr, index };
+    }
+  }
+  return { address::kind::global, nullptr, 0 };
+}
+
+int ast::resolver::capture(size_t fn, const vm::capture& var)
+{
+  auto& captures = m_functions[fn].captures;
+  auto existing = find_if(begin(captures), end(captures), [&](const auto& i)
+  {
+    return i.local == var.local && i.index == var.index;
+  });
+  if (existing != end(captures))
+    return static_cast<int>(existing - begin(captures));
+
+  captures.push_back(var);
+  return static_cast<int>(captures.size() - 1);
+}
+
+void ast::resolver::defer(const std::function<void()>& resolve)
+{
+  auto& deferred = m_functions.back().deferred;
+  if (deferred.size())
+    deferred.back().push_back(resolve);
+  else
+    resolve();
+}
+
+vm::function_t ast::resolver::layout(function_scope& scope)
+{
+  vm::function_t layout{};
+  for (const auto& i : scope.slots) {
+    layout.locals.push_back(i->name);
+    if (i->captured)
+      layout.cells.push_back(i->slot);
+  }
+  layout.captures = move(scope.captures);
+  return layout;
+}
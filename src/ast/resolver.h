@@ -0,0 +1,116 @@
+#ifndef VV_AST_RESOLVER_H
+#define VV_AST_RESOLVER_H
+
+#include "symbol.h"
+#include "vm/instruction.h"
+
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace vv {
+
+namespace vm {
+
+class emitter;
+
+}
+
+namespace ast {
+
+// A variable declared inside a function.
+struct local_variable {
+  symbol name;
+  int slot;
+  // Set once some closure refers to the variable, in which case it's stored in
+  // a cell (shared with the closure) instead of directly in its slot
+  bool captured;
+};
+
+// Variables declared directly inside a block. Any captured are given new cells
+// each time the block's entered (see make_cells).
+using block_variables = std::vector<std::shared_ptr<const local_variable>>;
+
+// Emits a make_cell for each of vars that's captured, at the start of the
+// block declaring them
+void make_cells(vm::emitter& out, const block_variables& vars);
+
+// Where a variable lives, as determined at compile time. Variables declared
+// inside a function, or inside a block in top-level code, are given a fixed
+// slot in that function's (or the top level's) call frame, or a cell if
+// they're captured; variables from enclosing functions are reached through the
+// closure's captured cells; everything else (top-level variables, builtins,
+// required bindings, the REPL) is still looked up by name at runtime.
+struct address {
+  enum class kind {
+    global,
+    local,
+    upvalue
+  } type;
+  // For locals. Whether it's captured isn't known until the whole function's
+  // been resolved, so this is read at generation time rather than copied
+  std::shared_ptr<const local_variable> var;
+  // For upvalues, the index into the current closure's captured variables
+  int index;
+
+  // Instructions to read, assign to, and declare the variable, respectively
+  vm::command read(symbol name) const;
+  vm::command write(symbol name) const;
+  vm::command let(symbol name) const;
+};
+
+// Assigns addresses to variables, in a pass over the AST prior to code
+// generation (see ast::expression::resolve).
+class resolver {
+public:
+  resolver();
+
+  // Doesn't enter a block; the caller enters one for the function's arguments,
+  // and leaves it before leaving the function
+  void enter_function();
+  // Returns an empty function (no argc or body) with the function's locals,
+  // cells and captures filled in
+  vm::function_t leave_function();
+  // The same, for the top-level code resolved
+  vm::function_t top_level();
+
+  void enter_block();
+  block_variables leave_block();
+
+  bool in_function() const;
+
+  address declare(symbol name);
+  address lookup(symbol name);
+
+  // Calls resolve once the current block's been fully resolved, so functions
+  // can refer to variables declared after them (e.g. in mutually recursive
+  // local functions). Outside of any block (i.e. directly in top-level code),
+  // resolve is called immediately.
+  void defer(const std::function<void()>& resolve);
+
+private:
+  // Top-level code is resolved as if it were a function, except that it starts
+  // off without any blocks: only what's declared inside blocks gets a slot
+  struct function_scope {
+    using block = std::unordered_map<symbol, std::shared_ptr<local_variable>>;
+    std::vector<block> blocks;
+    std::vector<std::vector<std::function<void()>>> deferred;
+    std::vector<std::shared_ptr<local_variable>> slots;
+    std::vector<vm::capture> captures;
+  };
+
+  // Finds or adds a capture in the function m_functions[fn], returning its
+  // index
+  int capture(size_t fn, const vm::capture& var);
+  // The layout of the function (or top-level code) in scope
+  static vm::function_t layout(function_scope& scope);
+
+  std::vector<function_scope> m_functions;
+};
+
+}
+
+}
+
+#endif
@@ -1,6 +1,6 @@
 #include "return_statement.h"
 
-#include "vm/instruction.h"
+#include "vm/emitter.h"
 
 using namespace vv;
 
@@ -8,9 +8,13 @@ ast::return_statement::return_statement(std::unique_ptr<expression>&& value)
   : m_value {move(value)}
 { }
 
-std::vector<vm::command> ast::return_statement::generate() const
+void ast::return_statement::resolve(resolver& scope)
 {
-  auto vec = m_value->generate();
-  vec.emplace_back(vm::instruction::ret);
-  return vec;
+  m_value->resolve(scope);
+}
+
+void ast::return_statement::generate(vm::emitter& out) const
+{
+  m_value->generate(out);
+  out.emit(vm::instruction::ret);
 }
@@ -1,35 +1,73 @@
 #include "try_catch.h"
 
-#include "gc.h"
+#include "ast/resolver.h"
+#include "vm/emitter.h"
 
 using namespace vv;
 
 ast::try_catch::try_catch(std::unique_ptr<expression>&& body,
                           symbol exception_name,
                           std::unique_ptr<expression>&& catcher)
-  : m_body           {move(body)},
-    m_exception_name {exception_name},
-    m_catcher        {move(catcher)}
+  : m_body              {move(body)},
+    m_exception_name    {exception_name},
+    m_catcher           {move(catcher)},
+    m_exception_address {address::kind::global, nullptr, 0},
+    m_dynamic           {true}
 { }
 
-std::vector<vm::command> ast::try_catch::generate() const
+void ast::try_catch::resolve(resolver& scope)
 {
-  std::vector<vm::command> catcher;
-  catcher.emplace_back(vm::instruction::arg, 0);
-  catcher.emplace_back(vm::instruction::let, m_exception_name);
-  auto catcher_body = m_catcher->generate();
-  copy(begin(catcher_body), end(catcher_body), back_inserter(catcher));
-  catcher.emplace_back(vm::instruction::ret);
-
-  std::vector<vm::command> vec;
-  vec.emplace_back(vm::instruction::push_fn, vm::function_t{1, move(catcher)});
-  vec.emplace_back(vm::instruction::push_catch);
-
-  auto body = m_body->generate();
-  body.emplace_back(vm::instruction::ret);
-  vec.emplace_back(vm::instruction::push_fn, vm::function_t{0, move(body)});
-  vec.emplace_back(vm::instruction::call, 0);
-
-  vec.emplace_back(vm::instruction::pop_catch);
-  return vec;
+  m_dynamic = !scope.in_function();
+
+  scope.enter_block();
+  m_body->resolve(scope);
+  m_body_variables = scope.leave_block();
+
+  scope.enter_block();
+  m_exception_address = scope.declare(m_exception_name);
+  m_catcher->resolve(scope);
+  m_catcher_variables = scope.leave_block();
+}
+
+void ast::try_catch::generate(vm::emitter& out) const
+{
+  // Given body 'b', exception 'e' and catcher 'c', generate the following VM
+  // instructions (the blocks only being entered at the top level):
+  //   try_begin catch
+  //   eblk
+  //   b
+  //   lblk
+  //   try_end
+  //   jmp end
+  // catch:
+  //   eblk
+  //   let e
+  //   c
+  //   lblk
+  // end:
+  // try_begin and try_end never make it as far as the VM; vm::optimize turns
+  // them into an entry in the function's handler table, so running the body
+  // costs nothing extra unless it actually throws
+  auto catcher = out.make_label();
+  auto end = out.make_label();
+
+  out.emit(vm::instruction::try_begin, catcher);
+  if (m_dynamic)
+    out.emit(vm::instruction::eblk);
+  make_cells(out, m_body_variables);
+  m_body->generate(out);
+  if (m_dynamic)
+    out.emit(vm::instruction::lblk);
+  out.emit(vm::instruction::try_end);
+  out.emit(vm::instruction::jmp, end);
+
+  out.place(catcher);
+  if (m_dynamic)
+    out.emit(vm::instruction::eblk);
+  make_cells(out, m_catcher_variables);
+  out.emit(m_exception_address.let(m_exception_name));
+  m_catcher->generate(out);
+  if (m_dynamic)
+    out.emit(vm::instruction::lblk);
+  out.place(end);
 }
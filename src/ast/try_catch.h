@@ -3,6 +3,9 @@
 
 #include "expression.h"
 
+#include "ast/resolver.h"
+#include "vm/instruction.h"
+
 namespace vv {
 
 namespace ast {
@@ -13,12 +16,20 @@ public:
             symbol exception_name,
             std::unique_ptr<expression>&& catcher);
 
-  std::vector<vm::command> generate() const override;
+  void resolve(resolver& scope) override;
+  void generate(vm::emitter& out) const override;
 
 private:
   std::unique_ptr<expression> m_body;
   symbol m_exception_name;
   std::unique_ptr<expression> m_catcher;
+
+  address m_exception_address;
+  block_variables m_body_variables;
+  block_variables m_catcher_variables;
+  // The body and catcher are each run in a block of their own; like any other
+  // block, it's only entered at runtime when at the top level
+  bool m_dynamic;
 };
 
 }
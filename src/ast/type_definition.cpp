@@ -1,9 +1,7 @@
 #include "type_definition.h"
 
-#include "gc.h"
-#include "vm/instruction.h"
-
-#include <boost/variant/get.hpp>
+#include "ast/resolver.h"
+#include "vm/emitter.h"
 
 using namespace vv;
 
@@ -17,16 +15,20 @@ ast::type_definition::type_definition(
     m_methods {move(methods)}
 { }
 
-std::vector<vm::command> ast::type_definition::generate() const
+void ast::type_definition::resolve(resolver& scope)
+{
+  // Types themselves are always looked up by name, so there's nothing to
+  // declare
+  for (auto& i : m_methods)
+    i.second.resolve_function(scope);
+}
+
+void ast::type_definition::generate(vm::emitter& out) const
 {
-  std::unordered_map<symbol, vm::function_t> methods;
-  for (const auto& i : m_methods) {
-    auto arg = i.second.generate().front().arg;
-    methods[i.first] = boost::get<vm::function_t>(arg);
-  }
+  vm::type_t type{m_name, m_parent, {}};
+  for (const auto& i : m_methods)
+    type.methods[i.first] = std::make_shared<const vm::function_t>(
+        i.second.generate_function());
 
-  std::vector<vm::command> vec;
-  vec.emplace_back(vm::instruction::push_type,
-                   vm::type_t{m_name, m_parent, methods});
-  return vec;
+  out.emit(vm::instruction::push_type, out.constants().add(std::move(type)));
 }
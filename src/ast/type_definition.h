@@ -22,7 +22,8 @@ public:
                     m_methods);
 
 
-  std::vector<vm::command> generate() const override;
+  void resolve(resolver& scope) override;
+  void generate(vm::emitter& out) const override;
 
 private:
   symbol m_name;
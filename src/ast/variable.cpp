@@ -1,14 +1,24 @@
 #include "variable.h"
 
-#include "vm/instruction.h"
+#include "vm/emitter.h"
 
 using namespace vv;
 
-ast::variable::variable(symbol name) : m_name{name} { }
+ast::variable::variable(symbol name)
+  : m_name    {name},
+    m_address {address::kind::global, nullptr, 0}
+{ }
 
-std::vector<vm::command> ast::variable::generate() const
+void ast::variable::resolve(resolver& scope)
+{
+  if (m_name != symbol{"self"})
+    m_address = scope.lookup(m_name);
+}
+
+void ast::variable::generate(vm::emitter& out) const
 {
   if (m_name == symbol{"self"})
-    return { {vm::instruction::self} };
-  return { {vm::instruction::read, m_name} };
+    out.emit(vm::instruction::self);
+  else
+    out.emit(m_address.read(m_name));
 }
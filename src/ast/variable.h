@@ -3,6 +3,8 @@
 
 #include "expression.h"
 
+#include "ast/resolver.h"
+
 #include "symbol.h"
 
 namespace vv {
@@ -13,10 +15,12 @@ class variable : public expression {
 public:
   variable(symbol name);
 
-  std::vector<vm::command> generate() const override;
+  void resolve(resolver& scope) override;
+  void generate(vm::emitter& out) const override;
 
 private:
   symbol m_name;
+  address m_address;
 };
 
 }
@@ -1,19 +1,26 @@
 #include "variable_declaration.h"
 
-#include "vm/instruction.h"
+#include "vm/emitter.h"
 
 using namespace vv;
 
 ast::variable_declaration::variable_declaration(
     symbol name,
     std::unique_ptr<expression>&& value)
-  : m_name  {name},
-    m_value {move(value)}
+  : m_name    {name},
+    m_value   {move(value)},
+    m_address {address::kind::global, nullptr, 0}
 { }
 
-std::vector<vm::command> ast::variable_declaration::generate() const
+void ast::variable_declaration::resolve(resolver& scope)
 {
-  auto vec = m_value->generate();
-  vec.emplace_back(vm::instruction::let, m_name);
-  return vec;
+  // Resolve the value first, so e.g. 'let x = x + 1' refers to any outer x
+  m_value->resolve(scope);
+  m_address = scope.declare(m_name);
+}
+
+void ast::variable_declaration::generate(vm::emitter& out) const
+{
+  m_value->generate(out);
+  out.emit(m_address.let(m_name));
 }
@@ -3,6 +3,8 @@
 
 #include "expression.h"
 
+#include "ast/resolver.h"
+
 #include "symbol.h"
 
 namespace vv {
@@ -13,11 +15,13 @@ class variable_declaration : public expression {
 public:
   variable_declaration(symbol name, std::unique_ptr<expression>&& value);
 
-  std::vector<vm::command> generate() const override;
+  void resolve(resolver& scope) override;
+  void generate(vm::emitter& out) const override;
 
 private:
   symbol m_name;
   std::unique_ptr<expression> m_value;
+  address m_address;
 };
 
 }
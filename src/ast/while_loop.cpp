@@ -1,8 +1,7 @@
 #include "while_loop.h"
 
 #include "lang_utils.h"
-#include "value/nil.h"
-#include "vm/instruction.h"
+#include "vm/emitter.h"
 
 using namespace vv;
 
@@ -12,18 +11,23 @@ ast::while_loop::while_loop(std::unique_ptr<expression>&& test,
     m_body {move(body)}
 { }
 
-std::vector<vm::command> ast::while_loop::generate() const
+void ast::while_loop::resolve(resolver& scope)
 {
-  auto vec = m_test->generate();
-  vec.emplace_back(vm::instruction::jmp_false);
-  auto test_jump_idx = vec.size() - 1;
+  m_test->resolve(scope);
+  m_body->resolve(scope);
+}
 
-  auto body = m_body->generate();
-  copy(begin(body), end(body), back_inserter(vec));
+void ast::while_loop::generate(vm::emitter& out) const
+{
+  auto test = out.make_label();
+  auto end = out.make_label();
 
-  vec.emplace_back(vm::instruction::jmp, -static_cast<int>(vec.size()));
-  vec.emplace_back(vm::instruction::push_nil);
-  vec[test_jump_idx].arg = static_cast<int>(vec.size() - 1 - test_jump_idx);
+  out.place(test);
+  m_test->generate(out);
+  out.emit(vm::instruction::jmp_false, end);
+  m_body->generate(out);
+  out.emit(vm::instruction::jmp, test);
 
-  return vec;
+  out.place(end);
+  out.emit(vm::instruction::push_nil);
 }
@@ -12,7 +12,8 @@ public:
   while_loop(std::unique_ptr<expression>&& test,
              std::unique_ptr<expression>&& body);
 
-  std::vector<vm::command> generate() const override;
+  void resolve(resolver& scope) override;
+  void generate(vm::emitter& out) const override;
 
 private:
   std::unique_ptr<expression> m_test;
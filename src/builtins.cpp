@@ -20,25 +20,25 @@ vv::symbol sym::call{"call"};
 
 namespace {
 
-value::base* fn_print(vm::machine& vm)
+value::handle fn_print(vm::machine&, value::handle, value::arg_span args)
 {
-  auto arg = get_arg(vm, 0);
+  auto arg = args[0];
 
-  if (arg->type == &type::string)
-    std::cout << static_cast<value::string*>(arg)->val;
+  if (arg.type() == &type::string)
+    std::cout << static_cast<value::string&>(*arg).val;
   else
-    std::cout << arg->value();
-  return gc::alloc<value::nil>( );
+    std::cout << arg.value();
+  return value::handle::nil();
 }
 
-value::base* fn_puts(vm::machine& vm)
+value::handle fn_puts(vm::machine& vm, value::handle self, value::arg_span args)
 {
-  auto ret = fn_print(vm);
+  auto ret = fn_print(vm, self, args);
   std::cout << '\n';
   return ret;
 }
 
-value::base* fn_gets(vm::machine&)
+value::handle fn_gets(vm::machine&, value::handle, value::arg_span)
 {
   std::string str;
   getline(std::cin, str);
@@ -46,7 +46,7 @@ value::base* fn_gets(vm::machine&)
   return gc::alloc<value::string>( str );
 }
 
-value::base* fn_quit(vm::machine&)
+value::handle fn_quit(vm::machine&, value::handle, value::arg_span)
 {
   gc::empty();
   exit(0);
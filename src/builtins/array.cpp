@@ -13,42 +13,57 @@ namespace {
 
 // Array {{{
 
-value::base* fn_array_init(vm::machine& vm)
+value::handle fn_array_init(vm::machine& vm,
+                            value::handle self,
+                            value::arg_span args)
 {
-  auto arr = static_cast<value::array*>(&*vm.frame->self);
-  auto arg = get_arg(vm, 0);
-  if (arg->type != &type::array)
+  auto arr = static_cast<value::array*>(self.get());
+  auto arg = args[0];
+  if (arg.type() != &type::array)
     return throw_exception("Arrays can only be constructed from other Arrays", vm);
-  arr->val = static_cast<value::array*>( arg )->val;
+  auto old_size = arr->owned_size();
+  arr->val = static_cast<value::array*>(arg.get())->val;
+  for (auto i : arr->val)
+    gc::write_barrier(*arr, i);
+  gc::resized(*arr, old_size);
   return arr;
 }
 
-value::base* fn_array_size(vm::machine& vm)
+value::handle fn_array_size(vm::machine&, value::handle self, value::arg_span)
 {
-  auto sz = static_cast<value::array&>(*vm.frame->self).val.size();
-  return gc::alloc<value::integer>( static_cast<int>(sz) );
+  auto sz = static_cast<value::array&>(*self).val.size();
+  return value::handle{static_cast<int>(sz)};
 }
 
-value::base* fn_array_append(vm::machine& vm)
+value::handle fn_array_append(vm::machine&,
+                              value::handle self,
+                              value::arg_span args)
 {
-  auto arg = get_arg(vm, 0);
-  if (arg->type == &type::array) {
-    auto& arr = static_cast<value::array&>(*vm.frame->self).val;
-    const auto& new_val = static_cast<value::array*>(arg)->val;
+  auto arg = args[0];
+  auto old_size = self.get()->owned_size();
+  if (arg.type() == &type::array) {
+    auto& arr = static_cast<value::array&>(*self).val;
+    const auto& new_val = static_cast<value::array*>(arg.get())->val;
     copy(begin(new_val), end(new_val), back_inserter(arr));
+    for (auto i : new_val)
+      gc::write_barrier(*self, i);
   } else {
-    static_cast<value::array&>(*vm.frame->self).val.push_back(arg);
+    static_cast<value::array&>(*self).val.push_back(arg);
+    gc::write_barrier(*self, arg);
   }
-  return &*vm.frame->self;
+  gc::resized(*self, old_size);
+  return self;
 }
 
-value::base* fn_array_at(vm::machine& vm)
+value::handle fn_array_at(vm::machine& vm,
+                          value::handle self,
+                          value::arg_span args)
 {
-  auto arg = get_arg(vm, 0);
-  if (arg->type != &type::integer)
+  auto arg = args[0];
+  if (!arg.is_int())
     return throw_exception("Index must be an Integer", vm);
-  auto val = static_cast<value::integer*>(arg)->val;
-  const auto& arr = static_cast<value::array&>(*vm.frame->self).val;
+  auto val = arg.as_int();
+  const auto& arr = static_cast<value::array&>(*self).val;
   if (arr.size() <= static_cast<unsigned>(val) || val < 0)
     return throw_exception("Out of range (expected 0-"
                            + std::to_string(arr.size()) + ", got "
@@ -57,94 +72,116 @@ value::base* fn_array_at(vm::machine& vm)
   return arr[static_cast<unsigned>(val)];
 }
 
-value::base* fn_array_set_at(vm::machine& vm)
+value::handle fn_array_set_at(vm::machine& vm,
+                              value::handle self,
+                              value::arg_span args)
 {
-  auto arg = get_arg(vm, 0);
-  if (arg->type != &type::integer)
+  auto arg = args[0];
+  if (!arg.is_int())
     return throw_exception("Index must be an Integer", vm);
-  auto val = static_cast<value::integer*>(arg)->val;
-  auto& arr = static_cast<value::array&>(*vm.frame->self).val;
+  auto val = arg.as_int();
+  auto& arr = static_cast<value::array&>(*self).val;
   if (arr.size() <= static_cast<unsigned>(val) || val < 0)
     return throw_exception("Out of range (expected 0-"
                            + std::to_string(arr.size()) + ", got "
                            + std::to_string(val) + ")",
                            vm);
-  return arr[static_cast<unsigned>(val)] = get_arg(vm, 1);
+  arr[static_cast<unsigned>(val)] = args[1];
+  gc::write_barrier(*self, args[1]);
+  return args[1];
 }
 
-value::base* fn_array_start(vm::machine& vm)
+value::handle fn_array_start(vm::machine&, value::handle self, value::arg_span)
 {
-  auto& self = static_cast<value::array&>(*vm.frame->self);
-  return gc::alloc<value::array_iterator>( self );
+  auto& arr = static_cast<value::array&>(*self);
+  return gc::alloc<value::array_iterator>( arr );
 }
 
-value::base* fn_array_end(vm::machine& vm)
+value::handle fn_array_end(vm::machine&, value::handle self, value::arg_span)
 {
-  auto& self = static_cast<value::array&>(*vm.frame->self);
-  auto iter = gc::alloc<value::array_iterator>( self );
-  static_cast<value::array_iterator*>(iter)->idx = self.val.size();
+  auto& arr = static_cast<value::array&>(*self);
+  auto iter = gc::alloc<value::array_iterator>( arr );
+  static_cast<value::array_iterator*>(iter)->idx = arr.val.size();
   return iter;
 }
 
-value::base* fn_array_add(vm::machine& vm)
+value::handle fn_array_add(vm::machine& vm,
+                           value::handle self,
+                           value::arg_span args)
 {
-  auto arr = static_cast<value::array*>(&*vm.frame->self);
-  auto arg = get_arg(vm, 0);
-  if (arg->type != &type::array)
+  auto arr = static_cast<value::array*>(self.get());
+  auto arg = args[0];
+  if (arg.type() != &type::array)
     return throw_exception("Only Arrays can be added to other Arrays", vm);
-  auto other = static_cast<value::array*>(arg);
+  auto other = static_cast<value::array*>(arg.get());
+  auto old_size = arr->owned_size();
   copy(begin(other->val), end(other->val), back_inserter(arr->val));
+  for (auto i : other->val)
+    gc::write_barrier(*arr, i);
+  gc::resized(*arr, old_size);
   return arr;
 }
 
 // }}}
 // Iterator {{{
 
-value::base* fn_array_iterator_at_start(vm::machine& vm)
+value::handle fn_array_iterator_at_start(vm::machine&,
+                                         value::handle self,
+                                         value::arg_span)
 {
-  auto iter = static_cast<value::array_iterator*>(&*vm.frame->self);
-  return gc::alloc<value::boolean>( iter->idx == 0 );
+  auto iter = static_cast<value::array_iterator*>(self.get());
+  return value::handle{iter->idx == 0};
 }
 
-value::base* fn_array_iterator_at_end(vm::machine& vm)
+value::handle fn_array_iterator_at_end(vm::machine&,
+                                       value::handle self,
+                                       value::arg_span)
 {
-  auto iter = static_cast<value::array_iterator*>(&*vm.frame->self);
-  return gc::alloc<value::boolean>( iter->idx == iter->arr.val.size() );
+  auto iter = static_cast<value::array_iterator*>(self.get());
+  return value::handle{iter->idx == iter->arr.val.size()};
 }
 
-value::base* fn_array_iterator_get(vm::machine& vm)
+value::handle fn_array_iterator_get(vm::machine& vm,
+                                    value::handle self,
+                                    value::arg_span)
 {
-  auto iter = static_cast<value::array_iterator*>(&*vm.frame->self);
+  auto iter = static_cast<value::array_iterator*>(self.get());
   if (iter->idx == iter->arr.val.size())
     return throw_exception("ArrayIterator is at end of array", vm);
   return iter->arr.val[iter->idx];
 }
 
-value::base* fn_array_iterator_increment(vm::machine& vm)
+value::handle fn_array_iterator_increment(vm::machine& vm,
+                                          value::handle self,
+                                          value::arg_span)
 {
-  auto iter = static_cast<value::array_iterator*>(&*vm.frame->self);
+  auto iter = static_cast<value::array_iterator*>(self.get());
   if (iter->idx == iter->arr.val.size())
     return throw_exception("ArrayIterators cannot be incremented past end", vm);
   iter->idx += 1;
   return iter;
 }
 
-value::base* fn_array_iterator_decrement(vm::machine& vm)
+value::handle fn_array_iterator_decrement(vm::machine& vm,
+                                          value::handle self,
+                                          value::arg_span)
 {
-  auto iter = static_cast<value::array_iterator*>(&*vm.frame->self);
+  auto iter = static_cast<value::array_iterator*>(self.get());
   if (iter->idx == 0)
     return throw_exception("ArrayIterators cannot be decremented past start", vm);
   iter->idx -= 1;
   return iter;
 }
 
-value::base* fn_array_iterator_add(vm::machine& vm)
+value::handle fn_array_iterator_add(vm::machine& vm,
+                                    value::handle self,
+                                    value::arg_span args)
 {
-  auto iter = static_cast<value::array_iterator*>(&*vm.frame->self);
-  auto arg = get_arg(vm, 0);
-  if (arg->type != &builtin::type::integer)
+  auto iter = static_cast<value::array_iterator*>(self.get());
+  auto arg = args[0];
+  if (!arg.is_int())
     return throw_exception("Only Integers can be added to ArrayIterators", vm);
-  auto offset = static_cast<value::integer*>(arg)->val;
+  auto offset = arg.as_int();
 
   if (static_cast<int>(iter->idx) + offset < 0)
     return throw_exception("ArrayIterators cannot be decremented past start", vm);
@@ -156,13 +193,15 @@ value::base* fn_array_iterator_add(vm::machine& vm)
   return other;
 }
 
-value::base* fn_array_iterator_subtract(vm::machine& vm)
+value::handle fn_array_iterator_subtract(vm::machine& vm,
+                                         value::handle self,
+                                         value::arg_span args)
 {
-  auto iter = static_cast<value::array_iterator*>(&*vm.frame->self);
-  auto arg = get_arg(vm, 0);
-  if (arg->type != &builtin::type::integer)
+  auto iter = static_cast<value::array_iterator*>(self.get());
+  auto arg = args[0];
+  if (!arg.is_int())
     return throw_exception("Only Integers can be added to ArrayIterators", vm);
-  auto offset = static_cast<value::integer*>(arg)->val;
+  auto offset = arg.as_int();
 
   if (!offset)
     return throw_exception("Only numeric types can be added to ArrayIterators", vm);
@@ -176,20 +215,24 @@ value::base* fn_array_iterator_subtract(vm::machine& vm)
   return other;
 }
 
-value::base* fn_array_iterator_equals(vm::machine& vm)
+value::handle fn_array_iterator_equals(vm::machine&,
+                                       value::handle self,
+                                       value::arg_span args)
 {
-  auto iter = static_cast<value::array_iterator*>(&*vm.frame->self);
-  auto other = static_cast<value::array_iterator*>(get_arg(vm, 0));
-  return gc::alloc<value::boolean>( &iter->arr == &other->arr
-                                  && iter->idx == other->idx );
+  auto iter = static_cast<value::array_iterator*>(self.get());
+  auto other = static_cast<value::array_iterator*>(args[0].get());
+  return value::handle{&iter->arr == &other->arr
+                      && iter->idx == other->idx};
 }
 
-value::base* fn_array_iterator_unequal(vm::machine& vm)
+value::handle fn_array_iterator_unequal(vm::machine&,
+                                        value::handle self,
+                                        value::arg_span args)
 {
-  auto iter = static_cast<value::array_iterator*>(&*vm.frame->self);
-  auto other = static_cast<value::array_iterator*>(get_arg(vm, 0));
-  return gc::alloc<value::boolean>( &iter->arr != &other->arr
-                                  || iter->idx != other->idx );
+  auto iter = static_cast<value::array_iterator*>(self.get());
+  auto other = static_cast<value::array_iterator*>(args[0].get());
+  return value::handle{&iter->arr != &other->arr
+                      || iter->idx != other->idx};
 }
 
 // }}}
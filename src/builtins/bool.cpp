@@ -1,8 +1,6 @@
 #include "builtins.h"
 
-#include "gc.h"
 #include "lang_utils.h"
-#include "value/boolean.h"
 #include "value/builtin_function.h"
 
 using namespace vv;
@@ -10,18 +8,18 @@ using namespace builtin;
 
 namespace {
 
-value::base* fn_bool_init(vm::machine& vm)
+value::handle fn_bool_init(vm::machine&, value::handle, value::arg_span args)
 {
-  auto arg = get_arg(vm, 0);
-  if (arg->type == &type::boolean)
+  auto arg = args[0];
+  if (arg.is_bool())
     return arg;
-  return gc::alloc<value::boolean>( truthy(arg) );
+  return value::handle{truthy(arg)};
 }
 
 value::builtin_function bool_init {fn_bool_init, 1};
 
 }
 
-value::type type::boolean {gc::alloc<value::boolean>, {
+value::type type::boolean {[]{ return value::handle{true}; }, {
   { {"init"}, &bool_init }
 }, builtin::type::object, {"Bool"}};
@@ -12,37 +12,60 @@ namespace {
 
 // dictionary {{{
 
-value::base* fn_dictionary_init(vm::machine& vm)
+value::handle fn_dictionary_init(vm::machine& vm,
+                                 value::handle self,
+                                 value::arg_span args)
 {
-  auto dict = static_cast<value::dictionary*>(&*vm.frame->self);
-  auto arg = get_arg(vm, 0);
-  if (arg->type != &type::dictionary)
+  auto dict = static_cast<value::dictionary*>(self.get());
+  auto arg = args[0];
+  if (arg.type() != &type::dictionary)
     return throw_exception("Dictionaries can only be constructed from other Dictionaries",
                            vm);
-  dict->val = static_cast<value::dictionary*>( arg )->val;
+  auto old_size = dict->owned_size();
+  dict->val = static_cast<value::dictionary*>(arg.get())->val;
+  for (const auto& i : dict->val) {
+    gc::write_barrier(*dict, i.first);
+    gc::write_barrier(*dict, i.second);
+  }
+  gc::resized(*dict, old_size);
   return dict;
 }
 
-value::base* fn_dictionary_size(vm::machine& vm)
+value::handle fn_dictionary_size(vm::machine&,
+                                 value::handle self,
+                                 value::arg_span)
 {
-  auto sz = static_cast<value::dictionary&>(*vm.frame->self).val.size();
-  return gc::alloc<value::integer>( static_cast<int>(sz) );
+  auto sz = static_cast<value::dictionary&>(*self).val.size();
+  return value::handle{static_cast<int>(sz)};
 }
 
-value::base* fn_dictionary_at(vm::machine& vm)
+value::handle fn_dictionary_at(vm::machine&,
+                               value::handle self,
+                               value::arg_span args)
 {
-  auto& dict = static_cast<value::dictionary&>(*vm.frame->self);
-  auto arg = get_arg(vm, 0);
-  if (!dict.val.count(arg))
-    dict.val[arg] = gc::alloc<value::nil>( );
+  auto& dict = static_cast<value::dictionary&>(*self);
+  auto arg = args[0];
+  if (!dict.val.count(arg)) {
+    auto old_size = dict.owned_size();
+    dict.val[arg] = value::handle::nil();
+    gc::write_barrier(dict, arg);
+    gc::resized(dict, old_size);
+  }
   return dict.val[arg];
 }
 
-value::base* fn_dictionary_set_at(vm::machine& vm)
+value::handle fn_dictionary_set_at(vm::machine&,
+                                   value::handle self,
+                                   value::arg_span args)
 {
-  auto& dict = static_cast<value::dictionary&>(*vm.frame->self);
-  auto arg = get_arg(vm, 0);
-  return dict.val[arg] = get_arg(vm, 1);
+  auto& dict = static_cast<value::dictionary&>(*self);
+  auto arg = args[0];
+  auto old_size = dict.owned_size();
+  dict.val[arg] = args[1];
+  gc::write_barrier(dict, arg);
+  gc::write_barrier(dict, args[1]);
+  gc::resized(dict, old_size);
+  return args[1];
 }
 
 // }}}
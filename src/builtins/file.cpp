@@ -14,53 +14,59 @@ using namespace builtin;
 
 namespace {
 
-value::base* fn_file_init(vm::machine& vm)
+value::handle fn_file_init(vm::machine& vm,
+                           value::handle self,
+                           value::arg_span args)
 {
-  auto arg = get_arg(vm, 0);
-  if (arg->type != &type::string)
+  auto arg = args[0];
+  if (arg.type() != &type::string)
     return throw_exception("Files can only be constructed from Strings", vm);
-  auto& self = static_cast<value::file&>(*vm.frame->self);
-  const auto& filename = static_cast<value::string*>(arg)->val;
-  self.val = std::fstream{filename};
-  self.name = filename;
-  std::getline(self.val, self.cur_line);
-  return &self;
+  auto& file = static_cast<value::file&>(*self);
+  const auto& filename = static_cast<value::string*>(arg.get())->val;
+  file.val = std::fstream{filename};
+  file.name = filename;
+  std::getline(file.val, file.cur_line);
+  return &file;
 }
 
-value::base* fn_file_contents(vm::machine& vm)
+value::handle fn_file_contents(vm::machine&,
+                               value::handle self,
+                               value::arg_span)
 {
-  auto& self = static_cast<value::file&>(*vm.frame->self);
+  auto& file = static_cast<value::file&>(*self);
   std::ostringstream str_stream;
-  str_stream << self.cur_line;
-  str_stream << self.val.rdbuf();
-  self.cur_line.clear();
+  str_stream << file.cur_line;
+  str_stream << file.val.rdbuf();
+  file.cur_line.clear();
   return gc::alloc<value::string>( str_stream.str() );
 }
 
-value::base* fn_file_start(vm::machine& vm)
+value::handle fn_file_start(vm::machine&, value::handle self, value::arg_span)
 {
-  return &*vm.frame->self;
+  return self;
 }
 
-value::base* fn_file_get(vm::machine& vm)
+value::handle fn_file_get(vm::machine&, value::handle self, value::arg_span)
 {
-  const auto& self = static_cast<value::file&>(*vm.frame->self);
-  return gc::alloc<value::string>( self.cur_line );
+  const auto& file = static_cast<value::file&>(*self);
+  return gc::alloc<value::string>( file.cur_line );
 }
 
-value::base* fn_file_increment(vm::machine& vm)
+value::handle fn_file_increment(vm::machine& vm,
+                                value::handle self,
+                                value::arg_span)
 {
-  auto& self = static_cast<value::file&>(*vm.frame->self);
-  if (self.val.peek() == EOF)
+  auto& file = static_cast<value::file&>(*self);
+  if (file.val.peek() == EOF)
     return throw_exception("Cannot read past end of File", vm);
-  std::getline(self.val, self.cur_line);
-  return &self;
+  std::getline(file.val, file.cur_line);
+  return &file;
 }
 
-value::base* fn_file_at_end(vm::machine& vm)
+value::handle fn_file_at_end(vm::machine&, value::handle self, value::arg_span)
 {
-  auto& self = static_cast<value::file&>(*vm.frame->self);
-  return gc::alloc<value::boolean>(self.val.peek() == EOF && !self.cur_line.size());
+  auto& file = static_cast<value::file&>(*self);
+  return value::handle{file.val.peek() == EOF && !file.cur_line.size()};
 }
 
 value::builtin_function file_init      {fn_file_init,      1};
@@ -1,10 +1,7 @@
 #include "builtins.h"
 
 #include "lang_utils.h"
-#include "gc.h"
 #include "value/builtin_function.h"
-#include "value/floating_point.h"
-#include "value/integer.h"
 
 using namespace vv;
 using namespace builtin;
@@ -12,59 +9,60 @@ using value::builtin_function;
 
 namespace {
 
-bool is_float(value::base* boxed) noexcept
+bool is_float(value::handle val) noexcept
 {
-  return boxed->type == &type::floating_point || boxed->type == &type::integer;
+  return val.is_float() || val.is_int();
 }
 
-double to_float(value::base* boxed) noexcept
+double to_float(value::handle val) noexcept
 {
-  if (boxed->type == &type::floating_point)
-    return static_cast<const value::floating_point*>(boxed)->val;
-  return static_cast<double>(static_cast<value::integer*>(boxed)->val);
+  if (val.is_float())
+    return val.as_float();
+  return static_cast<double>(val.as_int());
 }
 
 template <typename F>
 auto fn_floating_point_op(const F& op)
 {
-  return [=](vm::machine& vm)
+  return [=](vm::machine& vm, value::handle self, value::arg_span args)
   {
-    if (!is_float(get_arg(vm, 0)))
+    if (!is_float(args[0]))
       return throw_exception("Right-hand argument is not a Float", vm);
-    return gc::alloc<value::floating_point>( op(to_float(&*vm.frame->self),
-                                                to_float(get_arg(vm, 0))) );
+    return value::handle{op(to_float(self),
+                            to_float(args[0]))};
   };
 }
 
 template <typename F>
 auto fn_float_bool_op(const F& op)
 {
-  return [=](vm::machine& vm)
+  return [=](vm::machine& vm, value::handle self, value::arg_span args)
   {
-    if (!is_float(get_arg(vm, 0)))
+    if (!is_float(args[0]))
       return throw_exception("Right-hand argument is not a Float", vm);
-    return gc::alloc<value::boolean>( op(to_float(&*vm.frame->self),
-                                         to_float(get_arg(vm, 0))) );
+    return value::handle{op(to_float(self),
+                            to_float(args[0]))};
   };
 }
 
 template <typename F>
 auto fn_floating_point_monop(const F& op)
 {
-  return [=](vm::machine& vm)
+  return [=](vm::machine&, value::handle self, value::arg_span)
   {
-    return gc::alloc<value::floating_point>( op(to_float(&*vm.frame->self)) );
+    return value::handle{op(to_float(self))};
   };
 }
 
-value::base* fn_floating_point_divides(vm::machine& vm)
+value::handle fn_floating_point_divides(vm::machine& vm,
+                                        value::handle self,
+                                        value::arg_span args)
 {
-  if (!is_float(get_arg(vm, 0)))
+  if (!is_float(args[0]))
     return throw_exception("Right-hand argument is not a Float", vm);
-  if (to_float(get_arg(vm, 0)) == 0)
+  if (to_float(args[0]) == 0)
     return throw_exception("Cannot divide by zero", vm);
-  return gc::alloc<value::floating_point>( to_float(&*vm.frame->self) /
-                                           to_float(get_arg(vm, 0)) );
+  return value::handle{to_float(self) / to_float(args[0])};
 }
 
 builtin_function flt_add      {fn_floating_point_op(std::plus<double>{}),       1};
@@ -1,10 +1,7 @@
 #include "builtins.h"
 
-#include "gc.h"
 #include "lang_utils.h"
 #include "value/builtin_function.h"
-#include "value/integer.h"
-#include "value/floating_point.h"
 
 using namespace vv;
 using namespace builtin;
@@ -12,14 +9,14 @@ using value::builtin_function;
 
 namespace {
 
-int to_int(value::base* boxed)
+int to_int(value::handle val)
 {
-  return static_cast<value::integer*>(boxed)->val;
+  return val.as_int();
 }
 
-double to_float(value::base* boxed)
+double to_float(value::handle val)
 {
-  return static_cast<value::floating_point*>(boxed)->val;
+  return val.as_float();
 }
 
 // Generic binop generators, if the operator doesn't require any special casing
@@ -27,134 +24,139 @@ double to_float(value::base* boxed)
 template <typename F>
 auto fn_int_or_flt_op(const F& op)
 {
-  return [=](vm::machine& vm)
+  return [=](vm::machine& vm, value::handle self, value::arg_span args)
   {
-    auto left = to_int(&*vm.frame->self);
-    auto arg = get_arg(vm, 0);
-    if (arg->type == &type::floating_point)
-      return gc::alloc<value::floating_point>( op(left, to_float(arg)) );
+    auto left = to_int(self);
+    auto arg = args[0];
+    if (arg.is_float())
+      return value::handle{op(left, to_float(arg))};
 
-    if (arg->type != &type::integer)
+    if (!arg.is_int())
       return throw_exception("Right-hand argument is not an Integer", vm);
-    // Apparently moving from integers is a bad idea; without the explicit int&&
-    // template parameter, 0 is always passed to value::integer::integer
-    return gc::alloc<value::integer, int&&>( op(left, to_int(arg)) );
+    return value::handle{op(left, to_int(arg))};
   };
 }
 
 template <typename F>
 auto fn_integer_op(const F& op)
 {
-  return [=](vm::machine& vm)
+  return [=](vm::machine& vm, value::handle self, value::arg_span args)
   {
-    auto left = to_int(&*vm.frame->self);
-    if (get_arg(vm, 0)->type != &type::integer)
+    auto left = to_int(self);
+    if (!args[0].is_int())
       return throw_exception("Right-hand argument is not an Integer", vm);
-    auto right = to_int(get_arg(vm, 0));
+    auto right = to_int(args[0]);
 
-    return gc::alloc<value::integer, int&&>( op(left, right) );
+    return value::handle{op(left, right)};
   };
 }
 
 template <typename F>
 auto fn_integer_monop(const F& op)
 {
-  return [=](vm::machine& vm)
+  return [=](vm::machine&, value::handle self, value::arg_span)
   {
-    return gc::alloc<value::integer, int&&>( op(to_int(&*vm.frame->self)) );
+    return value::handle{op(to_int(self))};
   };
 }
 
 template <typename F>
 auto fn_int_to_flt_monop(const F& op)
 {
-  return [=](vm::machine& vm)
+  return [=](vm::machine&, value::handle self, value::arg_span)
   {
-    return gc::alloc<value::floating_point>( op(to_int(&*vm.frame->self)) );
+    return value::handle{op(to_int(self))};
   };
 }
 
 template <typename F>
 auto fn_int_bool_op(const F& op)
 {
-  return [=](vm::machine& vm)
+  return [=](vm::machine& vm, value::handle self, value::arg_span args)
   {
 
-    auto arg = get_arg(vm, 0);
-    if (arg->type == &type::floating_point) {
-      auto left = to_int(&*vm.frame->self);
+    auto arg = args[0];
+    if (arg.is_float()) {
+      auto left = to_int(self);
       auto right = to_float(arg);
-      return gc::alloc<value::boolean>( op(left, right) );
+      return value::handle{op(left, right)};
     }
-    if (arg->type != &type::integer)
+    if (!arg.is_int())
       return throw_exception("Right-hand argument is not an Integer", vm);
 
-    auto left = to_int(&*vm.frame->self);
+    auto left = to_int(self);
     auto right = to_int(arg);
-    return gc::alloc<value::boolean>( op(left, right) );
+    return value::handle{op(left, right)};
   };
 }
 
-value::base* fn_integer_divides(vm::machine& vm)
+value::handle fn_integer_divides(vm::machine& vm,
+                                 value::handle self,
+                                 value::arg_span args)
 {
-  auto left = to_int(&*vm.frame->self);
-  auto arg = get_arg(vm, 0);
-  if (arg->type == &type::floating_point) {
+  auto left = to_int(self);
+  auto arg = args[0];
+  if (arg.is_float()) {
     if (to_float(arg) == 0.0)
       return throw_exception("cannot divide by zero", vm);
-    return gc::alloc<value::floating_point>( left / to_float(arg) );
+    return value::handle{left / to_float(arg)};
   }
 
-  if (arg->type != &type::integer)
+  if (!arg.is_int())
     return throw_exception("Right-hand argument is not an Integer", vm);
   if (to_int(arg) == 0)
     return throw_exception("cannot divide by zero", vm);
-  return gc::alloc<value::integer>( left / to_int(arg));
+  return value::handle{left / to_int(arg)};
 }
 
-bool boxed_integer_equal(vm::machine& vm)
+bool integer_equal(value::handle self, value::handle arg)
 {
-  auto arg = get_arg(vm, 0);
-  if (arg->type == &type::floating_point) {
-    auto left = to_int(&*vm.frame->self);
+  if (arg.is_float()) {
+    auto left = to_int(self);
     auto right = to_float(arg);
     return left == right;
   }
-  if (arg->type != &type::integer)
+  if (!arg.is_int())
     return false;
 
-  auto left = to_int(&*vm.frame->self);
+  auto left = to_int(self);
   auto right = to_int(arg);
   return left == right;
 }
 
-value::base* fn_integer_equals(vm::machine& vm)
+value::handle fn_integer_equals(vm::machine&,
+                                value::handle self,
+                                value::arg_span args)
 {
-  return gc::alloc<value::boolean>( boxed_integer_equal(vm) );
+  return value::handle{integer_equal(self, args[0])};
 }
 
-value::base* fn_integer_unequal(vm::machine& vm)
+value::handle fn_integer_unequal(vm::machine&,
+                                 value::handle self,
+                                 value::arg_span args)
 {
-  return gc::alloc<value::boolean>( !boxed_integer_equal(vm) );
+  return value::handle{!integer_equal(self, args[0])};
 }
 
-value::base* fn_integer_pow(vm::machine& vm)
+value::handle fn_integer_pow(vm::machine& vm,
+                             value::handle self,
+                             value::arg_span args)
 {
-  auto arg = get_arg(vm, 0);
-  if (arg->type == &type::floating_point) {
-    auto left = to_int(&*vm.frame->self);
+  auto arg = args[0];
+  if (arg.is_float()) {
+    auto left = to_int(self);
     auto right = to_float(arg);
-    return gc::alloc<value::floating_point>( pow(left, right) );
+    return value::handle{pow(left, right)};
   }
 
-  auto left = to_int(&*vm.frame->self);
-  if (arg->type != &type::integer)
+  auto left = to_int(self);
+  if (!arg.is_int())
     return throw_exception("Right-hand argument is not an Integer", vm);
   auto right = to_int(arg);
 
   if (right < 0)
-    return gc::alloc<value::floating_point>( pow(left, right) );
-  return gc::alloc<value::integer>( static_cast<int>(pow(left, right)) );
+    return value::handle{pow(left, right)};
+  return value::handle{static_cast<int>(pow(left, right))};
 }
 
 builtin_function int_add      {fn_int_or_flt_op([](auto a, auto b){ return a + b; }), 1};
@@ -9,24 +9,28 @@ using namespace builtin;
 
 namespace {
 
-value::base* fn_object_equals(vm::machine& vm)
+value::handle fn_object_equals(vm::machine&,
+                               value::handle self,
+                               value::arg_span args)
 {
-  return gc::alloc<value::boolean>( vm.frame->self->equals(*get_arg(vm, 0)) );
+  return value::handle{self.equals(args[0])};
 }
 
-value::base* fn_object_unequal(vm::machine& vm)
+value::handle fn_object_unequal(vm::machine&,
+                                value::handle self,
+                                value::arg_span args)
 {
-  return gc::alloc<value::boolean>( !vm.frame->self->equals(*get_arg(vm, 0)) );
+  return value::handle{!self.equals(args[0])};
 }
 
-value::base* fn_object_not(vm::machine& vm)
+value::handle fn_object_not(vm::machine&, value::handle self, value::arg_span)
 {
-  return gc::alloc<value::boolean>( !truthy(&*vm.frame->self) );
+  return value::handle{!truthy(self)};
 }
 
-value::base* fn_object_type(vm::machine& vm)
+value::handle fn_object_type(vm::machine&, value::handle self, value::arg_span)
 {
-  return vm.frame->self->type;
+  return self.type();
 }
 
 value::builtin_function obj_equals  {fn_object_equals,  1};
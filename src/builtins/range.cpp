@@ -11,70 +11,81 @@ using namespace builtin;
 
 namespace {
 
-value::base* fn_range_init(vm::machine& vm)
+value::handle fn_range_init(vm::machine&,
+                            value::handle self,
+                            value::arg_span args)
 {
-  auto& rng = static_cast<value::range&>(*vm.frame->self);
-  rng.end = get_arg(vm, 1);
-  rng.start = get_arg(vm, 0);
+  auto& rng = static_cast<value::range&>(*self);
+  rng.end = args[1];
+  rng.start = args[0];
+  gc::write_barrier(rng, rng.end);
+  gc::write_barrier(rng, rng.start);
   return &rng;
 }
 
-value::base* fn_range_start(vm::machine& vm)
+value::handle fn_range_start(vm::machine&, value::handle self, value::arg_span)
 {
-  return &*vm.frame->self;
+  return self;
 }
 
-value::base* fn_range_size(vm::machine& vm)
+value::handle fn_range_size(vm::machine& vm,
+                            value::handle self,
+                            value::arg_span)
 {
-  auto& rng = static_cast<value::range&>(*vm.frame->self);
+  auto& rng = static_cast<value::range&>(*self);
   vm.retval = rng.start;
   vm.push_arg();
   vm.retval = rng.end;
-  vm.readm({"subtract"});
-  vm.call(1);
+  vm.call_method({"subtract"}, 1);
   return vm.retval;
 }
 
-value::base* fn_range_at_end(vm::machine& vm)
+value::handle fn_range_at_end(vm::machine& vm,
+                              value::handle self,
+                              value::arg_span)
 {
-  auto& rng = static_cast<value::range&>(*vm.frame->self);
+  auto& rng = static_cast<value::range&>(*self);
   vm.retval = rng.start;
   vm.push_arg();
   vm.retval = rng.end;
-  vm.readm({"greater"});
-  vm.call(1);
-  vm.readm({"not"});
-  vm.call(0);
+  if (!vm.call_method({"greater"}, 1))
+    return vm.retval;
+  vm.call_method({"not"}, 0);
   return vm.retval;
 }
 
-value::base* fn_range_get(vm::machine& vm)
+value::handle fn_range_get(vm::machine&, value::handle self, value::arg_span)
 {
-  return static_cast<value::range&>(*vm.frame->self).start;
+  return static_cast<value::range&>(*self).start;
 }
 
-value::base* fn_range_increment(vm::machine& vm)
+value::handle fn_range_increment(vm::machine& vm,
+                                 value::handle self,
+                                 value::arg_span)
 {
-  auto& rng = static_cast<value::range&>(*vm.frame->self);
+  auto& rng = static_cast<value::range&>(*self);
   vm.push_int(1);
   vm.push_arg();
   vm.retval = rng.start;
-  vm.readm({"add"});
-  vm.call(1);
+  if (!vm.call_method({"add"}, 1))
+    return vm.retval;
   rng.start = vm.retval;
+  gc::write_barrier(rng, rng.start);
   return &rng;
 }
 
-value::base* fn_range_to_arr(vm::machine& vm)
+value::handle fn_range_to_arr(vm::machine& vm,
+                              value::handle self,
+                              value::arg_span)
 {
-  auto& rng = static_cast<value::range&>(*vm.frame->self);
-  std::vector<value::base*> vals;
+  auto& rng = static_cast<value::range&>(*self);
+  std::vector<value::handle> vals;
   auto iter = vm.retval = rng.start;
   for (;;) {
     vm.push_arg();
     vm.retval = rng.end;
-    vm.readm({"greater"});
-    vm.call(1);
+    if (!vm.call_method({"greater"}, 1))
+      return vm.retval;
     if (!truthy(vm.retval))
       break;
     vals.push_back(iter);
@@ -83,8 +94,8 @@ value::base* fn_range_to_arr(vm::machine& vm)
     vm.push_int(1);
     vm.push_arg();
     vm.retval = iter;
-    vm.readm({"add"});
-    vm.call(1);
+    if (!vm.call_method({"add"}, 1))
+      return vm.retval;
     iter = vm.retval;
   }
 
@@ -13,94 +13,108 @@ using namespace builtin;
 
 namespace {
 
-int to_int(value::base* boxed)
+int to_int(value::handle boxed)
 {
-  return static_cast<value::integer*>(boxed)->val;
+  return boxed.as_int();
 }
 
-const std::string& to_string(const value::base* boxed)
+const std::string& to_string(value::handle boxed)
 {
-  return static_cast<const value::string*>(boxed)->val;
+  return static_cast<const value::string&>(*boxed).val;
 }
 
-vv::symbol to_symbol(const value::base* boxed)
+vv::symbol to_symbol(value::handle boxed)
 {
-  return static_cast<const value::symbol*>(boxed)->val;
+  return static_cast<const value::symbol&>(*boxed).val;
 }
 
 // string {{{
 
-value::base* fn_string_init(vm::machine& vm)
+value::handle fn_string_init(vm::machine&,
+                             value::handle self,
+                             value::arg_span args)
 {
-  auto& str = static_cast<value::string&>(*vm.frame->self);
-  auto arg = get_arg(vm, 0);
-  if (arg->type == &type::string)
+  auto& str = static_cast<value::string&>(*self);
+  auto arg = args[0];
+  auto old_size = str.owned_size();
+  if (arg.type() == &type::string)
     str.val = to_string(arg);
-  else if (arg->type == &type::symbol)
+  else if (arg.type() == &type::symbol)
     str.val = to_string(to_symbol(arg));
   else
-     str.val = arg->value();
+     str.val = arg.value();
+  gc::resized(str, old_size);
   return &str;
 }
 
-value::base* fn_string_size(vm::machine& vm)
+value::handle fn_string_size(vm::machine&, value::handle self, value::arg_span)
 {
-  auto sz = static_cast<value::string&>(*vm.frame->self).val.size();
-  return gc::alloc<value::integer>( static_cast<int>(sz) );
+  auto sz = static_cast<value::string&>(*self).val.size();
+  return value::handle{static_cast<int>(sz)};
 }
 
-value::base* fn_string_equals(vm::machine& vm)
+value::handle fn_string_equals(vm::machine&,
+                               value::handle self,
+                               value::arg_span args)
 {
-  auto arg = get_arg(vm, 0);
-  if (arg->type != &type::string)
-    return gc::alloc<value::boolean>( false );
-  return gc::alloc<value::boolean>(
-      to_string(&*vm.frame->self) == to_string(arg) );
+  auto arg = args[0];
+  if (arg.type() != &type::string)
+    return value::handle{false};
+  return value::handle{to_string(self) == to_string(arg)};
 }
 
-value::base* fn_string_unequal(vm::machine& vm)
+value::handle fn_string_unequal(vm::machine&,
+                                value::handle self,
+                                value::arg_span args)
 {
-  auto arg = get_arg(vm, 0);
-  if (arg->type != &type::string)
-    return gc::alloc<value::boolean>( false );
-  return gc::alloc<value::boolean>(
-      to_string(&*vm.frame->self) != to_string(arg) );
+  auto arg = args[0];
+  if (arg.type() != &type::string)
+    return value::handle{false};
+  return value::handle{to_string(self) != to_string(arg)};
 }
 
-value::base* fn_string_add(vm::machine& vm)
+value::handle fn_string_add(vm::machine& vm,
+                            value::handle self,
+                            value::arg_span args)
 {
-  if (get_arg(vm, 0)->type != &type::string)
+  if (args[0].type() != &type::string)
     return throw_exception("Only strings can be appended to other strings", vm);
 
-  auto str = to_string(get_arg(vm, 0));
-  auto new_str = static_cast<value::string&>(*vm.frame->self).val + str;
+  auto str = to_string(args[0]);
+  auto new_str = static_cast<value::string&>(*self).val + str;
   return gc::alloc<value::string>( new_str );
 }
 
-value::base* fn_string_times(vm::machine& vm)
+value::handle fn_string_times(vm::machine& vm,
+                              value::handle self,
+                              value::arg_span args)
 {
-  if (get_arg(vm, 0)->type != &type::integer)
+  if (!args[0].is_int())
     return throw_exception("Strings can only be multiplied by Integers", vm);
 
-  auto val = static_cast<value::string&>(*vm.frame->self).val;
+  auto val = static_cast<value::string&>(*self).val;
   std::string new_str{};
-  for (auto i = to_int(get_arg(vm, 0)); i--;)
+  for (auto i = to_int(args[0]); i--;)
     new_str += val;
   return gc::alloc<value::string>( new_str );
 }
 
-value::base* fn_string_to_int(vm::machine& vm)
+value::handle fn_string_to_int(vm::machine&,
+                               value::handle self,
+                               value::arg_span)
 {
-  return gc::alloc<value::integer>( vv::to_int(to_string(&*vm.frame->self)) );
+  return value::handle{vv::to_int(to_string(self))};
 }
 
-value::base* fn_string_at(vm::machine& vm)
+value::handle fn_string_at(vm::machine& vm,
+                           value::handle self,
+                           value::arg_span args)
 {
-  auto arg = get_arg(vm, 0);
-  if (arg->type != &type::integer)
+  auto arg = args[0];
+  if (!arg.is_int())
     return throw_exception("Index must be an Integer", vm);
-  auto val = static_cast<value::integer*>(arg)->val;
-  const auto& str = static_cast<value::string&>(*vm.frame->self).val;
+  auto val = arg.as_int();
+  const auto& str = static_cast<value::string&>(*self).val;
   if (str.size() <= static_cast<unsigned>(val) || val < 0)
     return throw_exception("Out of range (expected 0-"
                            + std::to_string(str.size()) + ", got "
@@ -109,94 +123,112 @@ value::base* fn_string_at(vm::machine& vm)
   return gc::alloc<value::string>( std::string{str[static_cast<unsigned>(val)]} );
 }
 
-value::base* fn_string_start(vm::machine& vm)
+value::handle fn_string_start(vm::machine&, value::handle self, value::arg_span)
 {
-  auto& self = static_cast<value::string&>(*vm.frame->self);
-  return gc::alloc<value::string_iterator>(self);
+  auto& str = static_cast<value::string&>(*self);
+  return gc::alloc<value::string_iterator>(str);
 }
 
-value::base* fn_string_end(vm::machine& vm)
+value::handle fn_string_end(vm::machine&, value::handle self, value::arg_span)
 {
-  auto& self = static_cast<value::string&>(*vm.frame->self);
-  auto end = gc::alloc<value::string_iterator>(self);
-  static_cast<value::string_iterator*>(end)->idx = self.val.size();
+  auto& str = static_cast<value::string&>(*self);
+  auto end = gc::alloc<value::string_iterator>(str);
+  static_cast<value::string_iterator*>(end)->idx = str.val.size();
   return end;
 }
 
-value::base* fn_string_to_upper(vm::machine& vm)
+value::handle fn_string_to_upper(vm::machine&,
+                                 value::handle self,
+                                 value::arg_span)
 {
-  auto str = static_cast<value::string&>(*vm.frame->self).val;
+  auto str = static_cast<value::string&>(*self).val;
   transform(begin(str), end(str), begin(str), toupper);
   return gc::alloc<value::string>( str );
 }
 
-value::base* fn_string_to_lower(vm::machine& vm)
+value::handle fn_string_to_lower(vm::machine&,
+                                 value::handle self,
+                                 value::arg_span)
 {
-  auto str = static_cast<value::string&>(*vm.frame->self).val;
+  auto str = static_cast<value::string&>(*self).val;
   transform(begin(str), end(str), begin(str), tolower);
   return gc::alloc<value::string>( str );
 }
 
-value::base* fn_string_starts_with(vm::machine& vm)
+value::handle fn_string_starts_with(vm::machine& vm,
+                                    value::handle self,
+                                    value::arg_span args)
 {
-  if (get_arg(vm, 0)->type != &type::string)
+  if (args[0].type() != &type::string)
     return throw_exception("Strings can only start with other Strings", vm);
 
-  const auto& str = static_cast<value::string&>(*vm.frame->self).val;
-  const auto& other = to_string(get_arg(vm, 0));
+  const auto& str = static_cast<value::string&>(*self).val;
+  const auto& other = to_string(args[0]);
 
   if (other.size() > str.size() || !equal(begin(other), end(other), begin(str)))
-    return gc::alloc<value::boolean>( false );
-  return gc::alloc<value::boolean>( true );
+    return value::handle{false};
+  return value::handle{true};
 }
 
 // }}}
 // string_iterator {{{
 
-value::base* fn_string_iterator_at_start(vm::machine& vm)
+value::handle fn_string_iterator_at_start(vm::machine&,
+                                          value::handle self,
+                                          value::arg_span)
 {
-  auto iter = static_cast<value::string_iterator*>(&*vm.frame->self);
-  return gc::alloc<value::boolean>( iter->idx == 0 );
+  auto iter = static_cast<value::string_iterator*>(self.get());
+  return value::handle{iter->idx == 0};
 }
 
-value::base* fn_string_iterator_at_end(vm::machine& vm)
+value::handle fn_string_iterator_at_end(vm::machine&,
+                                        value::handle self,
+                                        value::arg_span)
 {
-  auto iter = static_cast<value::string_iterator*>(&*vm.frame->self);
-  return gc::alloc<value::boolean>( iter->idx == iter->str.val.size() );
+  auto iter = static_cast<value::string_iterator*>(self.get());
+  return value::handle{iter->idx == iter->str.val.size()};
 }
 
-value::base* fn_string_iterator_get(vm::machine& vm)
+value::handle fn_string_iterator_get(vm::machine& vm,
+                                     value::handle self,
+                                     value::arg_span)
 {
-  auto iter = static_cast<value::string_iterator*>(&*vm.frame->self);
+  auto iter = static_cast<value::string_iterator*>(self.get());
   if (iter->idx == iter->str.val.size())
     return throw_exception("StringIterator is at end of string", vm);
   return gc::alloc<value::string>( std::string{iter->str.val[iter->idx]} );
 }
 
-value::base* fn_string_iterator_increment(vm::machine& vm)
+value::handle fn_string_iterator_increment(vm::machine& vm,
+                                           value::handle self,
+                                           value::arg_span)
 {
-  auto iter = static_cast<value::string_iterator*>(&*vm.frame->self);
+  auto iter = static_cast<value::string_iterator*>(self.get());
   if (iter->idx == iter->str.val.size())
     return throw_exception("StringIterators cannot be incremented past end", vm);
   iter->idx += 1;
   return iter;
 }
 
-value::base* fn_string_iterator_decrement(vm::machine& vm)
+value::handle fn_string_iterator_decrement(vm::machine& vm,
+                                           value::handle self,
+                                           value::arg_span)
 {
-  auto iter = static_cast<value::string_iterator*>(&*vm.frame->self);
+  auto iter = static_cast<value::string_iterator*>(self.get());
   if (iter->idx == 0)
     return throw_exception("StringIterators cannot be decremented past start", vm);
   iter->idx -= 1;
   return iter;
 }
 
-value::base* fn_string_iterator_add(vm::machine& vm)
+value::handle fn_string_iterator_add(vm::machine& vm,
+                                     value::handle self,
+                                     value::arg_span args)
 {
-  auto iter = static_cast<value::string_iterator*>(&*vm.frame->self);
-  if (get_arg(vm, 0)->type != &type::integer)
+  auto iter = static_cast<value::string_iterator*>(self.get());
+  if (!args[0].is_int())
     return throw_exception("Only numeric types can be added to StringIterators", vm);
-  auto offset = to_int(get_arg(vm, 0));
+  auto offset = to_int(args[0]);
 
   if (static_cast<int>(iter->idx) + offset < 0)
     return throw_exception("StringIterators cannot be decremented past start", vm);
@@ -208,12 +240,14 @@ value::base* fn_string_iterator_add(vm::machine& vm)
   return other;
 }
 
-value::base* fn_string_iterator_subtract(vm::machine& vm)
+value::handle fn_string_iterator_subtract(vm::machine& vm,
+                                          value::handle self,
+                                          value::arg_span args)
 {
-  auto iter = static_cast<value::string_iterator*>(&*vm.frame->self);
-  if (get_arg(vm, 0)->type != &type::integer)
+  auto iter = static_cast<value::string_iterator*>(self.get());
+  if (!args[0].is_int())
     return throw_exception("Only numeric types can be added to StringIterators", vm);
-  auto offset = to_int(get_arg(vm, 0));
+  auto offset = to_int(args[0]);
 
   if (static_cast<int>(iter->idx) - offset < 0)
     return throw_exception("StringIterators cannot be decremented past start", vm);
@@ -225,20 +259,24 @@ value::base* fn_string_iterator_subtract(vm::machine& vm)
   return other;
 }
 
-value::base* fn_string_iterator_equals(vm::machine& vm)
+value::handle fn_string_iterator_equals(vm::machine&,
+                                        value::handle self,
+                                        value::arg_span args)
 {
-  auto iter = static_cast<value::string_iterator*>(&*vm.frame->self);
-  auto other = static_cast<value::string_iterator*>(get_arg(vm, 0));
-  return gc::alloc<value::boolean>( &iter->str == &other->str
-                                  && iter->idx == other->idx );
+  auto iter = static_cast<value::string_iterator*>(self.get());
+  auto other = static_cast<value::string_iterator*>(args[0].get());
+  return value::handle{&iter->str == &other->str
+                      && iter->idx == other->idx};
 }
 
-value::base* fn_string_iterator_unequal(vm::machine& vm)
+value::handle fn_string_iterator_unequal(vm::machine&,
+                                         value::handle self,
+                                         value::arg_span args)
 {
-  auto iter = static_cast<value::string_iterator*>(&*vm.frame->self);
-  auto other = static_cast<value::string_iterator*>(get_arg(vm, 0));
-  return gc::alloc<value::boolean>( &iter->str != &other->str
-                                  || iter->idx != other->idx );
+  auto iter = static_cast<value::string_iterator*>(self.get());
+  auto other = static_cast<value::string_iterator*>(args[0].get());
+  return value::handle{&iter->str != &other->str
+                      || iter->idx != other->idx};
 }
 
 // }}}
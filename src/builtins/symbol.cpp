@@ -11,23 +11,25 @@ using namespace builtin;
 
 namespace {
 
-const std::string& to_string(const value::base* boxed)
+const std::string& to_string(value::handle boxed)
 {
-  return static_cast<const value::string*>(boxed)->val;
+  return static_cast<const value::string&>(*boxed).val;
 }
 
-vv::symbol to_symbol(const value::base* boxed)
+vv::symbol to_symbol(value::handle boxed)
 {
-  return static_cast<const value::symbol*>(boxed)->val;
+  return static_cast<const value::symbol&>(*boxed).val;
 }
 
-value::base* fn_symbol_init(vm::machine& vm)
+value::handle fn_symbol_init(vm::machine& vm,
+                             value::handle self,
+                             value::arg_span args)
 {
-  auto& sym = static_cast<value::symbol&>(*vm.frame->self);
-  auto arg = get_arg(vm, 0);
-  if (arg->type == &type::symbol)
+  auto& sym = static_cast<value::symbol&>(*self);
+  auto arg = args[0];
+  if (arg.type() == &type::symbol)
     sym.val = to_symbol(arg);
-  if (arg->type == &type::string)
+  if (arg.type() == &type::string)
     sym.val = vv::symbol{to_string(arg)};
   else
     return throw_exception("Symbols can only be constructed a String or another Symbol",
@@ -35,22 +37,26 @@ value::base* fn_symbol_init(vm::machine& vm)
   return &sym;
 }
 
-value::base* fn_symbol_equals(vm::machine& vm)
+value::handle fn_symbol_equals(vm::machine&,
+                               value::handle self,
+                               value::arg_span args)
 {
-  auto arg = get_arg(vm, 0);
+  auto arg = args[0];
 
-  if (arg->type != &type::symbol)
-    return gc::alloc<value::boolean>( false );
-  return gc::alloc<value::boolean>(to_symbol(&*vm.frame->self)==to_symbol(arg));
+  if (arg.type() != &type::symbol)
+    return value::handle{false};
+  return value::handle{to_symbol(self) == to_symbol(arg)};
 }
 
-value::base* fn_symbol_unequal(vm::machine& vm)
+value::handle fn_symbol_unequal(vm::machine&,
+                                value::handle self,
+                                value::arg_span args)
 {
-  auto arg = get_arg(vm, 0);
+  auto arg = args[0];
 
-  if (arg->type != &type::symbol)
-    return gc::alloc<value::boolean>( true );
-  return gc::alloc<value::boolean>(to_symbol(&*vm.frame->self)!=to_symbol(arg));
+  if (arg.type() != &type::symbol)
+    return value::handle{true};
+  return value::handle{to_symbol(self) != to_symbol(arg)};
 }
 
 // }}}
@@ -9,9 +9,11 @@ namespace {
 
 // custom_type {{{
 
-value::base* fn_custom_type_parent(vm::machine& vm)
+value::handle fn_custom_type_parent(vm::machine&,
+                                    value::handle self,
+                                    value::arg_span)
 {
-  return &static_cast<value::type&>(*vm.frame->self).parent;
+  return &static_cast<value::type&>(*self).parent;
 }
 
 // }}}
@@ -9,20 +9,26 @@ namespace vv {
 
 namespace vm {
 
-struct command;
+class emitter;
 
 }
 
 namespace ast {
 
+class resolver;
+
 class expression {
 public:
-  virtual std::vector<vm::command> generate() const = 0;
+  // Determines the address of every variable referenced, prior to generation
+  virtual void resolve(resolver& scope) = 0;
+  // Appends the expression's code, which leaves its value in retval
+  virtual void generate(vm::emitter& out) const = 0;
   virtual ~expression() { }
 };
 
 class assignment;
 class array;
+class binary_operator;
 class block;
 class cond_statement;
 class dictionary;
@@ -35,6 +41,7 @@ class logical_or;
 class member;
 class member_assignment;
 class require;
+class resolver;
 class return_statement;
 class try_catch;
 class type_definition;
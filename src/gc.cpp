@@ -1,79 +1,683 @@
 #include "gc.h"
 
 #include "builtins.h"
+#include "vm.h"
+#include "value/array.h"
+#include "value/string.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <limits>
 
 using namespace vv;
 
+gc::collection_stats gc::g_collection_stats{};
+
+std::chrono::microseconds gc::g_pause_budget{0};
+size_t gc::g_heap_min{4 * 1024 * 1024};
+double gc::g_heap_growth{2};
+size_t gc::g_max_heap{0};
 
-value::nil gc::internal::g_nil{};
-value::boolean gc::internal::g_true{true};
-value::boolean gc::internal::g_false{false};
-std::array<value::integer, 1024> gc::internal::g_ints;
+std::vector<value::base*> gc::internal::g_mark_stack;
+std::vector<std::pair<value::array*, size_t>> gc::internal::g_array_stack;
+size_t gc::internal::g_collection{0};
+bool gc::internal::g_marking{false};
 
 namespace {
 
-std::shared_ptr<vm::call_frame> g_frame{nullptr};
-std::vector<value::base*> g_vals;
-value::base* g_retval;
+// Number of values allocated between minor collections
+const size_t nursery_size{4096};
+// Number of bytes owned by new values at which the nursery's collected early,
+// so e.g. a few huge Strings don't wait for thousands of other values
+const size_t max_nursery_owned_size{4 * 1024 * 1024};
+// How much further the heap's allowed to grow once out_of_memory's been thrown
+const size_t out_of_memory_headroom{1024 * 1024};
+// Number of values allocated between slices of incremental marking or
+// sweeping
+const size_t slice_interval{1024};
+// Number of values marked between checks of whether a slice is out of time
+const size_t slice_check_interval{256};
+// Number of an Array's elements pushed onto the mark stack at once
+const size_t array_chunk_size{256};
+
+// Size of each page values are allocated from
+const size_t page_size{64 * 1024};
+// Every slot's size is a multiple of this, so every value's suitably aligned
+const size_t slot_alignment{16};
+const size_t bits_per_word{64};
+// Enough words of bitmap for a page of the smallest slots
+const size_t bitmap_size{page_size / slot_alignment / bits_per_word};
+
+// A page of equally sized slots, each of which is either free or holds a
+// value. Which are which is kept in a bitmap, rather than in the slots
+// themselves, so sweeping never needs to touch free ones
+struct page {
+  std::array<uint64_t, bitmap_size> allocated;
+  // Slots holding values that are still in the nursery
+  std::array<uint64_t, bitmap_size> young;
+  // First word of allocated that might have a free slot in it
+  size_t first_free_word;
+  size_t slot_size;
+  size_t slot_count;
+  // Number of slots allocated
+  size_t live;
+  // Position in its size class's pages
+  size_t index;
+  // Whether it's in g_nursery_pages
+  bool in_nursery;
+  char* slots;
+
+  value::base* slot(size_t idx)
+  {
+    return reinterpret_cast<value::base*>(slots + idx * slot_size);
+  }
+
+  // Number of words of each bitmap actually used
+  size_t words() const
+  {
+    return (slot_count + bits_per_word - 1) / bits_per_word;
+  }
+  bool full() const { return live == slot_count; }
+};
+
+// Every page holding slots of a single size
+struct size_class {
+  std::vector<page*> pages;
+  // Index of the first page that might have a free slot
+  size_t first_free_page;
+};
+
+// Indexed by slot size / slot_alignment
+std::vector<size_class> g_size_classes;
+
+// Pages with values in the nursery, so minor collections can skip the rest
+std::vector<page*> g_nursery_pages;
+size_t g_nursery_count{0};
+// Total size of every page
+size_t g_heap_size{0};
+
+// The heap's size is the slots in use, plus the sizes owned by old and new
+// values. The latter two are only estimates, since values' contents can grow
+// or shrink after they're counted
+size_t g_slots_size{0};
+size_t g_old_owned_size{0};
+size_t g_nursery_owned_size{0};
+// Size owned by the values marked so far in the current collection
+size_t g_marked_owned_size{0};
+// Size of every machine's stack and frames; see gc::stack_resized
+size_t g_stack_size{0};
+
+// Set to a value that's just been allocated while it's being checked against
+// g_max_heap, to keep it alive through any collection that takes
+value::base* g_allocating{nullptr};
+// Once out_of_memory's been thrown, the heap's allowed to grow to this
+// instead of g_max_heap, until it's back under g_max_heap; see
+// gc::out_of_memory
+size_t g_raised_max_heap{0};
+// See gc::out_of_memory_error
+value::base* g_out_of_memory_error{nullptr};
+
+std::vector<vm::machine*> g_roots;
+
+// Size the heap has to reach to trigger the next major collection, besides
+// g_heap_min
+size_t g_major_threshold{0};
+// Values allocated since the last slice of incremental marking or sweeping
+size_t g_since_slice{0};
+
+// Once marking's finished, old values are swept incrementally as well, a page
+// at a time, starting from these
+bool g_sweeping{false};
+size_t g_sweep_class{0};
+size_t g_sweep_page{0};
+
+void prefetch(const void* ptr)
+{
+#ifdef __GNUC__
+  __builtin_prefetch(ptr, 1);
+#else
+  static_cast<void>(ptr);
+#endif
+}
+
+// Index of the lowest set bit in word, which mustn't be zero
+size_t lowest_bit(uint64_t word)
+{
+#ifdef __GNUC__
+  return static_cast<size_t>(__builtin_ctzll(word));
+#else
+  size_t idx{0};
+  while (!(word & 1)) {
+    word >>= 1;
+    ++idx;
+  }
+  return idx;
+#endif
+}
+
+// Calls f with the index of every set bit in word, from the lowest up
+template <typename F>
+void for_each_bit(uint64_t word, const F& f)
+{
+  for (; word; word &= word - 1)
+    f(lowest_bit(word));
+}
+
+uint64_t bit(size_t idx)
+{
+  return uint64_t{1} << (idx % bits_per_word);
+}
+
+page* new_page(size_t slot_size, size_t index)
+{
+  auto mem = ::operator new(page_size);
+  auto header_size = (sizeof(page) + slot_alignment - 1) / slot_alignment
+                   * slot_alignment;
+
+  auto pg = new (mem) page{};
+  pg->slot_size = slot_size;
+  pg->slot_count = (page_size - header_size) / slot_size;
+  pg->index = index;
+  pg->slots = static_cast<char*>(mem) + header_size;
+
+  g_heap_size += page_size;
+  auto& stats = gc::g_collection_stats;
+  stats.peak_heap_size = std::max(stats.peak_heap_size, g_heap_size);
+  return pg;
+}
+
+void delete_page(page* pg)
+{
+  pg->~page();
+  ::operator delete(pg);
+  g_heap_size -= page_size;
+}
+
+size_class& class_of(const page& pg)
+{
+  return g_size_classes[pg.slot_size / slot_alignment];
+}
+
+// Marks slot idx of pg as free, without touching what's in it
+void free_slot(page& pg, size_t idx)
+{
+  auto word = idx / bits_per_word;
+  pg.allocated[word] &= ~bit(idx);
+  pg.young[word] &= ~bit(idx);
+  --pg.live;
+  g_slots_size -= pg.slot_size;
+  pg.first_free_word = std::min(pg.first_free_word, word);
+  auto& cls = class_of(pg);
+  cls.first_free_page = std::min(cls.first_free_page, pg.index);
+}
 
-void mark()
+void destroy(page& pg, size_t idx)
 {
-  mark(*g_frame);
-  if (g_retval && !g_retval->marked())
-    g_retval->mark();
+  pg.slot(idx)->~base();
+  free_slot(pg, idx);
 }
 
-void sweep()
+using pause_clock = std::chrono::steady_clock;
+using time_point = pause_clock::time_point;
+
+// Pushes the next few elements of the Array on top of the array stack onto the
+// mark stack
+void push_array_chunk()
 {
-  for (auto*& i : g_vals) {
-    if (i->marked()) {
-      i->unmark();
+  auto& arrays = gc::internal::g_array_stack;
+  auto& top = arrays.back();
+  const auto& elements = top.first->val;
+  // The Array might have shrunk since it was pushed
+  auto first = std::min(top.second, elements.size());
+  auto last = std::min(first + array_chunk_size, elements.size());
+  for (auto i = first; i != last; ++i)
+    gc::mark(elements[i]);
+
+  if (last == elements.size())
+    arrays.pop_back();
+  else
+    top.second = last;
+}
+
+// Marks everything on the mark stack, and everything reachable from it, or as
+// much as can be done by deadline; returns whether the stack was emptied. The
+// next value to be marked is fetched into the cache while the current one is
+bool drain_mark_stack(time_point deadline = time_point::max())
+{
+  auto& stack = gc::internal::g_mark_stack;
+  auto& arrays = gc::internal::g_array_stack;
+  for (size_t count{1}; !stack.empty() || !arrays.empty(); ++count) {
+    if (!stack.empty()) {
+      auto val = stack.back();
+      stack.pop_back();
+      if (!stack.empty())
+        prefetch(stack.back());
+      val->set_shaded(false);
+      if (!val->marked()) {
+        val->mark();
+        g_marked_owned_size += val->owned_size();
+      }
     } else {
-      delete i;
-      i = nullptr;
+      push_array_chunk();
+    }
+    if (count % slice_check_interval == 0 && pause_clock::now() >= deadline)
+      return stack.empty() && arrays.empty();
+  }
+  return true;
+}
+
+void mark_roots()
+{
+  for (auto* i : g_roots)
+    mark(*i);
+  if (g_allocating)
+    gc::mark(*g_allocating);
+  if (g_out_of_memory_error)
+    gc::mark(*g_out_of_memory_error);
+}
+
+size_t heap_size()
+{
+  return g_slots_size + g_old_owned_size + g_nursery_owned_size;
+}
+
+// Records a pause that started at start, returning its length in seconds
+double record_pause(time_point start)
+{
+  std::chrono::duration<double> time{pause_clock::now() - start};
+  auto& stats = gc::g_collection_stats;
+  size_t bucket{0};
+  while (time.count() >= gc::pause_bucket_limit(bucket))
+    ++bucket;
+  ++stats.pause_histogram[bucket];
+  ++stats.pauses;
+  stats.max_pause = std::max(stats.max_pause, time.count());
+  return time.count();
+}
+
+// Moves every value in the nursery into the old generation, leaving it empty
+void clear_nursery()
+{
+  for (auto* pg : g_nursery_pages) {
+    pg->young.fill(0);
+    pg->in_nursery = false;
+  }
+  g_nursery_pages.clear();
+  g_nursery_count = 0;
+  g_nursery_owned_size = 0;
+}
+
+void minor_collection()
+{
+  auto start = pause_clock::now();
+
+  ++gc::internal::g_collection;
+  g_marked_owned_size = 0;
+  // Old values are already marked, so marking stops at them; anything new
+  // they point to is already on the mark stack, thanks to the write barrier
+  mark_roots();
+  drain_mark_stack();
+  g_old_owned_size += g_marked_owned_size;
+
+  size_t promoted{0};
+  for (auto* pg : g_nursery_pages) {
+    for (size_t word = 0; word != pg->words(); ++word) {
+      for_each_bit(pg->young[word], [&](size_t idx)
+      {
+        idx += word * bits_per_word;
+        if (pg->slot(idx)->marked())
+          ++promoted;
+        else
+          destroy(*pg, idx);
+      });
+    }
+  }
+  clear_nursery();
+
+  ++gc::g_collection_stats.minor_collections;
+  gc::g_collection_stats.promoted += promoted;
+  gc::g_collection_stats.minor_time += record_pause(start);
+}
+
+// Frees every unmarked old value in pg
+void sweep_page(page& pg)
+{
+  for (size_t word = 0; word != pg.words(); ++word) {
+    for_each_bit(pg.allocated[word] & ~pg.young[word], [&](size_t idx)
+    {
+      idx += word * bits_per_word;
+      if (!pg.slot(idx)->marked())
+        destroy(pg, idx);
+    });
+  }
+}
+
+// Returns pages left empty by sweeping, besides any still in the nursery
+void release_empty_pages()
+{
+  for (auto& cls : g_size_classes) {
+    auto kept = begin(cls.pages);
+    for (auto* pg : cls.pages) {
+      if (pg->live || pg->in_nursery) {
+        pg->index = static_cast<size_t>(kept - begin(cls.pages));
+        *kept++ = pg;
+      } else {
+        delete_page(pg);
+      }
+    }
+    cls.pages.erase(kept, end(cls.pages));
+    cls.first_free_page = 0;
+  }
+}
+
+// Frees unmarked old values until deadline; returns whether they've all been
+// swept, and so the major collection's done. Pages allocated partway through
+// are swept as well, which is harmless, since they only hold values that are
+// either new or marked
+bool sweep_old(time_point deadline)
+{
+  for (; g_sweep_class != g_size_classes.size(); ++g_sweep_class) {
+    const auto& pages = g_size_classes[g_sweep_class].pages;
+    while (g_sweep_page != pages.size()) {
+      sweep_page(*pages[g_sweep_page++]);
+      if (pause_clock::now() >= deadline)
+        return false;
+    }
+    g_sweep_page = 0;
+  }
+
+  release_empty_pages();
+  g_sweeping = false;
+  g_major_threshold = static_cast<size_t>(static_cast<double>(heap_size())
+                                        * gc::g_heap_growth);
+  ++gc::g_collection_stats.major_collections;
+  return true;
+}
+
+// Marks everything reachable, once the mark stack's been emptied, and starts
+// sweeping everything else. Whatever's happened since the roots were first
+// marked has gone through a write barrier, besides changes to the roots
+// themselves, so those just need to be marked again
+void finish_marking()
+{
+  ++gc::internal::g_collection;
+  mark_roots();
+  drain_mark_stack();
+  gc::internal::g_marking = false;
+
+  // Everything allocated while marking is swept along with the old values
+  clear_nursery();
+  g_old_owned_size = g_marked_owned_size;
+
+  g_sweeping = true;
+  g_sweep_class = 0;
+  g_sweep_page = 0;
+}
+
+// Runs a slice of the major collection in progress, until deadline, in a pause
+// that started at start
+void major_slice(time_point start, time_point deadline)
+{
+  if (gc::internal::g_marking && drain_mark_stack(deadline))
+    finish_marking();
+  if (g_sweeping)
+    sweep_old(deadline);
+  gc::g_collection_stats.major_time += record_pause(start);
+}
+
+// Starts a major collection, running the first slice until deadline (given
+// the time it started at)
+void start_major_collection(time_point start, time_point deadline)
+{
+  ++gc::internal::g_collection;
+  gc::internal::g_marking = true;
+  g_since_slice = 0;
+  g_marked_owned_size = 0;
+  value::base::marked_value = !value::base::marked_value;
+  // Flipping the meaning of the mark bit unmarks every old value, but would
+  // also mark every new one
+  for (auto* pg : g_nursery_pages) {
+    for (size_t word = 0; word != pg->words(); ++word) {
+      for_each_bit(pg->young[word], [&](size_t idx)
+      {
+        pg->slot(idx + word * bits_per_word)->unmark();
+      });
+    }
+  }
+  mark_roots();
+  major_slice(start, deadline);
+}
+
+void start_major_collection()
+{
+  auto start = pause_clock::now();
+  auto deadline = gc::g_pause_budget.count() ? start + gc::g_pause_budget
+                                             : time_point::max();
+  start_major_collection(start, deadline);
+}
+
+void continue_major_collection()
+{
+  auto start = pause_clock::now();
+  major_slice(start, start + gc::g_pause_budget);
+}
+
+// Frees everything that can be freed, ignoring the pause budget: finishes any
+// major collection in progress, then runs a fresh one (since the one in
+// progress won't free anything that became garbage after it started)
+void full_collection()
+{
+  if (gc::internal::g_marking || g_sweeping)
+    major_slice(pause_clock::now(), time_point::max());
+  start_major_collection(pause_clock::now(), time_point::max());
+}
+
+// What's counted towards g_max_heap: the heap, plus the machines' stacks
+size_t memory_size()
+{
+  return heap_size() + g_stack_size;
+}
+
+// Returns whether memory_size's within g_max_heap (or what it's been raised
+// to), after collecting everything possible, if need be, besides val (if any)
+bool fits_in_max_heap(value::base* val)
+{
+  if (!gc::g_max_heap)
+    return true;
+  if (memory_size() <= gc::g_max_heap) {
+    g_raised_max_heap = 0;
+    return true;
+  }
+  auto max_heap = std::max(gc::g_max_heap, g_raised_max_heap);
+  if (memory_size() <= max_heap)
+    return true;
+
+  g_allocating = val;
+  full_collection();
+  g_allocating = nullptr;
+  return memory_size() <= max_heap;
+}
+
+[[noreturn]] void throw_out_of_memory()
+{
+  // Only raised the first time, so a program that keeps allocating anyway
+  // doesn't just keep going
+  if (!g_raised_max_heap)
+    g_raised_max_heap = memory_size() + out_of_memory_headroom;
+  throw gc::out_of_memory{};
+}
+
+// Collects (or continues collecting) if enough's been allocated to need to
+void collect_if_needed()
+{
+  if (gc::internal::g_marking || g_sweeping) {
+    if (++g_since_slice == slice_interval) {
+      g_since_slice = 0;
+      continue_major_collection();
     }
   }
+  if (!gc::internal::g_marking &&
+      (g_nursery_count >= nursery_size ||
+       g_nursery_owned_size >= max_nursery_owned_size)) {
+    if (!g_sweeping && heap_size() >= std::max(gc::g_heap_min,
+                                               g_major_threshold))
+      start_major_collection();
+    else
+      minor_collection();
+  }
+}
 
-  g_vals.erase(remove(begin(g_vals), end(g_vals), nullptr), end(g_vals));
 }
 
+void* gc::internal::allocate(size_t size)
+{
+  collect_if_needed();
+
+  auto slot_size = (size + slot_alignment - 1) / slot_alignment
+                 * slot_alignment;
+  auto class_idx = slot_size / slot_alignment;
+  if (class_idx >= g_size_classes.size())
+    g_size_classes.resize(class_idx + 1);
+  auto& cls = g_size_classes[class_idx];
+
+  auto& pages = cls.pages;
+  while (cls.first_free_page != pages.size() &&
+         pages[cls.first_free_page]->full())
+    ++cls.first_free_page;
+  if (cls.first_free_page == pages.size())
+    pages.push_back(new_page(slot_size, pages.size()));
+  auto& pg = *pages[cls.first_free_page];
+
+  // There's a free slot somewhere, so the lowest free bit can't be past the
+  // last slot
+  auto word = pg.first_free_word;
+  while (!~pg.allocated[word])
+    ++word;
+  pg.first_free_word = word;
+  auto idx = word * bits_per_word + lowest_bit(~pg.allocated[word]);
+
+  pg.allocated[word] |= bit(idx);
+  pg.young[word] |= bit(idx);
+  ++pg.live;
+  g_slots_size += slot_size;
+  if (!pg.in_nursery) {
+    pg.in_nursery = true;
+    g_nursery_pages.push_back(&pg);
+  }
+  ++g_nursery_count;
+  return pg.slot(idx);
 }
 
-value::base* gc::internal::emplace(value::base* val)
+void gc::internal::deallocate(void* slot, size_t size)
 {
-  if (g_vals.capacity() == g_vals.size()) {
-    mark();
-    sweep();
-    if (g_vals.capacity() == g_vals.size())
-      g_vals.reserve(g_vals.capacity() * 2);
+  auto slot_size = (size + slot_alignment - 1) / slot_alignment
+                 * slot_alignment;
+  auto addr = static_cast<char*>(slot);
+  for (auto* pg : g_size_classes[slot_size / slot_alignment].pages) {
+    if (pg->slots <= addr && addr < pg->slots + pg->slot_count * slot_size) {
+      auto idx = static_cast<size_t>(addr - pg->slots) / slot_size;
+      if (pg->young[idx / bits_per_word] & bit(idx))
+        --g_nursery_count;
+      free_slot(*pg, idx);
+      return;
+    }
   }
+}
+
+void gc::internal::account(value::base& val, size_t size)
+{
+  auto owned_size = val.owned_size();
+  g_nursery_owned_size += owned_size;
+  if (fits_in_max_heap(&val))
+    return;
+
+  // The full collection's made it old, and counted what it owns again
+  g_old_owned_size -= std::min(g_old_owned_size, owned_size);
+  val.~base();
+  deallocate(&val, size);
+  throw_out_of_memory();
+}
+
+void gc::resized(value::base& obj, size_t old_size)
+{
+  auto new_size = obj.owned_size();
+  if (new_size == old_size)
+    return;
+  auto& owned_size = obj.marked() ? g_old_owned_size : g_nursery_owned_size;
+  owned_size = owned_size + new_size > old_size
+             ? owned_size + new_size - old_size
+             : 0;
+  if (!fits_in_max_heap(&obj))
+    throw_out_of_memory();
+}
 
-  val->unmark();
-  g_vals.push_back(val);
-  return val;
+void gc::stack_resized(size_t old_size, size_t new_size)
+{
+  g_stack_size = g_stack_size + new_size > old_size
+               ? g_stack_size + new_size - old_size
+               : 0;
+  if (new_size > old_size && !fits_in_max_heap(nullptr))
+    throw_out_of_memory();
 }
 
-void gc::set_current_frame(std::shared_ptr<vm::call_frame> frame)
+double gc::pause_bucket_limit(size_t bucket)
 {
-  g_frame = frame;
+  if (bucket == pause_buckets - 1)
+    return std::numeric_limits<double>::infinity();
+  if (!bucket)
+    return 1e-6;
+  auto limit = 1e-6 * static_cast<double>((bucket - 1) % 9 + 2);
+  for (auto decade = (bucket - 1) / 9; decade--;)
+    limit *= 10;
+  return limit;
 }
 
-void gc::set_current_retval(value::base* retval)
+void gc::add_root(vm::machine& vm)
 {
-  g_retval = retval;
+  g_roots.push_back(&vm);
+}
+
+void gc::remove_root(vm::machine& vm)
+{
+  g_roots.erase(remove(begin(g_roots), end(g_roots), &vm), end(g_roots));
+}
+
+value::handle gc::out_of_memory_error()
+{
+  return g_out_of_memory_error;
 }
 
 void gc::init()
 {
-  int value = 0;
-  for (auto& i : internal::g_ints)
-    i.val = value++;
-  g_vals.reserve(512);
+  g_size_classes.resize(internal::max_value_size / slot_alignment + 1);
+  g_out_of_memory_error = alloc<value::string>("Out of memory");
 }
 
 void gc::empty()
 {
-  for (auto i : g_vals)
-    delete i;
-  g_vals.clear();
+  if (g_sweeping)
+    sweep_old(time_point::max());
+  for (auto& cls : g_size_classes) {
+    for (auto* pg : cls.pages) {
+      for (size_t word = 0; word != pg->words(); ++word) {
+        for_each_bit(pg->allocated[word], [&](size_t idx)
+        {
+          pg->slot(idx + word * bits_per_word)->~base();
+        });
+      }
+      delete_page(pg);
+    }
+  }
+  g_size_classes.clear();
+  g_out_of_memory_error = nullptr;
+  g_nursery_pages.clear();
+  g_nursery_count = 0;
+  g_slots_size = 0;
+  g_old_owned_size = 0;
+  g_nursery_owned_size = 0;
+  internal::g_mark_stack.clear();
+  internal::g_array_stack.clear();
+  internal::g_marking = false;
 }
@@ -2,58 +2,218 @@
 #define VV_GC_H
 
 #include "value.h"
-#include "value/boolean.h"
-#include "value/integer.h"
-#include "value/nil.h"
 #include "vm/call_frame.h"
 
 #include <array>
+#include <chrono>
+#include <new>
 
 namespace vv {
 
 namespace gc {
 
+// Values are collected generationally. New values start out in the nursery,
+// which is collected on its own (a minor collection) whenever it fills up;
+// survivors are promoted to the old generation, which is only collected along
+// with everything else (a major collection) once it's grown enough since the
+// last one.
+//
+// Nothing's ever moved, since raw pointers to values are held all over the
+// place (builtins, iterators, call frames...). Instead, old values simply keep
+// their mark bits between collections, so a minor collection marks only the
+// nursery, stopping at anything already marked; a value is old if and only if
+// it's marked. New values stored in old ones have to be kept alive anyway, so
+// every store of a value into another one has to go through write_barrier,
+// which pushes the new value straight onto the mark stack, to be marked by the
+// next collection.
+//
+// Major collections mark incrementally, in slices of at most g_pause_budget
+// interleaved with allocation. Throughout, everything's white (unmarked and
+// not on the mark stack), gray (on the mark stack, and if it was pushed by a
+// write barrier, shaded) or black (marked, with everything it points to gray
+// or black). No black value may point to a white one: a white value stored in
+// a black one is shaded gray by the same write barrier as above (old values
+// being exactly the black ones). Nothing's freed until marking's finished, by
+// marking the roots again and sweeping, so the nursery isn't collected in the
+// meantime.
+//
+// Values aren't allocated with new, but from pages of same-sized slots, one set
+// of pages for each size; which slots are in use, and which hold new values,
+// is kept in bitmaps alongside them, so collections sweep page by page rather
+// than through a list of every value.
+//
+// When to collect is decided by bytes rather than by number of values: the
+// size of the heap is the slots in use plus whatever their values own (see
+// value::base::owned_size), as of when they were allocated, resized or last
+// marked. A major collection starts once the heap's grown to g_heap_growth
+// times what was live after the last one (or to g_heap_min, if that's
+// bigger).
+
 namespace internal {
 
-value::base* emplace(value::base* item);
+// Returns uninitialized memory for a value of the given size, first collecting
+// (or running a slice of the collection in progress) if it's time to
+void* allocate(size_t size);
+// Frees memory returned by allocate that never had a value constructed in it
+void deallocate(void* slot, size_t size);
+// Counts a newly constructed value of the given size towards the heap. If
+// that takes it past g_max_heap, and a full collection doesn't help, it's
+// freed again and out_of_memory thrown
+void account(value::base& val, size_t size);
+
+// Largest value allocate can return memory for
+const size_t max_value_size{4096};
+
+// Values waiting to be marked. Values are only marked once they're popped
+// off, so the same one can be pushed more than once
+extern std::vector<value::base*> g_mark_stack;
+
+// Arrays with elements still to be pushed onto the mark stack, starting from
+// the given index. Long Arrays are pushed a piece at a time, so a single one
+// never takes longer than a slice of marking (nor makes the mark stack huge)
+extern std::vector<std::pair<value::array*, size_t>> g_array_stack;
+
+// Shades an unmarked value gray from a write barrier, by pushing it onto the
+// mark stack, unless it's already waiting there
+inline void shade(value::base& val)
+{
+  if (!val.shaded()) {
+    val.set_shaded(true);
+    g_mark_stack.push_back(&val);
+  }
+}
+
+// Incremented at the start of every pass over the roots
+extern size_t g_collection;
 
-// Optimize common values
-extern value::nil g_nil;
-extern value::boolean g_true;
-extern value::boolean g_false;
-extern std::array<value::integer, 1024> g_ints;
+// Whether a major collection's partway through marking
+extern bool g_marking;
 
 }
 
-template <typename T, typename... Args>
-inline value::base* alloc(Args&&... args)
+// Queues val to be marked, along with everything reachable from it, by the
+// collection currently running
+inline void mark(value::base& val)
+{
+  if (!val.marked())
+    internal::g_mark_stack.push_back(&val);
+}
+
+inline void mark(value::handle val)
 {
-  return internal::emplace(new T{args...});
+  if (!val.marked())
+    internal::g_mark_stack.push_back(val.get());
 }
 
-// Optimized template overrides for alloc:
-template <>
-inline value::base* alloc<value::boolean>(bool&& val)
+// Queues every element of arr to be marked
+inline void mark_elements(value::array& arr)
+{
+  internal::g_array_stack.emplace_back(&arr, 0);
+}
+
+// Integers, Floats, Bools and nil are never allocated; see value::handle
+template <typename T, typename... Args>
+inline value::base* alloc(Args&&... args)
 {
-  return &(val ? internal::g_true : internal::g_false);
+  static_assert(sizeof(T) <= internal::max_value_size, "value too large");
+  auto slot = internal::allocate(sizeof(T));
+  value::base* val;
+  try {
+    val = new (slot) T{args...};
+  } catch (...) {
+    internal::deallocate(slot, sizeof(T));
+    throw;
+  }
+  internal::account(*val, sizeof(T));
+  return val;
 }
 
-template <>
-inline value::base* alloc<value::nil>()
+// Records that val's been stored in obj, so that val's kept alive by the next
+// minor collection (or slice of marking) if obj's old (or black) and val's new
+// (or white)
+inline void write_barrier(value::base& obj, value::handle val)
 {
-  return &internal::g_nil;
+  if (obj.marked() && !val.marked())
+    internal::shade(*val);
 }
 
-template <>
-inline value::base* alloc<value::integer>(int&& val)
+// Records that val's been stored in a cell (see vm::cell). Cells aren't
+// values, and can be shared by any number of old and new closures, so val's
+// always kept alive
+inline void cell_barrier(value::handle val)
 {
-  if (val >= 0 && val < 1024)
-    return &internal::g_ints[static_cast<unsigned>(val)];
-  return gc::alloc<value::integer>( val );
+  if (!val.marked())
+    internal::shade(*val);
 }
 
-void set_current_frame(std::shared_ptr<vm::call_frame> frame);
-void set_current_retval(value::base* val);
+// Thrown by alloc when a new value won't fit under g_max_heap, even after
+// collecting everything possible. Once it's been thrown, the heap's allowed to
+// grow a little further, so there's room to handle it, until it's back under
+// the limit
+struct out_of_memory : public std::bad_alloc {
+  const char* what() const noexcept override { return "out of memory"; }
+};
+
+// What the VM throws (as an ordinary exception) in place of out_of_memory.
+// It's allocated up front, since by then there might not be room for it
+value::handle out_of_memory_error();
+
+// Records that obj's contents have been resized (e.g. by appending to an
+// Array) since its owned_size was old_size, keeping the heap's size up to date.
+// Throws out_of_memory if the heap won't fit under g_max_heap any more
+void resized(value::base& obj, size_t old_size);
+
+// Records that the memory taken by a machine's stack and frames has changed
+// from old_size to new_size bytes. It isn't part of the heap, and never
+// triggers a collection, but it counts towards g_max_heap, so e.g. unbounded
+// recursion runs out of memory like anything else. Throws out_of_memory if it's
+// grown and doesn't fit any more
+void stack_resized(size_t old_size, size_t new_size);
+
+// Every running machine is a root; they register themselves on construction
+// and unregister on destruction
+void add_root(vm::machine& vm);
+void remove_root(vm::machine& vm);
+
+// Pauses are counted in log-linear buckets, so percentiles can be given to
+// within a bucket: the first holds pauses under 1us, each of the next nine per
+// power of ten a tenth of it (1-2us, 2-3us, ... 9-10us, 10-20us, ...) up to
+// 1s, and the last anything longer
+const size_t pause_buckets{2 + 9 * 6};
+// Upper bound, in seconds, on the pauses counted in the given bucket (infinity
+// for the last)
+double pause_bucket_limit(size_t bucket);
+
+struct collection_stats {
+  size_t minor_collections;
+  size_t major_collections;
+  // Values that survived a minor collection, and so moved to the old generation
+  size_t promoted;
+  // Total time spent in each kind of collection, in seconds
+  double minor_time;
+  double major_time;
+  // Number of separate pauses for collection, and the longest, in seconds
+  size_t pauses;
+  double max_pause;
+  // Number of pauses in each bucket (see pause_buckets)
+  std::array<size_t, pause_buckets> pause_histogram;
+  // Most memory ever taken up by pages of values, in bytes
+  size_t peak_heap_size;
+};
+
+extern collection_stats g_collection_stats;
+
+// Longest a single slice of marking is allowed to take; zero, the default,
+// means to mark everything at once
+extern std::chrono::microseconds g_pause_budget;
+
+// Smallest the heap's allowed to grow to, in bytes, before a major collection
+extern size_t g_heap_min;
+// How much the heap's allowed to grow between major collections, as a multiple
+// of what was live after the last one
+extern double g_heap_growth;
+// Largest the heap's allowed to grow to, in bytes; zero means there's no limit
+extern size_t g_max_heap;
 
 // Called in main at the start and end of the program. TODO: RAII
 void init();
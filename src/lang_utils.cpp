@@ -2,27 +2,26 @@
 
 #include "builtins.h"
 #include "gc.h"
-#include "value/boolean.h"
 
-bool vv::truthy(const value::base* val)
+bool vv::truthy(value::handle val)
 {
-  if (val->type == &builtin::type::nil)
+  if (val.is_nil())
     return false;
-  else if (val->type == &builtin::type::boolean)
-    return static_cast<const value::boolean*>(val)->val;
+  else if (val.is_bool())
+    return val.as_bool();
   return true;
 }
 
-vv::value::base* vv::throw_exception(const std::string& value, vm::machine& vm)
+vv::value::handle vv::throw_exception(const std::string& value, vm::machine& vm)
 {
   vm.push_str(value);
   vm.except();
   return vm.retval;
 }
 
-vv::value::base* vv::get_arg(vm::machine& vm, size_t idx)
+vv::value::handle vv::get_arg(vm::machine& vm, size_t idx)
 {
-  return *(end(vm.frame->parent->pushed) - vm.frame->args + idx);
+  return vm.stack[vm.frame->frame_ptr + idx];
 }
 
 vv::value::base* vv::find_method(value::type* type, symbol name)
@@ -6,10 +6,10 @@
 
 namespace vv {
 
-bool truthy(const value::base* value);
+bool truthy(value::handle value);
 
-value::base* throw_exception(const std::string& value, vm::machine& vm);
-value::base* get_arg(vm::machine& vm, size_t idx);
+value::handle throw_exception(const std::string& value, vm::machine& vm);
+value::handle get_arg(vm::machine& vm, size_t idx);
 
 value::base* find_method(value::type* type, symbol name);
 
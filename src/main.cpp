@@ -1,13 +1,23 @@
 #include "builtins.h"
+#include "expression.h"
 #include "gc.h"
 #include "parser.h"
 #include "run_file.h"
 #include "vm.h"
+#include "ast/resolver.h"
 #include "value/builtin_function.h"
-#include "value/nil.h"
+#include "vm/bytecode_cache.h"
+#include "vm/emitter.h"
+#include "vm/optimizer.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
-#include <sstream>
+#include <limits>
 
 void write_error(const std::string& error)
 {
@@ -16,77 +26,297 @@ void write_error(const std::string& error)
 
 void repl_catcher(vv::vm::machine& vm)
 {
-  write_error("caught exception: " + vm.retval->value());
-
-  // Clear out remaining instructions once the current line's borked
-  auto remaining = vm.frame->instr_ptr.size();
-  vm.frame->instr_ptr = vm.frame->instr_ptr.subvec(remaining);
-  vm.retval = vv::gc::alloc<vv::value::nil>( );
+  write_error("caught exception: " + vm.retval.value());
+  // No need to clear out the rest of the line; the VM stops executing on its
+  // own once an exception goes uncaught
+  vm.retval = vv::value::handle::nil();
 }
 
 std::vector<std::unique_ptr<vv::ast::expression>> get_valid_line()
 {
   std::cout << ">>> ";
-  std::vector<std::string> tokens;
-  vv::parser::val_res validator;
+  // Every line read since the last complete expression, since the tokens point
+  // into it
+  std::string source;
+  std::vector<vv::parser::token> tokens;
+  vv::parser::parse_result parsed;
   while (!std::cin.eof()) {
     std::string line;
     getline(std::cin, line);
-    std::istringstream linestream{line};
+    source += line + '\n';
 
-    auto new_tokens = vv::parser::tokenize(linestream);
-    copy(begin(new_tokens), end(new_tokens), back_inserter(tokens));
-    validator = vv::parser::is_valid(tokens);
-    if (validator.valid())
+    tokens = vv::parser::tokenize(source);
+    parsed = vv::parser::parse(tokens);
+    const auto& validity = parsed.validity;
+    if (validity.valid())
       break;
 
-    if (validator.invalid() && validator->size()) {
+    if (validity.invalid() && validity->size()) {
       std::string error{"invalid syntax"};
-      if (validator.invalid()) {
+      if (validity.invalid()) {
         error += " at "
-              + (validator->front() == "\n"
+              + (validity->front().which == vv::parser::token::type::newline
                   ? "end of line: "
-                  : '\'' + validator->front() + "': ")
-              + validator.error();
+                  : '\'' + validity->front().str.to_string() + "': ")
+              + validity.error();
       }
       write_error(error);
-      tokens.clear();
+      source.clear();
       std::cout << ">>> ";
     } else {
       std::cout << "... ";
     }
   }
 
-  return vv::parser::parse(tokens);
+  return move(parsed.expressions);
 }
 
 void run_repl()
 {
-  vv::gc::init();
-
   auto base_frame = std::make_shared<vv::vm::call_frame>(
-      std::shared_ptr<vv::vm::call_frame>{},
-      std::shared_ptr<vv::vm::call_frame>{},
+      nullptr,
+      nullptr,
       0,
-      vv::vector_ref<vv::vm::command>{{}} );
+      0,
+      nullptr,
+      nullptr );
   vv::builtin::make_base_env(*base_frame);
 
   while (!std::cin.eof()) {
     for (const auto& expr : get_valid_line()) {
-      auto body = expr->generate();
-      base_frame->instr_ptr = vv::vector_ref<vv::vm::command>{body};
+      vv::ast::resolver scope;
+      expr->resolve(scope);
+      auto line = scope.top_level();
+      vv::vm::emitter out{line};
+      expr->generate(out);
+      out.emit(vv::vm::instruction::halt);
+      vv::vm::optimize(line);
+      base_frame->instr_ptr = line.body.data();
+      base_frame->code = &line;
       vv::vm::machine machine{base_frame, repl_catcher};
       machine.run();
-      std::cout << "=> " << machine.retval->value() << '\n';
+      std::cout << "=> " << machine.retval.value() << '\n';
     }
   }
   std::cout << '\n'; // stick prompt on newline on ^D
 }
 
+// Reads a number between min and max from str (e.g. an environment variable),
+// returning false if it isn't one
+bool read_number(const char* str, size_t& val, size_t max, size_t min)
+{
+  if (!isdigit(static_cast<unsigned char>(*str)))
+    return false;
+  char* end;
+  errno = 0;
+  auto num = strtoull(str, &end, 10);
+  if (*end || errno || num > max || num < min)
+    return false;
+  val = num;
+  return true;
+}
+
+bool read_number(const char* str, double& val, double max, double min)
+{
+  if (!isdigit(static_cast<unsigned char>(*str)))
+    return false;
+  char* end;
+  errno = 0;
+  auto num = strtod(str, &end);
+  if (*end || errno || num > max || num < min)
+    return false;
+  val = num;
+  return true;
+}
+
+// Reads the environment variable name into val, if it's set; complains and
+// returns false if it's set to something besides a number between min and max
+template <typename T>
+bool read_env(const char* name, T& val, const char* description,
+              T max = std::numeric_limits<T>::max(), T min = 0)
+{
+  auto env = getenv(name);
+  if (!env || read_number(env, val, max, min))
+    return true;
+  std::cerr << "invalid value for " << name << ": must be " << description
+            << '\n';
+  return false;
+}
+
+void write_ic_stats()
+{
+  const auto& stats = vv::vm::g_member_cache_stats;
+  std::cerr << "member caches: "
+            << stats.monomorphic_hits << " monomorphic hits, "
+            << stats.polymorphic_hits << " polymorphic hits, "
+            << stats.misses << " misses, "
+            << stats.megamorphic_sites << " megamorphic sites; "
+            << stats.write_hits << " write hits, "
+            << stats.write_misses << " write misses\n";
+}
+
+// Upper bound of a bucket of GC pauses, in whichever unit keeps it a whole
+// number (e.g. "<30us", "<2ms")
+std::string bucket_label(size_t bucket)
+{
+  if (bucket == vv::gc::pause_buckets - 1)
+    return ">=1s";
+  auto us = std::lround(vv::gc::pause_bucket_limit(bucket) * 1e6);
+  if (us < 1000)
+    return '<' + std::to_string(us) + "us";
+  if (us < 1000000)
+    return '<' + std::to_string(us / 1000) + "ms";
+  return '<' + std::to_string(us / 1000000) + 's';
+}
+
+void write_gc_stats()
+{
+  const auto& stats = vv::gc::g_collection_stats;
+  std::cerr << "gc: "
+            << stats.minor_collections << " minor collections ("
+            << stats.minor_time * 1000 << " ms), "
+            << stats.major_collections << " major collections ("
+            << stats.major_time * 1000 << " ms), "
+            << stats.promoted << " values promoted, peak heap "
+            << stats.peak_heap_size / 1024 << " KiB\n";
+
+  if (!stats.pauses)
+    return;
+  const auto& histogram = stats.pause_histogram;
+  // Only the bucket each pause fell into is kept, so percentiles are given as
+  // the upper bound of the bucket the nth percentile pause fell into
+  auto percentile = [&](size_t n)
+  {
+    auto rank = (stats.pauses - 1) * n / 100;
+    size_t bucket{0};
+    for (auto seen = histogram[0]; seen <= rank; seen += histogram[bucket])
+      ++bucket;
+    return bucket_label(bucket);
+  };
+  std::cerr << "gc pauses: " << stats.pauses << ", p50 " << percentile(50)
+            << ", p99 " << percentile(99) << ", max "
+            << stats.max_pause * 1000 << " ms\n";
+
+  std::cerr << "gc pause histogram:";
+  for (size_t i = 0; i != histogram.size(); ++i) {
+    if (histogram[i])
+      std::cerr << ' ' << bucket_label(i) << ' ' << histogram[i];
+  }
+  std::cerr << '\n';
+}
+
+// Reads the number given to a --name=number argument; returns false if arg's
+// not that argument. If it is, but what's given isn't a number between min and
+// max, complains and sets invalid
+template <typename T>
+bool read_flag(const std::string& arg, const std::string& name, T& val,
+               const char* description, bool& invalid,
+               T max = std::numeric_limits<T>::max(), T min = 0)
+{
+  auto prefix = "--" + name + '=';
+  if (arg.compare(0, prefix.size(), prefix))
+    return false;
+  if (!read_number(arg.c_str() + prefix.size(), val, max, min)) {
+    std::cerr << "invalid value for --" << name << ": must be " << description
+              << '\n';
+    invalid = true;
+  }
+  return true;
+}
+
+void write_opcode_profile()
+{
+  using vv::vm::instruction;
+  const auto& pairs = vv::vm::g_opcode_profile.pairs;
+  const auto size = vv::vm::opcode_profile::size;
+
+  // Pairs of {count, first * size + second}, most frequent first
+  std::vector<std::pair<size_t, size_t>> ranked;
+  size_t total{};
+  for (size_t first = 0; first != size; ++first) {
+    for (size_t second = 0; second != size; ++second) {
+      if (pairs[first][second])
+        ranked.emplace_back(pairs[first][second], first * size + second);
+      total += pairs[first][second];
+    }
+  }
+  sort(rbegin(ranked), rend(ranked));
+  if (ranked.size() > 20)
+    ranked.resize(20);
+
+  std::cerr << "opcode pairs (" << total << " total):\n";
+  for (const auto& i : ranked) {
+    auto first = static_cast<instruction>(i.second / size);
+    auto second = static_cast<instruction>(i.second % size);
+    std::cerr << "  " << i.first << '\t' << 100 * i.first / total << "%\t"
+              << to_string(first) << ' ' << to_string(second) << '\n';
+  }
+}
+
 int main(int argc, char** argv)
 {
+  auto print_name = argv[0];
+  auto ic_stats = false;
+  auto gc_stats = false;
+  auto& profile = vv::vm::g_opcode_profile;
+  size_t pause_budget{};
+  // Heap sizes are given in megabytes
+  size_t heap_min{vv::gc::g_heap_min >> 20};
+  auto heap_growth = vv::gc::g_heap_growth;
+  size_t max_heap{};
+
+  const auto micros = "a number of microseconds";
+  const auto megs = "a number of megabytes";
+  // Small enough that adding it to the current time can't overflow
+  const auto max_pause_budget = static_cast<size_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::duration::max()).count() / 2);
+  // Small enough to convert to bytes
+  const size_t max_megs{SIZE_MAX >> 20};
+  // The heap can't be expected to shrink between collections
+  const auto growth = "a number no less than 1";
+  const auto max_growth = std::numeric_limits<double>::max();
+  if (!read_env("VV_GC_PAUSE_BUDGET", pause_budget, micros, max_pause_budget)
+   || !read_env("VV_GC_HEAP_MIN", heap_min, megs, max_megs)
+   || !read_env("VV_GC_GROWTH", heap_growth, growth, max_growth, 1.0)
+   || !read_env("VV_MAX_HEAP", max_heap, megs, max_megs))
+    return 1;
+
+  auto invalid = false;
+  for (; argc > 1 && argv[1][0] == '-' && argv[1][1] == '-'; --argc, ++argv) {
+    if (argv[1] == std::string{"--ic-stats"})
+      ic_stats = true;
+    else if (argv[1] == std::string{"--gc-stats"})
+      gc_stats = true;
+    else if (argv[1] == std::string{"--profile-opcodes"})
+      profile.enabled = true;
+    else if (argv[1] == std::string{"--no-cache"})
+      vv::vm::g_cache_enabled = false;
+    else if (!read_flag(argv[1], "gc-pause-budget", pause_budget, micros,
+                        invalid, max_pause_budget) &&
+             !read_flag(argv[1], "gc-heap-min", heap_min, megs, invalid,
+                        max_megs) &&
+             !read_flag(argv[1], "gc-growth", heap_growth, growth, invalid,
+                        max_growth, 1.0) &&
+             !read_flag(argv[1], "max-heap", max_heap, megs, invalid,
+                        max_megs))
+      break;
+  }
+  if (invalid)
+    return 1;
+  vv::gc::g_pause_budget = std::chrono::microseconds{pause_budget};
+  vv::gc::g_heap_min = heap_min << 20;
+  vv::gc::g_heap_growth = heap_growth;
+  vv::gc::g_max_heap = max_heap << 20;
+
+  if (getenv("VV_NO_CACHE"))
+    vv::vm::g_cache_enabled = false;
+
   if (argc > 2) {
-    std::cerr << "Usage: " << argv[0] << " [file]\n";
+    std::cerr << "Usage: " << print_name
+              << " [--ic-stats] [--gc-stats] [--profile-opcodes] [--no-cache]"
+              << " [--gc-pause-budget=<us>] [--gc-heap-min=<MB>]"
+              << " [--gc-growth=<factor>] [--max-heap=<MB>] [file]\n";
     return 1;
   }
 
@@ -95,6 +325,12 @@ int main(int argc, char** argv)
   if (argc == 1) {
     run_repl();
     vv::gc::empty();
+    if (ic_stats)
+      write_ic_stats();
+    if (gc_stats)
+      write_gc_stats();
+    if (profile.enabled)
+      write_opcode_profile();
 
   } else {
     auto ret = vv::run_file(argv[1]);
@@ -102,9 +338,15 @@ int main(int argc, char** argv)
     if (ret.res == vv::run_file_result::result::file_not_found)
       std::cerr << argv[1] << ": file not found\n";
     else if (ret.res == vv::run_file_result::result::failure)
-      std::cerr << "Caught exception: " << ret.val->value() << '\n';
+      std::cerr << "Caught exception: " << ret.val.value() << '\n';
 
     vv::gc::empty();
+    if (ic_stats)
+      write_ic_stats();
+    if (gc_stats)
+      write_gc_stats();
+    if (profile.enabled)
+      write_opcode_profile();
     return ret.res != vv::run_file_result::result::success;
   }
 }
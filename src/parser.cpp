@@ -4,6 +4,7 @@
 #include "utils.h"
 #include "ast/assignment.h"
 #include "ast/array.h"
+#include "ast/binary_operator.h"
 #include "ast/block.h"
 #include "ast/cond_statement.h"
 #include "ast/dictionary.h"
@@ -24,349 +25,434 @@
 #include "ast/variable.h"
 #include "ast/variable_declaration.h"
 #include "ast/while_loop.h"
-#include "value/boolean.h"
-#include "value/floating_point.h"
-#include "value/integer.h"
-#include "value/nil.h"
 #include "value/string.h"
 #include "value/symbol.h"
 
-/// Implements a fairly simple recursive-descent parser
+/// Implements a fairly simple recursive-descent parser, which checks the syntax
+/// as it goes
 
 using namespace vv;
 using namespace ast;
+using parser::token;
+using parser::token_string;
+using parser::val_res;
+using token_type = token::type;
 
 // Parsing {{{
 
 namespace {
 
-bool trim_test(const std::string& s)
+bool trim_test(const token& t)
 {
-  return s=="\n" || s==";";
+  return t.which == token_type::newline || t.which == token_type::semicolon;
+}
+
+bool is_newline(const token& t)
+{
+  return t.which == token_type::newline;
+}
+
+bool next_is(token_string tokens, token_type which)
+{
+  return tokens.size() && tokens.front().which == which;
+}
+
+// Only needed for complaining about missing closing brackets
+std::string spelling(token_type which)
+{
+  switch (which) {
+  case token_type::close_brace:   return "}";
+  case token_type::close_bracket: return "]";
+  default:                        return ")";
+  }
+}
+
+char escaped(char nonescaped) {
+  switch (nonescaped) {
+  case 'a':  return '\a';
+  case 'b':  return '\b';
+  case 'n':  return '\n';
+  case 'f':  return '\f';
+  case 'r':  return '\r';
+  case 't':  return '\t';
+  case 'v':  return '\v';
+  case '"':  return '"';
+  case '\\': return '\\';
+  case '0':  return '\0';
+  default:   return nonescaped;
+  }
+}
+
+// Contents of a string literal, minus the quotes and with escape sequences
+// replaced
+std::string unescape(boost::string_ref literal)
+{
+  std::string val;
+  val.reserve(literal.size() - 2);
+  for (auto i = begin(literal) + 1; i != end(literal) - 1; ++i)
+    val += *i == '\\' ? escaped(*++i) : *i;
+  return val;
 }
 
 // Declarations {{{
 
+// Result of parsing some construct: what was parsed, along with the tokens
+// following it. Otherwise, either the tokens were a syntax error, in which case
+// status is invalid and points to where; or they just don't start with the
+// construct in question, in which case status is empty, and the caller's free
+// to try parsing something else.
 template <typename T = std::unique_ptr<expression>>
-using parse_res = boost::optional<std::pair<T, vector_ref<std::string>>>;
+class parse_res {
+public:
+  parse_res() { }
+  parse_res(T&& value, token_string rest)
+    : m_value  {std::move(value)},
+      m_status {rest}
+  { }
+  parse_res(token_string where, const std::string& what)
+    : m_status {where, what}
+  { }
+  // Passes on a failure to parse something else
+  parse_res(const val_res& failure)
+    : m_status {failure.invalid() ? failure : val_res{}}
+  { }
+
+  explicit operator bool() const { return m_status.operator bool(); }
+  bool invalid() const { return m_status.invalid(); }
+
+  T& operator*() { return *m_value; }
+  token_string rest() const { return *m_status; }
+  const val_res& status() const { return m_status; }
+
+private:
+  boost::optional<T> m_value;
+  val_res m_status;
+};
 
 using arg_t = std::vector<std::unique_ptr<expression>>;
 
-parse_res<> parse_expression(vector_ref<std::string> tokens);
-
-parse_res<> parse_nonop_expression(vector_ref<std::string> tokens);
-parse_res<> parse_prec0(vector_ref<std::string> tokens); // member, call, index
-parse_res<> parse_prec1(vector_ref<std::string> tokens); // monops
-parse_res<> parse_prec2(vector_ref<std::string> tokens); // **
-parse_res<> parse_prec3(vector_ref<std::string> tokens); // *, /, %
-parse_res<> parse_prec4(vector_ref<std::string> tokens); // +, -
-parse_res<> parse_prec5(vector_ref<std::string> tokens); // <<, >>
-parse_res<> parse_prec6(vector_ref<std::string> tokens); // &
-parse_res<> parse_prec7(vector_ref<std::string> tokens); // ^
-parse_res<> parse_prec8(vector_ref<std::string> tokens); // |
-parse_res<> parse_prec9(vector_ref<std::string> tokens); // to
-parse_res<> parse_prec10(vector_ref<std::string> tokens); // <, >, <=, =>
-parse_res<> parse_prec11(vector_ref<std::string> tokens); // ==, !=
-parse_res<> parse_prec12(vector_ref<std::string> tokens); // &&
-parse_res<> parse_prec13(vector_ref<std::string> tokens); // ||
-
-parse_res<> parse_array_literal(vector_ref<std::string> tokens);
-parse_res<> parse_dict_literal(vector_ref<std::string> tokens);
-parse_res<> parse_assignment(vector_ref<std::string> tokens);
-parse_res<> parse_block(vector_ref<std::string> tokens);
-parse_res<> parse_cond_statement(vector_ref<std::string> tokens);
-parse_res<> parse_except(vector_ref<std::string> tokens);
-parse_res<> parse_for_loop(vector_ref<std::string> tokens);
-parse_res<> parse_function_definition(vector_ref<std::string> tokens);
-parse_res<> parse_literal(vector_ref<std::string> tokens);
-parse_res<> parse_new_obj(vector_ref<std::string> tokens);
-parse_res<> parse_require(vector_ref<std::string> tokens);
-parse_res<> parse_return(vector_ref<std::string> tokens);
-parse_res<> parse_try_catch(vector_ref<std::string> tokens);
-parse_res<> parse_type_definition(vector_ref<std::string> tokens);
-parse_res<> parse_variable_declaration(vector_ref<std::string> tokens);
-parse_res<> parse_variable(vector_ref<std::string> tokens);
-parse_res<> parse_while_loop(vector_ref<std::string> tokens);
-
-parse_res<> parse_symbol(vector_ref<std::string> tokens);
-parse_res<> parse_integer(vector_ref<std::string> tokens);
-parse_res<> parse_float(vector_ref<std::string> tokens);
-parse_res<> parse_bool(vector_ref<std::string> tokens);
-parse_res<> parse_nil(vector_ref<std::string> tokens);
-parse_res<> parse_string(vector_ref<std::string> tokens);
+// Everything in a function definition after the 'fn', which is shared with
+// method definitions
+struct function_parts {
+  symbol name;
+  std::vector<symbol> args;
+  std::unique_ptr<expression> body;
+};
+
+parse_res<> parse_expression(token_string tokens);
+
+parse_res<> parse_nonop_expression(token_string tokens);
+parse_res<> parse_prec0(token_string tokens); // member, call, index
+parse_res<> parse_prec1(token_string tokens); // monops
+parse_res<> parse_prec2(token_string tokens); // **
+parse_res<> parse_prec3(token_string tokens); // *, /, %
+parse_res<> parse_prec4(token_string tokens); // +, -
+parse_res<> parse_prec5(token_string tokens); // <<, >>
+parse_res<> parse_prec6(token_string tokens); // &
+parse_res<> parse_prec7(token_string tokens); // ^
+parse_res<> parse_prec8(token_string tokens); // |
+parse_res<> parse_prec9(token_string tokens); // to
+parse_res<> parse_prec10(token_string tokens); // <, >, <=, =>
+parse_res<> parse_prec11(token_string tokens); // ==, !=
+parse_res<> parse_prec12(token_string tokens); // &&
+parse_res<> parse_prec13(token_string tokens); // ||
+
+parse_res<> parse_array_literal(token_string tokens);
+parse_res<> parse_dict_literal(token_string tokens);
+parse_res<> parse_assignment(token_string tokens);
+parse_res<> parse_block(token_string tokens);
+parse_res<> parse_cond_statement(token_string tokens);
+parse_res<> parse_except(token_string tokens);
+parse_res<> parse_for_loop(token_string tokens);
+parse_res<> parse_function_definition(token_string tokens);
+parse_res<> parse_literal(token_string tokens);
+parse_res<> parse_new_obj(token_string tokens);
+parse_res<> parse_require(token_string tokens);
+parse_res<> parse_return(token_string tokens);
+parse_res<> parse_try_catch(token_string tokens);
+parse_res<> parse_type_definition(token_string tokens);
+parse_res<> parse_variable_declaration(token_string tokens);
+parse_res<> parse_variable(token_string tokens);
+parse_res<> parse_while_loop(token_string tokens);
+
+parse_res<> parse_symbol(token_string tokens);
+parse_res<> parse_integer(token_string tokens);
+parse_res<> parse_float(token_string tokens);
+parse_res<> parse_bool(token_string tokens);
+parse_res<> parse_nil(token_string tokens);
+parse_res<> parse_string(token_string tokens);
 
 template <typename F>
-auto parse_comma_separated_list(vector_ref<std::string> tokens,
-                               const F& parse_item)
-    -> parse_res<std::vector<decltype(parse_item(tokens)->first)>>;
+auto parse_comma_separated_list(token_string tokens, const F& parse_item)
+    -> parse_res<std::vector<std::remove_reference_t<
+                                decltype(*parse_item(tokens))>>>;
 template <typename F>
-auto parse_bracketed_subexpr(vector_ref<std::string> tokens,
+auto parse_bracketed_subexpr(token_string tokens,
                              const F& parse_item,
-                             const std::string& opening,
-                             const std::string& closing)
+                             token_type opening,
+                             token_type closing)
     -> decltype(parse_item(tokens));
-parse_res<arg_t> parse_function_call(vector_ref<std::string> tokens);
+parse_res<arg_t> parse_function_call(token_string tokens);
 parse_res<std::pair<std::unique_ptr<expression>, std::unique_ptr<expression>>>
-  parse_cond_pair(vector_ref<std::string> tokens);
-parse_res<std::pair<symbol, function_definition>>
-  parse_method_definition(vector_ref<std::string> tokens);
+  parse_cond_pair(token_string tokens);
+parse_res<symbol> parse_name(token_string tokens);
+parse_res<function_parts> parse_function(token_string tokens);
 // }}}
 // Individual parsing functions {{{
 
-parse_res<> parse_expression(vector_ref<std::string> tokens)
+parse_res<> parse_expression(token_string tokens)
 {
   return parse_prec13(tokens);
 }
 
 // Operators {{{
 
-template <typename F1, typename F2, typename Pred, typename Transform>
-parse_res<> parse_operator_expr(vector_ref<std::string> tokens,
-                                const F1& pre,
-                                const F2& post,
-                                const Pred& test,
-                                const Transform& convert)
+// Parses a binary operator expression, given the operator's precedence level:
+// pre parses anything of a higher precedence, and post anything of the same
+// one or higher (they're right-associative)
+template <typename F1, typename F2, typename Pred, typename Make>
+parse_res<> parse_binop(token_string tokens,
+                        const F1& pre,
+                        const F2& post,
+                        const Pred& test,
+                        const Make& make)
 {
   auto left_res = pre(tokens);
   if (!left_res)
     return left_res;
-  tokens = left_res->second;
+  tokens = left_res.rest();
 
   if (tokens.size() && test(tokens.front())) {
-    auto left = move(left_res->first);
+    const auto& op = tokens.front();
+    auto right_res = post(tokens.subvec(1)); // binop
+    if (!right_res)
+      return right_res;
 
-    symbol method{convert(tokens.front())};
-
-    auto right_res = post(tokens.subvec(1)); // method (i.e. binop)
-    auto right = move(right_res->first);
-    tokens = right_res->second;
-
-    auto member = std::make_unique<ast::member>( move(left), method );
-    arg_t arg{};
-    arg.emplace_back(move(right));
-
-    return {{std::make_unique<function_call>(move(member), move(arg)), tokens}};
+    return { make(op, move(*left_res), move(*right_res)), right_res.rest() };
   }
   return left_res;
 }
 
-parse_res<> parse_prec13(vector_ref<std::string> tokens)
+// Method each binary operator is translated into a call to
+const char* method_for(token_type op)
 {
-  auto left_res = parse_prec12(tokens);
-  if (!left_res)
-    return left_res;
-  tokens = left_res->second;
-
-  if (tokens.size() && tokens.front() == "||") {
-    auto left = move(left_res->first);
-
-    auto right_res = parse_prec13(tokens.subvec(1)); // '||'
-    auto right = move(right_res->first);
-    tokens = right_res->second;
-
-    return {{ std::make_unique<logical_or>(move(left), move(right)), tokens }};
+  switch (op) {
+  case token_type::equals:         return "equals";
+  case token_type::not_equals:     return "unequal";
+  case token_type::greater:        return "greater";
+  case token_type::less:           return "less";
+  case token_type::greater_equals: return "greater_equals";
+  case token_type::less_equals:    return "less_equals";
+  case token_type::pipe:           return "bitor";
+  case token_type::caret:          return "xor";
+  case token_type::amp:            return "bitand";
+  case token_type::rshift:         return "rshift";
+  case token_type::lshift:         return "lshift";
+  case token_type::plus:           return "add";
+  case token_type::minus:          return "subtract";
+  case token_type::star:           return "times";
+  case token_type::slash:          return "divides";
+  case token_type::percent:        return "modulo";
+  case token_type::star_star:      return "pow";
+  default:                         return nullptr;
   }
-  return left_res;
 }
 
-parse_res<> parse_prec12(vector_ref<std::string> tokens)
+// Binary operators that are just method calls, given the operators at this
+// precedence level
+template <typename F1, typename F2>
+parse_res<> parse_operator_expr(token_string tokens,
+                                const F1& pre,
+                                const F2& post,
+                                std::initializer_list<token_type> ops)
 {
-  auto left_res = parse_prec11(tokens);
-  if (!left_res)
-    return left_res;
-  tokens = left_res->second;
+  return parse_binop(tokens, pre, post, [&](const token& op)
+  {
+    return std::find(begin(ops), end(ops), op.which) != end(ops);
+  },
+  [](const token& op, auto&& left, auto&& right)
+  {
+    return std::make_unique<binary_operator>( move(left),
+                                              symbol{method_for(op.which)},
+                                              move(right) );
+  });
+}
 
-  if (tokens.size() && tokens.front() == "&&") {
-    auto left = move(left_res->first);
-    auto right_res = parse_prec12(tokens.subvec(1)); // '&&'
-    auto right = move(right_res->first);
-    tokens = right_res->second;
+parse_res<> parse_prec13(token_string tokens)
+{
+  return parse_binop(tokens, parse_prec12, parse_prec13,
+                     [](const token& t)
+                     {
+                       return t.which == token_type::pipe_pipe;
+                     },
+                     [](const token&, auto&& left, auto&& right)
+                     {
+                       return std::make_unique<logical_or>( move(left),
+                                                            move(right) );
+                     });
+}
 
-    return {{ std::make_unique<logical_and>(move(left), move(right)), tokens }};
-  }
-  return left_res;
+parse_res<> parse_prec12(token_string tokens)
+{
+  return parse_binop(tokens, parse_prec11, parse_prec12,
+                     [](const token& t)
+                     {
+                       return t.which == token_type::amp_amp;
+                     },
+                     [](const token&, auto&& left, auto&& right)
+                     {
+                       return std::make_unique<logical_and>( move(left),
+                                                             move(right) );
+                     });
 }
 
-parse_res<> parse_prec11(vector_ref<std::string> tokens)
+parse_res<> parse_prec11(token_string tokens)
 {
   return parse_operator_expr(tokens, parse_prec10, parse_prec11,
-                             [](const auto& s)
-                             {
-                               return s == "==" || s == "!=";
-                             },
-                             [](const auto& s)
-                             {
-                               return (s == "==") ? "equals" : "unequal";
-                             });
+                             { token_type::equals, token_type::not_equals });
 }
 
-parse_res<> parse_prec10(vector_ref<std::string> tokens)
+parse_res<> parse_prec10(token_string tokens)
 {
   return parse_operator_expr(tokens, parse_prec9, parse_prec10,
-                             [](const auto& s)
-                             {
-                               return s == ">"
-                                   || s == "<"
-                                   || s == ">="
-                                   || s == "<=";
-                             },
-                             [](const auto& s)
-                             {
-                               return (s == ">")  ? "greater" :
-                                      (s == "<")  ? "less"    :
-                                      (s == ">=") ? "greater_equals" :
-                                                    "less_equals";
-                             });
-}
-
-parse_res<> parse_prec9(vector_ref<std::string> tokens)
-{
-  auto left_res = parse_prec8(tokens);
-  if (!left_res)
-    return left_res;
-  tokens = left_res->second;
-
-  if (tokens.size() && tokens.front() == "to") {
-    auto left = move(left_res->first);
-    auto right_res = parse_prec9(tokens.subvec(1)); // 'to'
-    auto right = move(right_res->first);
-    tokens = right_res->second;
-
-    arg_t args;
-    args.emplace_back(move(left));
-    args.emplace_back(move(right));
-
-    auto range = std::make_unique<variable>( symbol{"Range"} );
+                             { token_type::greater,
+                               token_type::less,
+                               token_type::greater_equals,
+                               token_type::less_equals });
+}
 
-    return {{std::make_unique<object_creation>(move(range), move(args)), tokens}};
-  }
-  return left_res;
+parse_res<> parse_prec9(token_string tokens)
+{
+  return parse_binop(tokens, parse_prec8, parse_prec9,
+                     [](const token& t)
+                     {
+                       return t.which == token_type::key_to;
+                     },
+                     [](const token&, auto&& left, auto&& right)
+                     {
+                       arg_t args;
+                       args.emplace_back(move(left));
+                       args.emplace_back(move(right));
+
+                       auto range = std::make_unique<variable>(symbol{"Range"});
+                       return std::make_unique<object_creation>( move(range),
+                                                                 move(args) );
+                     });
 }
 
-parse_res<> parse_prec8(vector_ref<std::string> tokens)
+parse_res<> parse_prec8(token_string tokens)
 {
   return parse_operator_expr(tokens, parse_prec7, parse_prec8,
-                             [](const auto& s) { return s == "|"; },
-                             [](const auto&) { return "bitor"; });
+                             { token_type::pipe });
 }
 
-parse_res<> parse_prec7(vector_ref<std::string> tokens)
+parse_res<> parse_prec7(token_string tokens)
 {
   return parse_operator_expr(tokens, parse_prec6, parse_prec7,
-                             [](const auto& s) { return s == "^"; },
-                             [](const auto&) { return "xor"; });
+                             { token_type::caret });
 }
 
-parse_res<> parse_prec6(vector_ref<std::string> tokens)
+parse_res<> parse_prec6(token_string tokens)
 {
   return parse_operator_expr(tokens, parse_prec5, parse_prec6,
-                             [](const auto& s) { return s == "&"; },
-                             [](const auto&) { return "bitand"; });
+                             { token_type::amp });
 }
 
-parse_res<> parse_prec5(vector_ref<std::string> tokens)
+parse_res<> parse_prec5(token_string tokens)
 {
   return parse_operator_expr(tokens, parse_prec4, parse_prec5,
-                             [](const auto& s)
-                             {
-                               return s == ">>" || s == "<<";
-                             },
-                             [](const auto& s)
-                             {
-                               return (s == ">>") ? "rshift" : "lshift";
-                             });
+                             { token_type::rshift, token_type::lshift });
 }
 
-parse_res<> parse_prec4(vector_ref<std::string> tokens)
+parse_res<> parse_prec4(token_string tokens)
 {
   return parse_operator_expr(tokens, parse_prec3, parse_prec4,
-                             [](const auto& s) { return s == "+" || s == "-"; },
-                             [](const auto& s)
-                             {
-                               return (s == "+") ? "add" : "subtract";
-                             });
+                             { token_type::plus, token_type::minus });
 }
 
-parse_res<> parse_prec3(vector_ref<std::string> tokens)
+parse_res<> parse_prec3(token_string tokens)
 {
   return parse_operator_expr(tokens, parse_prec2, parse_prec3,
-                             [](const auto& s)
-                             {
-                               return s == "*" || s == "/" || s == "%";
-                             },
-                             [](const auto& s)
-                             {
-                               return (s == "*") ? "times" :
-                                      (s == "/") ? "divides" :
-                                                   "modulo";
-                             });
+                             { token_type::star,
+                               token_type::slash,
+                               token_type::percent });
 }
 
-parse_res<> parse_prec2(vector_ref<std::string> tokens)
+parse_res<> parse_prec2(token_string tokens)
 {
   return parse_operator_expr(tokens, parse_prec1, parse_prec2,
-                             [](const auto& s) { return s == "**"; },
-                             [](const auto&) { return "pow"; });
+                             { token_type::star_star });
 }
 
-parse_res<> parse_prec1(vector_ref<std::string> tokens)
+parse_res<> parse_prec1(token_string tokens)
 {
-  if (tokens.size() && (tokens.front() == "!"
-                     || tokens.front() == "~"
-                     || tokens.front() == "-")) {
-
+  if (next_is(tokens, token_type::bang)
+   || next_is(tokens, token_type::tilde)
+   || next_is(tokens, token_type::minus)) {
 
-    symbol method{(tokens.front() == "!") ? "not" :
-                  (tokens.front() == "~") ? "negate" :
+    symbol method{next_is(tokens, token_type::bang)  ? "not" :
+                  next_is(tokens, token_type::tilde) ? "negate" :
                                             "negative"};
     auto expr_res = parse_prec1(tokens.subvec(1)); // monop
-    tokens = expr_res->second;
-    auto expr = move(expr_res->first);
-    auto member = std::make_unique<ast::member>( move(expr), method );
+    if (!expr_res)
+      return expr_res;
+    auto member = std::make_unique<ast::member>( move(*expr_res), method );
 
-    return {{ std::make_unique<function_call>( move(member), arg_t{} ),
-              tokens }};
+    return { std::make_unique<function_call>( move(member), arg_t{} ),
+             expr_res.rest() };
   }
   return parse_prec0(tokens);
 }
 
 // TODO: split function calls, members, and indexing into their own functions so
 // this one isn't so monstruously long
-parse_res<> parse_prec0(vector_ref<std::string> tokens)
+parse_res<> parse_prec0(token_string tokens)
 {
   auto expr_res = parse_nonop_expression(tokens);
-  if (!expr_res)
+  if (!expr_res || !expr_res.rest().size())
     return expr_res;
-  tokens = expr_res->second;
+  tokens = expr_res.rest();
 
-  auto expr = move(expr_res->first);
-  while (tokens.size() && (tokens.front() == "("
-                        || tokens.front() == "."
-                        || tokens.front() == "[")) {
-    if (tokens.front() == "(") {
+  auto expr = move(*expr_res);
+  while (next_is(tokens, token_type::open_paren)
+      || next_is(tokens, token_type::dot)
+      || next_is(tokens, token_type::open_bracket)) {
+    if (next_is(tokens, token_type::open_paren)) {
       auto list_res = parse_function_call(tokens);
-      auto list = move(list_res->first);
-      tokens = list_res->second;
-
-      expr = std::make_unique<function_call>(move(expr), move(list));
-
-    } else if (tokens.front() == "[") {
-      auto idx_res = parse_bracketed_subexpr(tokens, parse_expression, "[", "]");
-      auto idx = move(idx_res->first);
-      tokens = idx_res->second;
-
-      if (tokens.size() && tokens.front() == "=") {
+      if (list_res.invalid())
+        return list_res.status();
+      if (!list_res)
+        return { tokens.subvec(1), "expected argument list" };
+      tokens = list_res.rest();
+
+      expr = std::make_unique<function_call>(move(expr), move(*list_res));
+
+    } else if (next_is(tokens, token_type::open_bracket)) {
+      auto idx_res = parse_bracketed_subexpr(tokens, parse_expression,
+                                           token_type::open_bracket,
+                                           token_type::close_bracket);
+      if (idx_res.invalid())
+        return idx_res;
+      if (!idx_res)
+        return { tokens.subvec(1), "expected index expression" }; // '['
+      auto idx = move(*idx_res);
+      tokens = idx_res.rest();
+
+      if (next_is(tokens, token_type::assign)) {
         auto value_res = parse_expression(tokens.subvec(1)); // '='
-        auto value = move(value_res->first);
-        tokens = value_res->second;
+        if (value_res.invalid())
+          return value_res;
+        if (!value_res)
+          return { tokens.subvec(1), "expected assignment expression" }; // '='
 
-        auto member = std::make_unique<ast::member>( move(expr), symbol{"set_at"} );
+        auto member = std::make_unique<ast::member>( move(expr),
+                                                     symbol{"set_at"} );
         arg_t args{};
         args.emplace_back(move(idx));
-        args.emplace_back(move(value));
+        args.emplace_back(move(*value_res));
 
-        return {{ std::make_unique<function_call>( move(member), move(args) ),
-                  tokens }};
+        return { std::make_unique<function_call>( move(member), move(args) ),
+                 value_res.rest() };
       }
 
       auto member = std::make_unique<ast::member>( move(expr), symbol{"at"} );
@@ -375,494 +461,603 @@ parse_res<> parse_prec0(vector_ref<std::string> tokens)
       expr = std::make_unique<function_call>(move(member), move(arg));
 
     } else {
-      tokens = tokens.subvec(1); // '.'
-      symbol name{tokens.front()};
-      tokens = tokens.subvec(1); // name
+      auto name_res = parse_name(tokens.subvec(1)); // '.'
+      if (!name_res)
+        return { tokens.subvec(1), "expected member name" }; // '.'
+      auto name = *name_res;
+      tokens = name_res.rest();
 
-      if (tokens.size() && tokens.front() == "=") {
+      if (next_is(tokens, token_type::assign)) {
         auto value_res = parse_expression(tokens.subvec(1)); // '='
-        auto value = move(value_res->first);
-        tokens = value_res->second;
-        return {{ std::make_unique<member_assignment>( move(expr),
-                                                       name,
-                                                       move(value) ),
-                  tokens }};
+        if (value_res.invalid())
+          return value_res;
+        if (!value_res)
+          return { tokens.subvec(1), "expected assignment expression" }; // '='
+        return { std::make_unique<member_assignment>( move(expr),
+                                                      name,
+                                                      move(*value_res) ),
+                 value_res.rest() };
       }
       expr = std::make_unique<member>( move(expr), name );
     }
   }
-  return {{ move(expr), tokens }};
+  return { move(expr), tokens };
 }
 
-parse_res<> parse_nonop_expression(vector_ref<std::string> tokens)
+parse_res<> parse_nonop_expression(token_string tokens)
 {
-  if (tokens.size() && tokens.front() == "(")
-    return parse_bracketed_subexpr(tokens, parse_expression, "(", ")");
+  if (!tokens.size())
+    return {};
+  if (next_is(tokens, token_type::open_paren)) {
+    auto expr = parse_bracketed_subexpr(tokens, parse_expression,
+                                        token_type::open_paren,
+                                        token_type::close_paren);
+    if (expr || expr.invalid())
+      return expr;
+    return { tokens.subvec(1), "expected expression in parentheses" }; // '('
+  }
 
   parse_res<> res;
-  if ((res = parse_array_literal(tokens)))        return res;
-  if ((res = parse_assignment(tokens)))           return res;
-  if ((res = parse_block(tokens)))                return res;
-  if ((res = parse_cond_statement(tokens)))       return res;
-  if ((res = parse_dict_literal(tokens)))         return res;
-  if ((res = parse_except(tokens)))               return res;
-  if ((res = parse_for_loop(tokens)))             return res;
-  if ((res = parse_function_definition(tokens)))  return res;
-  if ((res = parse_literal(tokens)))              return res;
-  if ((res = parse_new_obj(tokens)))              return res;
-  if ((res = parse_require(tokens)))              return res;
-  if ((res = parse_return(tokens)))               return res;
-  if ((res = parse_try_catch(tokens)))            return res;
-  if ((res = parse_type_definition(tokens)))      return res;
-  if ((res = parse_variable_declaration(tokens))) return res;
-  if ((res = parse_while_loop(tokens)))           return res;
-  if ((res = parse_variable(tokens)))             return res;
-  return {};
+  if ((res = parse_array_literal(tokens))        || res.invalid()) return res;
+  if ((res = parse_assignment(tokens))           || res.invalid()) return res;
+  if ((res = parse_block(tokens))                || res.invalid()) return res;
+  if ((res = parse_cond_statement(tokens))       || res.invalid()) return res;
+  if ((res = parse_dict_literal(tokens))         || res.invalid()) return res;
+  if ((res = parse_except(tokens))               || res.invalid()) return res;
+  if ((res = parse_for_loop(tokens))             || res.invalid()) return res;
+  if ((res = parse_function_definition(tokens))  || res.invalid()) return res;
+  if ((res = parse_literal(tokens))              || res.invalid()) return res;
+  if ((res = parse_new_obj(tokens))              || res.invalid()) return res;
+  if ((res = parse_require(tokens))              || res.invalid()) return res;
+  if ((res = parse_return(tokens))               || res.invalid()) return res;
+  if ((res = parse_try_catch(tokens))            || res.invalid()) return res;
+  if ((res = parse_type_definition(tokens))      || res.invalid()) return res;
+  if ((res = parse_variable_declaration(tokens)) || res.invalid()) return res;
+  if ((res = parse_while_loop(tokens))           || res.invalid()) return res;
+  // has to come last, since most keywords would make valid names
+  return parse_variable(tokens);
 }
 
 // }}}
 // Other expressions {{{
 
-parse_res<> parse_assignment(vector_ref<std::string> tokens)
+parse_res<> parse_assignment(token_string tokens)
 {
-  if (tokens.size() < 2 || tokens[1] != "=")
+  // Checked before parsing the name, so a variable that isn't being assigned
+  // to doesn't get turned into a symbol twice
+  if (tokens.size() < 2 || tokens[1].which != token_type::assign)
+    return {};
+  auto name = parse_name(tokens);
+  if (!name)
     return {};
-  auto name = tokens.front();
-  auto expr_res = parse_expression(tokens.subvec(2)); // name '='
-  auto expr = move(expr_res->first);
-  tokens = expr_res->second;
-  return {{ std::make_unique<assignment>( name, move(expr) ), tokens }};
+  tokens = name.rest().subvec(1); // '='
+
+  auto expr_res = parse_expression(tokens);
+  if (expr_res.invalid())
+    return expr_res;
+  if (!expr_res)
+    return { tokens, "expected expression" };
+  return { std::make_unique<assignment>( *name, move(*expr_res) ),
+           expr_res.rest() };
 }
 
-parse_res<> parse_block(vector_ref<std::string> tokens)
+parse_res<> parse_block(token_string tokens)
 {
-  const static auto trim_test = [](const auto& s) { return s=="\n" || s==";"; };
-
-  if (!tokens.size() || tokens.front() != "do")
+  if (!next_is(tokens, token_type::key_do))
     return {};
   tokens = tokens.subvec(1); // 'do'
 
   std::vector<std::unique_ptr<expression>> subexprs;
   tokens = ltrim_if(tokens, trim_test);
-  while (tokens.front() != "end") {
+  while (tokens.size() && !next_is(tokens, token_type::key_end)) {
     auto expr_res = parse_expression(tokens);
-    subexprs.push_back(move(expr_res->first));
-    tokens = expr_res->second;
-    tokens = ltrim_if(tokens, trim_test);
+    if (expr_res.invalid())
+      return expr_res;
+    if (!expr_res)
+      return { tokens, "expected expression or 'end'" };
+    subexprs.push_back(move(*expr_res));
+    tokens = ltrim_if(expr_res.rest(), trim_test);
   }
+  if (!tokens.size())
+    return { tokens, "expected 'end'" };
 
   tokens = tokens.subvec(1); // 'end'
-  return {{ std::make_unique<block>( move(subexprs) ), tokens }};
+  return { std::make_unique<block>( move(subexprs) ), tokens };
 }
 
-parse_res<> parse_array_literal(vector_ref<std::string> tokens)
+parse_res<> parse_array_literal(token_string tokens)
 {
-  if (!tokens.size() || tokens.front() != "[")
+  if (!next_is(tokens, token_type::open_bracket))
     return {};
 
   auto vals_res = parse_bracketed_subexpr(tokens, [](auto t)
   {
     return parse_comma_separated_list(t, parse_expression);
-  }, "[", "]");
-  auto vals = move(vals_res->first);
-  tokens = vals_res->second;
+  }, token_type::open_bracket, token_type::close_bracket);
+  if (vals_res.invalid())
+    return vals_res.status();
+  if (!vals_res)
+    return { tokens.subvec(1), "expected array literal" };
 
-  return {{ std::make_unique<array>( move(vals) ), tokens }};
+  return { std::make_unique<array>( move(*vals_res) ), vals_res.rest() };
 }
 
-parse_res<> parse_dict_literal(vector_ref<std::string> tokens)
+parse_res<> parse_dict_literal(token_string tokens)
 {
-  if (!tokens.size() || tokens.front() != "{")
+  if (!next_is(tokens, token_type::open_brace))
     return {};
 
   auto vals_res = parse_bracketed_subexpr(tokens, [](auto t)
   {
     return parse_comma_separated_list(t, parse_cond_pair);
-  }, "{", "}");
-  auto vals = move(vals_res->first);
-  tokens = vals_res->second;
+  }, token_type::open_brace, token_type::close_brace);
+  if (vals_res.invalid())
+    return vals_res.status();
+  if (!vals_res)
+    return { tokens.subvec(1), "expected dictionary literal" };
   // inefficient, but do I really care at this point?
   arg_t flattened;
-  for (auto& i : vals) {
+  for (auto& i : *vals_res) {
     flattened.push_back(move(i.first));
     flattened.push_back(move(i.second));
   }
 
-  return {{ std::make_unique<dictionary>( move(flattened) ), tokens }};
+  return { std::make_unique<dictionary>( move(flattened) ), vals_res.rest() };
 }
 
-parse_res<> parse_cond_statement(vector_ref<std::string> tokens)
+parse_res<> parse_cond_statement(token_string tokens)
 {
-  if (!tokens.size() || (tokens.front() != "cond" && tokens.front() != "if"))
+  if (!next_is(tokens, token_type::key_cond)
+   && !next_is(tokens, token_type::key_if))
     return {};
-  tokens = ltrim(tokens.subvec(1), {"\n"});
+  tokens = ltrim_if(tokens.subvec(1), is_newline); // 'cond'
 
   auto pairs_res = parse_comma_separated_list(tokens, parse_cond_pair);
-  auto pairs = move(pairs_res->first);
-  tokens = pairs_res->second;
+  if (pairs_res.invalid())
+    return pairs_res.status();
+  if (!pairs_res)
+    return { tokens, "expected cond pair" };
 
-  return {{ std::make_unique<cond_statement>(move(pairs)), tokens }};
+  return { std::make_unique<cond_statement>(move(*pairs_res)),
+           pairs_res.rest() };
 }
 
-parse_res<> parse_except(vector_ref<std::string> tokens)
+parse_res<> parse_except(token_string tokens)
 {
-  if (!tokens.size() || tokens.front() != "except")
+  if (!next_is(tokens, token_type::key_except))
     return {};
   tokens = tokens.subvec(1); // 'except'
   auto expr_res = parse_expression(tokens);
-  auto expr = move(expr_res->first);
-  tokens = expr_res->second;
-  return {{ std::make_unique<except>( move(expr) ), tokens }};
+  if (expr_res.invalid())
+    return expr_res;
+  if (!expr_res)
+    return { tokens, "expected expression" };
+  return { std::make_unique<except>( move(*expr_res) ), expr_res.rest() };
 }
 
-parse_res<> parse_for_loop(vector_ref<std::string> tokens)
+parse_res<> parse_for_loop(token_string tokens)
 {
-  if (!tokens.size() || tokens.front() != "for")
+  if (!next_is(tokens, token_type::key_for))
     return {};
-  tokens = tokens.subvec(1); // 'for'
-
-  auto iterator = tokens.front();
-  tokens = tokens.subvec(2); // iterator 'in'
-
-  auto range_res = parse_expression(tokens);
-  auto range = move(range_res->first);
-  tokens = range_res->second.subvec(1); // ':'
 
-  auto body_res = parse_expression(tokens); // ':'
-  auto body = move(body_res->first);
-  tokens = body_res->second;
-
-  return {{ std::make_unique<for_loop>( iterator, move(range), move(body) ),
-            tokens }};
+  auto iterator = parse_name(tokens.subvec(1)); // 'for'
+  if (!iterator)
+    return { tokens.subvec(1), "expected variable name" }; // 'for'
+  tokens = iterator.rest();
+  if (!next_is(tokens, token_type::key_in))
+    return { tokens, "expected 'in'" };
+
+  auto range_res = parse_expression(tokens.subvec(1)); // 'in'
+  if (range_res.invalid())
+    return range_res;
+  if (!range_res)
+    return { tokens.subvec(1), "expected expression" }; // 'in'
+  tokens = range_res.rest();
+
+  if (!next_is(tokens, token_type::colon))
+    return { tokens, "expected ':'" };
+  auto body_res = parse_expression(tokens.subvec(1)); // ':'
+  if (body_res.invalid())
+    return body_res;
+  if (!body_res)
+    return { tokens.subvec(1), "expected expression" }; // ':'
+
+  return { std::make_unique<for_loop>( *iterator,
+                                       move(*range_res),
+                                       move(*body_res) ),
+           body_res.rest() };
 }
 
-parse_res<> parse_function_definition(vector_ref<std::string> tokens)
+parse_res<> parse_function_definition(token_string tokens)
 {
-  if (!tokens.size() || tokens.front() != "fn")
-    return {};
-  tokens = tokens.subvec(1);
-
-  symbol name;
-  if (tokens.front() != "(") {
-    name = tokens.front();
-    tokens = tokens.subvec(1); // name
-  }
-
-  auto arg_res = parse_bracketed_subexpr(tokens, [](auto tokens)
-  {
-    return parse_comma_separated_list(tokens, [](auto t)
-    {
-      if (t.front() == ")")
-        return parse_res<symbol>{};
-      return parse_res<symbol>{{ symbol{t.front()}, t.subvec(1) }}; // arg name
-    });
-  }, "(", ")");
-  auto args = move(arg_res->first);
-  tokens = arg_res->second;
-
-  auto body_res = parse_expression(tokens.subvec(1)); // ':'
-  auto body = move(body_res->first);
-  tokens = body_res->second;
-
-  return {{ std::make_unique<function_definition>( name, move(body), args ),
-            tokens }};
+  auto fn_res = parse_function(tokens);
+  if (!fn_res)
+    return fn_res.status();
+  auto& fn = *fn_res;
+  return { std::make_unique<function_definition>( fn.name,
+                                                  move(fn.body),
+                                                  fn.args ),
+           fn_res.rest() };
 }
 
-parse_res<> parse_literal(vector_ref<std::string> tokens)
+parse_res<> parse_literal(token_string tokens)
 {
   parse_res<> res;
-  if ((res = parse_float(tokens)))   return res;
-  if ((res = parse_integer(tokens))) return res;
-  if ((res = parse_bool(tokens)))    return res;
-  if ((res = parse_nil(tokens)))     return res;
-  if ((res = parse_symbol(tokens)))  return res;
-  if ((res = parse_string(tokens)))  return res;
-  return res;
+  if ((res = parse_bool(tokens))    || res.invalid()) return res;
+  if ((res = parse_float(tokens))   || res.invalid()) return res;
+  if ((res = parse_integer(tokens)) || res.invalid()) return res;
+  if ((res = parse_nil(tokens))     || res.invalid()) return res;
+  if ((res = parse_string(tokens))  || res.invalid()) return res;
+  return parse_symbol(tokens);
 }
 
-parse_res<> parse_new_obj(vector_ref<std::string> tokens)
+parse_res<> parse_new_obj(token_string tokens)
 {
-  if (!tokens.size() || tokens.front() != "new")
+  if (!next_is(tokens, token_type::key_new))
     return {};
   tokens = tokens.subvec(1); // 'new'
 
   auto type_res = parse_variable(tokens);
-  auto type = move(type_res->first);
-  tokens = type_res->second;
-  tokens = type_res->second;
+  if (!type_res)
+    return { tokens, "expected variable name" };
+  tokens = type_res.rest();
 
   auto args_res = parse_function_call(tokens);
-  auto args = move(args_res->first);
-  tokens = args_res->second;
-
-  return {{ std::make_unique<object_creation>( move(type), move(args) ),
-            tokens }};
+  if (args_res.invalid())
+    return args_res.status();
+  if (!args_res)
+    return { tokens, "expected argument list" };
+
+  return { std::make_unique<object_creation>( move(*type_res),
+                                              move(*args_res) ),
+           args_res.rest() };
 }
 
-parse_res<> parse_require(vector_ref<std::string> tokens)
+parse_res<> parse_require(token_string tokens)
 {
-  if (!tokens.size() || tokens.front() != "require")
+  if (!next_is(tokens, token_type::key_require))
     return {};
   tokens = tokens.subvec(1); // 'require'
-  std::string filename{++begin(tokens.front()), --end(tokens.front())};
-  tokens = tokens.subvec(1); // filename
-  return {{ std::make_unique<require>( filename ), tokens }};
+  auto filename = parse_string(tokens);
+  if (filename.invalid())
+    return filename;
+  if (!filename)
+    return { tokens, "expected expression" };
+
+  return { std::make_unique<require>( unescape(tokens.front().str) ),
+           filename.rest() };
 }
 
-parse_res<> parse_return(vector_ref<std::string> tokens)
+parse_res<> parse_return(token_string tokens)
 {
-  if (!tokens.size() || tokens.front() != "return")
+  if (!next_is(tokens, token_type::key_return))
     return {};
-  tokens = tokens.subvec(1); // 'except'
+  tokens = tokens.subvec(1); // 'return'
   auto expr_res = parse_expression(tokens);
-  auto expr = move(expr_res->first);
-  tokens = expr_res->second;
-  return {{ std::make_unique<return_statement>( move(expr) ), tokens }};
+  if (expr_res.invalid())
+    return expr_res;
+  if (!expr_res)
+    return { tokens, "expected expression" };
+  return { std::make_unique<return_statement>( move(*expr_res) ),
+           expr_res.rest() };
 }
 
-parse_res<> parse_try_catch(vector_ref<std::string> tokens)
+parse_res<> parse_try_catch(token_string tokens)
 {
-  if (!tokens.size() || tokens.front() != "try")
+  if (!next_is(tokens, token_type::key_try))
     return {};
+  if (tokens.size() < 2 || tokens[1].which != token_type::colon)
+    return { tokens.subvec(1), "expected ':'" }; // 'try'
   tokens = tokens.subvec(2); // 'try' ':'
 
   auto body_res = parse_expression(tokens);
-  auto body = move(body_res->first);
-  tokens = body_res->second;
-
-  tokens = ltrim(tokens, {"\n"});
-  tokens = tokens.subvec(1); // 'catch'
-  symbol exception_name{tokens.front()};
-  std::vector<symbol> exception_arg{exception_name};
-  tokens = tokens.subvec(2); // name ':
+  if (body_res.invalid())
+    return body_res;
+  if (!body_res)
+    return { tokens, "expected expression" };
+
+  tokens = ltrim_if(body_res.rest(), is_newline);
+  if (!next_is(tokens, token_type::key_catch))
+    return { tokens, "expected 'catch'" };
+  auto exception_name = parse_name(tokens.subvec(1)); // 'catch'
+  if (!exception_name)
+    return { tokens, "expected variable name" };
+  tokens = exception_name.rest();
+
+  if (!next_is(tokens, token_type::colon))
+    return { tokens, "expected ':'" };
+  tokens = tokens.subvec(1); // ':'
 
   auto catcher_res = parse_expression(tokens);
-  auto catcher = move(catcher_res->first);
-  tokens = catcher_res->second;
-
-  return {{std::make_unique<try_catch>(move(body),exception_name,move(catcher)),
-           tokens}};
+  if (catcher_res.invalid())
+    return catcher_res;
+  if (!catcher_res)
+    return { tokens, "expected expression" };
+
+  return { std::make_unique<try_catch>( move(*body_res),
+                                        *exception_name,
+                                        move(*catcher_res) ),
+           catcher_res.rest() };
 }
 
-parse_res<> parse_type_definition(vector_ref<std::string> tokens)
+parse_res<> parse_type_definition(token_string tokens)
 {
-  if (!tokens.size() || tokens.front() != "class")
-    return{};
-  symbol name{tokens[1]};
-  tokens = tokens.subvec(2); // 'class' name
+  if (!next_is(tokens, token_type::key_class))
+    return {};
+  auto name = parse_name(tokens.subvec(1)); // 'class'
+  if (!name)
+    return { tokens.subvec(1), "expected variable name" }; // 'class'
+  tokens = name.rest();
 
   symbol parent{"Object"};
-  if (tokens.front() == ":") {
-    parent = tokens[1];
-    tokens = tokens.subvec(2); // ':' parent
+  if (next_is(tokens, token_type::colon)) {
+    auto parent_res = parse_name(tokens.subvec(1)); // ':'
+    if (!parent_res)
+      return { tokens.subvec(1), "expected variable name" }; // ':'
+    parent = *parent_res;
+    tokens = parent_res.rest();
   }
 
   std::unordered_map<symbol, function_definition> method_map;
   tokens = ltrim_if(tokens, trim_test);
-  while (tokens.front() != "end") {
-    auto method = parse_method_definition(tokens);
-    method_map.insert(std::make_pair(method->first.first,
-                                     method->first.second));
-    tokens = ltrim_if(method->second, trim_test);
+  while (tokens.size() && !next_is(tokens, token_type::key_end)) {
+    auto method_res = parse_function(tokens);
+    if (method_res.invalid())
+      return method_res.status();
+    if (!method_res)
+      return { tokens, "expected method definition or 'end'" };
+    auto& method = *method_res;
+    if (method.name == symbol{})
+      return { tokens.subvec(1), "expected variable name" }; // 'fn'
+
+    method_map.insert(std::make_pair(method.name,
+                                     function_definition{ {},
+                                                          move(method.body),
+                                                          method.args }));
+    tokens = ltrim_if(method_res.rest(), trim_test);
   }
+  if (!tokens.size())
+    return { tokens, "expected 'end'" };
   tokens = tokens.subvec(1); // 'end'
 
-  return {{ std::make_unique<type_definition>( name, parent, move(method_map) ),
-            tokens }};
+  return { std::make_unique<type_definition>( *name,
+                                              parent,
+                                              move(method_map) ),
+           tokens };
 }
 
-parse_res<> parse_variable_declaration(vector_ref<std::string> tokens)
+parse_res<> parse_variable_declaration(token_string tokens)
 {
-  if (!tokens.size() || tokens.front() != "let")
+  if (!next_is(tokens, token_type::key_let))
     return {};
-  auto name = tokens[1];
-  auto expr_res = parse_expression(tokens.subvec(3)); // 'let' name '='
-  auto expr = move(expr_res->first);
-  tokens = expr_res->second;
-  return {{ std::make_unique<variable_declaration>(name, move(expr)), tokens }};
+  auto name = parse_name(tokens.subvec(1)); // 'let'
+  if (!name)
+    return { tokens.subvec(1), "expected variable name" }; // 'let'
+  tokens = name.rest();
+  if (!next_is(tokens, token_type::assign))
+    return { tokens, "expected '='" };
+
+  auto expr_res = parse_expression(tokens.subvec(1)); // '='
+  if (expr_res.invalid())
+    return expr_res;
+  if (!expr_res)
+    return { tokens.subvec(1), "expected expression" }; // '='
+  return { std::make_unique<variable_declaration>( *name, move(*expr_res) ),
+           expr_res.rest() };
 }
 
-parse_res<> parse_variable(vector_ref<std::string> tokens)
+parse_res<> parse_variable(token_string tokens)
 {
-  if (!tokens.size() || !isnamechar(tokens.front().front()))
+  auto name = parse_name(tokens);
+  if (!name)
     return {};
-  symbol name{tokens.front()};
-  tokens = tokens.subvec(1); // name
-  return {{ std::make_unique<variable>(name), tokens }};
+  return { std::make_unique<variable>(*name), name.rest() };
 }
 
-parse_res<> parse_while_loop(vector_ref<std::string> tokens)
+parse_res<> parse_while_loop(token_string tokens)
 {
-  if (!tokens.size() || tokens.front() != "while")
+  if (!next_is(tokens, token_type::key_while))
     return {};
+  tokens = tokens.subvec(1); // 'while'
 
-  auto test_res = parse_expression(tokens.subvec(1)); // 'while'
-  auto test = move(test_res->first);
-  tokens = test_res->second;
+  auto test_res = parse_expression(tokens);
+  if (test_res.invalid())
+    return test_res;
+  if (!test_res)
+    return { tokens, "expected expression" };
+  tokens = test_res.rest();
 
+  if (!next_is(tokens, token_type::colon))
+    return { tokens, "expected ':'" };
   auto body_res = parse_expression(tokens.subvec(1)); // ':'
-  auto body = move(body_res->first);
-  tokens = body_res->second;
+  if (body_res.invalid())
+    return body_res;
+  if (!body_res)
+    return { tokens.subvec(1), "expected expression" }; // ':'
 
-  return {{ std::make_unique<while_loop>( move(test), move(body) ), tokens }};
+  return { std::make_unique<while_loop>( move(*test_res), move(*body_res) ),
+           body_res.rest() };
 }
 
 // }}}
 // Literals {{{
 
-parse_res<> parse_symbol(vector_ref<std::string> tokens)
+parse_res<> parse_symbol(token_string tokens)
 {
-  if (!tokens.size() || tokens.front() != "'")
+  if (!next_is(tokens, token_type::quote))
     return {};
-  symbol name{tokens[1]};
+  if (tokens.size() < 2)
+    return { tokens.subvec(1), "expected symbol name" }; // '''
+  symbol name{tokens[1].str.to_string()};
   tokens = tokens.subvec(2); // ''' name
-  return {{ std::make_unique<literal::symbol>( name ), tokens }};
+  return { std::make_unique<literal::symbol>( name ), tokens };
 }
 
-parse_res<> parse_integer(vector_ref<std::string> tokens)
+parse_res<> parse_integer(token_string tokens)
 {
-  // parse_float should already be called by the time we get here, so assume
-  // we're an integer
-  if (!tokens.size() || !isdigit(tokens.front().front()))
+  // Anything wrong with the number itself has already been found while
+  // tokenizing
+  if (next_is(tokens, token_type::invalid_number))
+    return { tokens, "invalid number" };
+  if (!next_is(tokens, token_type::integer))
     return {};
-  auto str = tokens.front();
+  auto value = tokens.front().as_int;
   tokens = tokens.subvec(1); // number
 
-  return {{ std::make_unique<literal::integer>( to_int(str) ), tokens }};
+  return { std::make_unique<literal::integer>( value ), tokens };
 }
 
-parse_res<> parse_float(vector_ref<std::string> tokens)
+parse_res<> parse_float(token_string tokens)
 {
-  if (!tokens.size() || !isdigit(tokens.front().front()))
+  if (!next_is(tokens, token_type::floating_point))
     return {};
-  auto str = tokens.front();
+  auto value = tokens.front().as_float;
   tokens = tokens.subvec(1); // number
-
-  // Could this instead call parse_integer? Yes. Would that make more sense?
-  // Probably. Oh well.
-  if (find(begin(str), end(str), '.') == end(str))
-    return {};
-  return {{ std::make_unique<literal::floating_point>( stod(str) ), tokens }};
+  return { std::make_unique<literal::floating_point>( value ), tokens };
 }
 
-parse_res<> parse_bool(vector_ref<std::string> tokens)
+parse_res<> parse_bool(token_string tokens)
 {
-  if (!tokens.size() || (tokens.front() != "true" && tokens.front() != "false"))
+  if (!next_is(tokens, token_type::key_true)
+   && !next_is(tokens, token_type::key_false))
     return {};
-  bool value{tokens.front() == "true"};
+  bool value{tokens.front().which == token_type::key_true};
   tokens = tokens.subvec(1); // value
-  return {{ std::make_unique<literal::boolean>( value ), tokens }};
+  return { std::make_unique<literal::boolean>( value ), tokens };
 }
 
-parse_res<> parse_nil(vector_ref<std::string> tokens)
+parse_res<> parse_nil(token_string tokens)
 {
-  if (!tokens.size() || tokens.front() != "nil")
+  if (!next_is(tokens, token_type::key_nil))
     return {};
   tokens = tokens.subvec(1); // 'nil'
-  return {{ std::make_unique<literal::nil>( ), tokens }};
+  return { std::make_unique<literal::nil>( ), tokens };
 }
 
-parse_res<> parse_string(vector_ref<std::string> tokens)
+parse_res<> parse_string(token_string tokens)
 {
-  if (!tokens.size() || tokens.front().front() != '"')
+  if (!tokens.size() || tokens.front().str.front() != '"')
     return {};
-  // inc/decrement to remove quotes
-  std::string val{++begin(tokens.front()), --end(tokens.front())};
+  // How many ways are there to screw up a string, really?
+  if (tokens.front().which != token_type::string)
+    return { tokens, "invalid string" };
+  auto val = unescape(tokens.front().str);
   tokens = tokens.subvec(1); // val
-  return {{ std::make_unique<literal::string>( val ), tokens }};
+  return { std::make_unique<literal::string>( val ), tokens };
 }
 
 // }}}
 // Helpers {{{
 
+// Always succeeds (possibly with an empty list), unless one of the items is
+// invalid
 template <typename F>
-auto parse_comma_separated_list(vector_ref<std::string> tokens,
-                               const F& parse_item)
-    -> parse_res<std::vector<decltype(parse_item(tokens)->first)>>
+auto parse_comma_separated_list(token_string tokens, const F& parse_item)
+    -> parse_res<std::vector<std::remove_reference_t<
+                                decltype(*parse_item(tokens))>>>
 {
-  tokens = ltrim(tokens, {"\n"});
-  std::vector<decltype(parse_item(tokens)->first)> items;
-  decltype(parse_item(tokens)) item_res = parse_item(tokens);
+  std::vector<std::remove_reference_t<decltype(*parse_item(tokens))>> items;
+  auto item_res = parse_item(tokens);
   while (item_res) {
-    items.push_back(std::move(item_res->first));
-    tokens = item_res->second;
-    if (!tokens.size() || tokens.front() != ",")
-      return {{ move(items), tokens }};
-    tokens = ltrim(tokens.subvec(1), {"\n"}); // ','
+    items.push_back(std::move(*item_res));
+    tokens = item_res.rest();
+    if (!next_is(tokens, token_type::comma))
+      return { move(items), tokens };
+    tokens = ltrim_if(tokens.subvec(1), is_newline); // ','
     item_res = parse_item(tokens);
   }
-  return {{ move(items), tokens }};
+  if (item_res.invalid())
+    return item_res.status();
+  return { move(items), tokens };
 }
 
 template <typename F>
-auto parse_bracketed_subexpr(vector_ref<std::string> tokens,
+auto parse_bracketed_subexpr(token_string tokens,
                              const F& parse_item,
-                             const std::string& opening,
-                             const std::string&)
+                             token_type opening,
+                             token_type closing)
     -> decltype(parse_item(tokens))
 {
-  if (!tokens.size() || tokens.front() != opening)
+  if (!next_is(tokens, opening))
     return {};
-  tokens = ltrim(tokens.subvec(1), {"\n"}); // opening
+  tokens = ltrim_if(tokens.subvec(1), trim_test); // opening
   auto res = parse_item(tokens);
-  res->second = ltrim(res->second, {"\n"}).subvec(1); // closing
-  return res;
+  if (!res)
+    return res;
+  tokens = res.rest();
+  if (!next_is(tokens, closing))
+    return { tokens, "expected '" + spelling(closing) + '\'' };
+  return { move(*res), tokens.subvec(1) }; // closing
 }
 
-parse_res<arg_t> parse_function_call(vector_ref<std::string> tokens)
+parse_res<arg_t> parse_function_call(token_string tokens)
 {
   return parse_bracketed_subexpr(tokens, [](auto t)
   {
     return parse_comma_separated_list(t, parse_expression);
-  },"(", ")");
+  }, token_type::open_paren, token_type::close_paren);
 }
 
 parse_res<std::pair<std::unique_ptr<expression>, std::unique_ptr<expression>>>
-  parse_cond_pair(vector_ref<std::string> tokens)
+  parse_cond_pair(token_string tokens)
 {
   auto test_res = parse_expression(tokens);
   if (!test_res)
-    return {};
-  auto test = move(test_res->first);
-  tokens = test_res->second.subvec(1); // ':'
+    return test_res.status();
+  tokens = test_res.rest();
+  if (!next_is(tokens, token_type::colon))
+    return { tokens, "expected ':'" };
 
-  auto body_res = parse_expression(tokens);
-  auto body = move(body_res->first);
-  tokens = body_res->second;
+  auto body_res = parse_expression(tokens.subvec(1)); // ':'
+  if (body_res.invalid())
+    return body_res.status();
+  if (!body_res)
+    return { tokens.subvec(1), "expected expression" }; // ':'
 
-  return {{ make_pair(move(test), move(body)), tokens }};
+  return { make_pair(move(*test_res), move(*body_res)), body_res.rest() };
 }
 
-// Syntactically identical to (named) function definitions, but the returned
-// result is different
-parse_res<std::pair<symbol, function_definition>>
-  parse_method_definition(vector_ref<std::string> tokens)
+// Variable (or member, argument, etc.) name
+parse_res<symbol> parse_name(token_string tokens)
 {
-  if (!tokens.size() || tokens.front() != "fn")
+  if (!tokens.size() || !tokens.front().is_name())
+    return {};
+  return { symbol{tokens.front().str.to_string()}, tokens.subvec(1) }; // name
+}
+
+parse_res<function_parts> parse_function(token_string tokens)
+{
+  if (!next_is(tokens, token_type::key_fn))
     return {};
   tokens = tokens.subvec(1); // 'fn'
 
-  symbol name{tokens.front()};
-  tokens = tokens.subvec(1); // name
+  function_parts fn{};
+  if (auto name = parse_name(tokens)) {
+    fn.name = *name;
+    tokens = name.rest();
+  }
 
-  auto arg_res = parse_bracketed_subexpr(tokens, [](auto tokens)
+  auto arg_res = parse_bracketed_subexpr(tokens, [](auto t)
   {
-    return parse_comma_separated_list(tokens, [](auto t)
-    {
-      if (t.front() == ")")
-        return parse_res<symbol>{};
-      return parse_res<symbol>{{ symbol{t.front()}, t.subvec(1) }}; // argname
-    });
-  }, "(", ")");
-  auto args = move(arg_res->first);
-  tokens = arg_res->second;
-
+    return parse_comma_separated_list(t, parse_name);
+  }, token_type::open_paren, token_type::close_paren);
+  if (arg_res.invalid())
+    return arg_res.status();
+  if (!arg_res)
+    return { tokens, "expected argument list" };
+  fn.args = move(*arg_res);
+  tokens = arg_res.rest();
+
+  if (!next_is(tokens, token_type::colon))
+    return { tokens, "expected ':'" };
   auto body_res = parse_expression(tokens.subvec(1)); // ':'
-  auto body = move(body_res->first);
-  tokens = body_res->second;
+  if (body_res.invalid())
+    return body_res.status();
+  if (!body_res)
+    return { tokens.subvec(1), "expected expression" }; // ':'
+  fn.body = move(*body_res);
 
-  return {{ std::make_pair( name,function_definition{ {}, move(body), args} ),
-            tokens}};
+  return { std::move(fn), body_res.rest() };
 }
 
 // }}}
@@ -871,18 +1066,21 @@ parse_res<std::pair<symbol, function_definition>>
 
 }
 
-std::vector<std::unique_ptr<expression>> parser::parse(token_string tokens)
+parser::parse_result parser::parse(token_string tokens)
 {
   std::vector<std::unique_ptr<expression>> expressions;
   tokens = ltrim_if(tokens, trim_test);
 
   while (tokens.size()) {
     auto res = parse_expression(tokens);
-    expressions.push_back(move(res->first));
-    tokens = res->second;
-    tokens = ltrim_if(res->second, trim_test);
+    if (res.invalid())
+      return { {}, res.status() };
+    if (!res)
+      return { {}, { tokens, "expected end of input" } };
+    expressions.push_back(move(*res));
+    tokens = ltrim_if(res.rest(), trim_test);
   }
-  return expressions;
+  return { move(expressions), tokens };
 }
 
 // }}}
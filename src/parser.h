@@ -6,7 +6,6 @@
 
 #include <boost/optional/optional.hpp>
 
-#include <istream>
 #include <string>
 #include <vector>
 
@@ -14,11 +13,101 @@ namespace vv {
 
 namespace parser {
 
+// A single token, pointing into the source it was read from (which has to
+// outlive it)
+struct token {
+  enum class type {
+    open_brace,
+    close_brace,
+    open_bracket,
+    close_bracket,
+    open_paren,
+    close_paren,
+    comma,
+    colon,
+    semicolon,
+    dot,
+    quote,
+    hash,
+    newline,
+
+    plus,
+    minus,
+    star,
+    star_star,
+    slash,
+    percent,
+    tilde,
+    caret,
+    bang,
+    amp,
+    amp_amp,
+    pipe,
+    pipe_pipe,
+    assign,
+    equals,
+    not_equals,
+    less,
+    less_equals,
+    lshift,
+    greater,
+    greater_equals,
+    rshift,
+
+    integer,
+    floating_point,
+    string,
+    // An integer literal without any digits (e.g. '0x'), or too big for an int
+    invalid_number,
+
+    name,
+    // Keywords are still valid names anywhere a keyword isn't expected (e.g.
+    // 'foo.class'), so they all come after name
+    key_catch,
+    key_class,
+    key_cond,
+    key_do,
+    key_end,
+    key_except,
+    key_false,
+    key_fn,
+    key_for,
+    key_if,
+    key_in,
+    key_let,
+    key_new,
+    key_nil,
+    key_require,
+    key_return,
+    key_to,
+    key_true,
+    key_try,
+    key_while,
+
+    // A character that can't start any token
+    invalid
+  };
+
+  bool is_name() const { return which >= type::name && which < type::invalid; }
+
+  type which;
+  boost::string_ref str;
+  int line;
+  int column;
+  // Integer and float literals are decoded while tokenizing
+  union {
+    int    as_int;
+    double as_float;
+  };
+};
+
+using token_string = vector_ref<token>;
+
 class val_res {
 public:
-  val_res(vector_ref<std::string> token) : m_tokens{token} { }
+  val_res(token_string token) : m_tokens{token} { }
   val_res() { }
-  val_res(vector_ref<std::string> where, const std::string& what)
+  val_res(token_string where, const std::string& what)
     : m_tokens {where},
       m_error  {what}
   { }
@@ -34,17 +123,22 @@ public:
   bool valid() const { return !m_error; }
 
 private:
-  boost::optional<vector_ref<std::string>> m_tokens;
+  boost::optional<token_string> m_tokens;
   boost::optional<std::string> m_error;
 };
 
-using token_string = vector_ref<std::string>;
+// Tokenizes source, which has to outlive the tokens. Every line ends in a
+// newline token, including the last one, even if source doesn't end in '\n'
+std::vector<token> tokenize(boost::string_ref source);
 
-std::vector<std::string> tokenize(std::istream& input);
-
-val_res is_valid(token_string tokens);
+struct parse_result {
+  std::vector<std::unique_ptr<ast::expression>> expressions;
+  // Invalid, pointing to the offending token, if tokens aren't valid syntax
+  // (in which case there aren't any expressions)
+  val_res validity;
+};
 
-std::vector<std::unique_ptr<ast::expression>> parse(token_string tokens);
+parse_result parse(token_string tokens);
 
 }
 
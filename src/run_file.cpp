@@ -1,28 +1,37 @@
 #include "run_file.h"
 
 #include "builtins.h"
+#include "expression.h"
 #include "gc.h"
 #include "parser.h"
 #include "vm.h"
+#include "ast/resolver.h"
 #include "value/string.h"
+#include "vm/bytecode_cache.h"
+#include "vm/emitter.h"
+#include "vm/optimizer.h"
 
 #include <boost/filesystem.hpp>
 
 #include <fstream>
+#include <iterator>
 
 namespace {
 
-std::string message_for(vv::vector_ref<std::string> tokens,
+std::string message_for(vv::parser::token_string tokens,
                         const std::string& filename,
                         vv::parser::val_res validator)
 {
   if (validator.invalid()) {
-    const std::string* first{tokens.data()};
-    auto line = count(first, begin(*validator), "\n");
-    auto token = validator->size() == 0 ? "end of input"
-                                        : '\'' + validator->front() + '\'';
+    // Every line ends in a newline, so the end of input is on the line after
+    // the last one
+    auto line = validator->size() ? validator->front().line
+                                   : tokens.size() ? tokens.back().line + 1 : 1;
+    auto token = validator->size() == 0
+               ? "end of input"
+               : '\'' + validator->front().str.to_string() + '\'';
     return "Invalid syntax at " + token
-           + " in " + filename + " on line " + std::to_string(line + 1) + ": "
+           + " in " + filename + " on line " + std::to_string(line) + ": "
            + validator.error();
   }
 
@@ -39,18 +48,33 @@ vv::run_file_result vv::run_file(const std::string& filename)
              gc::alloc<value::string>( '"' + filename + "\": file not found" ),
              {} };
 
-  auto tokens = parser::tokenize(file);
-  auto validator = parser::is_valid(tokens);
-  if (!validator)
-    return { run_file_result::result::failure,
-             gc::alloc<value::string>(message_for(tokens, filename, validator)),
-             {} };
-
-  auto exprs = vv::parser::parse(tokens);
-  std::vector<vv::vm::command> body;
-  for (const auto& i : exprs) {
-    auto code = i->generate();
-    copy(begin(code), end(code), back_inserter(body));
+  vm::function_t file_code{};
+  if (auto cached = vm::load_cached(filename)) {
+    file_code = std::move(*cached);
+  } else {
+    // The tokens (and so the syntax tree) point into source, so it has to be
+    // read all at once and kept around until they're done with
+    std::string source{std::istreambuf_iterator<char>{file}, {}};
+    auto tokens = parser::tokenize(source);
+    auto parsed = parser::parse(tokens);
+    if (!parsed.validity)
+      return { run_file_result::result::failure,
+               gc::alloc<value::string>(message_for(tokens, filename,
+                                                    parsed.validity)),
+               {} };
+
+    const auto& exprs = parsed.expressions;
+    ast::resolver scope;
+    for (const auto& i : exprs)
+      i->resolve(scope);
+
+    file_code = scope.top_level();
+    vm::emitter out{file_code};
+    for (const auto& i : exprs)
+      i->generate(out);
+    out.emit(vm::instruction::halt);
+    vm::optimize(file_code);
+    vm::store_cached(filename, source, file_code);
   }
 
   // set working directory to path of file
@@ -60,7 +84,9 @@ vv::run_file_result vv::run_file(const std::string& filename)
     boost::filesystem::current_path(path.parent_path());
 
   // Set up base env
-  auto vm_base = std::make_shared<vm::call_frame>(nullptr, nullptr, 0, body);
+  auto vm_base = std::make_shared<vm::call_frame>(nullptr, nullptr, 0, 0,
+                                                  file_code.body.data(),
+                                                  &file_code);
   builtin::make_base_env(*vm_base);
 
   // Flag to check for exceptions--- slightly hacky, but oh well
@@ -75,6 +101,6 @@ vv::run_file_result vv::run_file(const std::string& filename)
     return { run_file_result::result::failure, machine.retval, {} };
 
   return { run_file_result::result::success,
-           gc::alloc<value::boolean>( true ),
+           value::handle{true},
            vm_base->local.front() };
 }
@@ -15,9 +15,9 @@ public:
     file_not_found
   } res;
   /// true on success, excepted result on exception or file_not_found
-  value::base* val;
+  value::handle val;
   /// frame containing everything defined in file
-  std::unordered_map<symbol, value::base*> frame;
+  std::unordered_map<symbol, value::handle> frame;
 };
 
 run_file_result run_file(const std::string& filename);
@@ -0,0 +1,26 @@
+#include "shape.h"
+
+using namespace vv;
+
+const shape* shape::empty()
+{
+  static const shape root{};
+  return &root;
+}
+
+int shape::find(symbol name) const
+{
+  auto slot = m_slots.find(name);
+  return slot == end(m_slots) ? -1 : slot->second;
+}
+
+const shape* shape::add(symbol name) const
+{
+  auto& next = m_transitions[name];
+  if (!next) {
+    next.reset(new shape{});
+    next->m_slots = m_slots;
+    next->m_slots[name] = static_cast<int>(m_slots.size());
+  }
+  return next.get();
+}
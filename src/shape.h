@@ -0,0 +1,44 @@
+#ifndef VV_SHAPE_H
+#define VV_SHAPE_H
+
+#include "symbol.h"
+
+#include <memory>
+#include <unordered_map>
+
+namespace vv {
+
+// Hidden class describing which members an object has, and which of the
+// object's member slots each is stored in. Shapes form a tree rooted at the
+// empty shape: adding a member to an object moves it to the child shape for
+// that name, so every object that had the same members added in the same order
+// shares a single shape. That makes the shape a cheap key for member caches
+// (see vm::member_cache), and saves every object from carrying around its own
+// hash table.
+//
+// Shapes are never freed; the tree only grows as large as the number of
+// distinct member layouts a program creates.
+class shape {
+public:
+  // Shape of an object without any members
+  static const shape* empty();
+
+  // Returns the slot the member name is stored in, or -1 if there's no such
+  // member
+  int find(symbol name) const;
+  // Returns the shape of an object with this shape once name's been added to
+  // it, as the last slot
+  const shape* add(symbol name) const;
+
+  size_t size() const { return m_slots.size(); }
+
+private:
+  shape() = default;
+
+  std::unordered_map<symbol, int> m_slots;
+  mutable std::unordered_map<symbol, std::unique_ptr<shape>> m_transitions;
+};
+
+}
+
+#endif
@@ -1,6 +1,11 @@
 #include "parser.h"
 
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+
 using namespace vv;
+using parser::token;
 
 /**
  * Available tokens:
@@ -9,18 +14,19 @@ using namespace vv;
  * '(', ')'
  * '.'
  * ','
- * ':'
- * '='
- * '=='
+ * ':', ';'
+ * '=', '==', '!='
  * '+', '-'
- * '*', '/', '%'
+ * '*', '**', '/', '%'
  * '!', '~'
  * '^', '&', '|'
  * '&&', '||'
  * '<', '>', '<=', '>='
+ * '<<', '>>'
  * '''
+ * '#'
  * (strings)
- * (names)
+ * (names and keywords)
  * (numbers)
  * (hexadecimal numbers)
  * (binary numbers)
@@ -30,250 +36,328 @@ using namespace vv;
 
 namespace {
 
-using tok_res = std::pair<std::string, boost::string_ref>;
-
-// Individual tokenizing functions {{{
-
-// '0' {{{
-
-tok_res zero_token(boost::string_ref line)
-{
-  auto last = begin(line) + 1;
-  if (line.size() > 1) {
-    if (line[1] == '.') {
-      auto post_dot = std::find_if_not(begin(line) + 2, end(line), isdigit);
-      if (post_dot != begin(line) + 2)
-        last = post_dot;
-
-    } else if (line[1] == 'x') {
-      last = std::find_if(begin(line) + 2, end(line),
-                         [](auto c) { return !isdigit(c) || c < 'a' || c > 'f'; });
-
-    } else if (line[1] == 'b') {
-      last = std::find_if(begin(line) + 2, end(line),
-                          [](auto c) { return c != '0' && c != '1'; });
-
-    } else if (isdigit(line[1])) {
-      last = std::find_if(begin(line) + 2, end(line),
-                          [](auto c)
-                            { return !isdigit(c) || c == '8' || c == '9'; });
-    }
+// Everything needed to make tokens from a contiguous source buffer. Each
+// tokenizing function reads a single token starting at m_pos, and leaves m_pos
+// at the first character after it.
+class tokenizer {
+public:
+  tokenizer(boost::string_ref source)
+    : m_pos        {source.data()},
+      m_end        {source.data() + source.size()},
+      m_line_start {source.data()},
+      m_line       {1}
+  {
+    // Rough guess at how many tokens there'll be (about one per three
+    // characters, in the examples), to avoid reallocating over and over
+    m_tokens.reserve(source.size() / 3);
   }
-  std::string num{begin(line), last};
-  return { num, ltrim(line.substr(last - begin(line))) };
-}
 
-// }}}
-// '1'-'9' {{{
-
-tok_res digit_token(boost::string_ref line)
+  std::vector<token> tokenize();
+
+private:
+  // Individual tokenizing functions {{{
+
+  void push(token::type which, const char* first);
+  // Pushes an integer literal starting at first, whose digits (in base) run
+  // from digits to m_pos
+  void push_integer(const char* first, const char* digits, unsigned base);
+
+  void number_token(const char* first);
+  void zero_token(const char* first);
+  void string_token(const char* first);
+  void name_token(const char* first);
+  // Pushes a two-character token if the next character is second, and a
+  // one-character one otherwise
+  void pair_token(const char* first,
+                  char second,
+                  token::type single,
+                  token::type pair);
+
+  // }}}
+
+  std::vector<token> m_tokens;
+  const char* m_pos;
+  const char* m_end;
+  const char* m_line_start;
+  int m_line;
+};
+
+bool is_space(char c)
 {
-  auto nondigit = std::find_if_not(begin(line), end(line), isdigit);
-  if (nondigit != end(line) && *nondigit == '.') {
-    auto nonfloat = std::find_if_not(nondigit + 1, end(line), isdigit);
-    if (nonfloat != nondigit + 1)
-      nondigit = nonfloat;
-  }
-
-  return { {begin(line), nondigit}, ltrim(line.substr(nondigit - begin(line)))};
+  return c != '\n' && isspace(static_cast<unsigned char>(c));
 }
 
-// }}}
-// '=' {{{
-
-tok_res eq_tokens(boost::string_ref line)
+bool is_digit(char c)
 {
-  if (line.size() == 1 || line[1] != '=')
-    return {"=", ltrim(line.substr(1))};
-  return {"==", ltrim(line.substr(2))};
+  return isdigit(static_cast<unsigned char>(c));
 }
 
-// }}}
-// '!' {{{
-
-tok_res bang_tokens(boost::string_ref line)
+bool is_namechar(char c)
 {
-  if (line.size() == 1 || line[1] != '=')
-    return {"!", ltrim(line.substr(1))};
-  return {"!=", ltrim(line.substr(2))};
+  return !(c & 0x80) && isnamechar(c);
 }
 
-// }}}
-// '*' {{{
-
-tok_res star_tokens(boost::string_ref line)
+// Decodes the digits of an integer literal into val; returns false if there
+// aren't any, or they don't fit in an int
+bool decode_int(const char* first, const char* last, unsigned base, int& val)
 {
-  if (line.size() == 1 || line[1] != '*')
-    return {"*", ltrim(line.substr(1))};
-  return {"**", ltrim(line.substr(2))};
+  if (first == last)
+    return false;
+  unsigned num{};
+  for (; first != last; ++first) {
+    auto digit = static_cast<unsigned>(is_digit(*first)
+                                       ? *first - '0'
+                                       : tolower(*first) - 'a' + 10);
+    if (num > (INT_MAX - digit) / base)
+      return false;
+    num = num * base + digit;
+  }
+  val = static_cast<int>(num);
+  return true;
 }
 
-// }}}
-// '&' {{{
+const struct {
+  boost::string_ref str;
+  token::type which;
+} keywords[] = {
+  { "catch",   token::type::key_catch   },
+  { "class",   token::type::key_class   },
+  { "cond",    token::type::key_cond    },
+  { "do",      token::type::key_do      },
+  { "end",     token::type::key_end     },
+  { "except",  token::type::key_except  },
+  { "false",   token::type::key_false   },
+  { "fn",      token::type::key_fn      },
+  { "for",     token::type::key_for     },
+  { "if",      token::type::key_if      },
+  { "in",      token::type::key_in      },
+  { "let",     token::type::key_let     },
+  { "new",     token::type::key_new     },
+  { "nil",     token::type::key_nil     },
+  { "require", token::type::key_require },
+  { "return",  token::type::key_return  },
+  { "to",      token::type::key_to      },
+  { "true",    token::type::key_true    },
+  { "try",     token::type::key_try     },
+  { "while",   token::type::key_while   }
+};
+
+// Individual tokenizing functions {{{
 
-tok_res and_tokens(boost::string_ref line)
+void tokenizer::push(token::type which, const char* first)
 {
-  if (line.size() == 1 || line[1] != '&')
-    return {"&", ltrim(line.substr(1))};
-  return {"&&", ltrim(line.substr(2))};
+  token tok;
+  tok.which = which;
+  tok.str = {first, static_cast<size_t>(m_pos - first)};
+  tok.line = m_line;
+  tok.column = static_cast<int>(first - m_line_start) + 1;
+  tok.as_int = 0;
+  m_tokens.push_back(tok);
 }
 
-// }}}
-// '|' {{{
-
-tok_res or_tokens(boost::string_ref line)
+void tokenizer::push_integer(const char* first,
+                             const char* digits,
+                             unsigned base)
 {
-  if (line.size() == 1 || line[1] != '|')
-    return {"|", ltrim(line.substr(1))};
-  return {"||", ltrim(line.substr(2))};
+  int val;
+  if (decode_int(digits, m_pos, base, val)) {
+    push(token::type::integer, first);
+    m_tokens.back().as_int = val;
+  } else {
+    push(token::type::invalid_number, first);
+  }
 }
 
-// }}}
-// '<' {{{
+// '1'-'9' {{{
 
-tok_res lt_tokens(boost::string_ref line)
+void tokenizer::number_token(const char* first)
 {
-  if (line.size() > 1 && line[1] == '=')
-    return {"<=", ltrim(line.substr(2))};
-  if (line.size() > 1 && line[1] == '<')
-    return {"<<", ltrim(line.substr(2))};
-  return {"<", ltrim(line.substr(1))};
+  m_pos = std::find_if_not(m_pos, m_end, is_digit);
+  if (m_pos + 1 < m_end && *m_pos == '.' && is_digit(m_pos[1])) {
+    m_pos = std::find_if_not(m_pos + 1, m_end, is_digit);
+    // Almost always short enough for std::string not to allocate
+    std::string digits{first, m_pos};
+    errno = 0;
+    auto val = strtod(digits.c_str(), nullptr);
+    if (errno == ERANGE) {
+      push(token::type::invalid_number, first);
+    } else {
+      push(token::type::floating_point, first);
+      m_tokens.back().as_float = val;
+    }
+  } else {
+    push_integer(first, first, 10);
+  }
 }
 
 // }}}
-// '>' {{{
+// '0' {{{
 
-tok_res gt_tokens(boost::string_ref line)
+void tokenizer::zero_token(const char* first)
 {
-  if (line.size() > 1 && line[1] == '=')
-    return {">=", ltrim(line.substr(2))};
-  if (line.size() > 1 && line[1] == '>')
-    return {">>", ltrim(line.substr(2))};
-  return {">", ltrim(line.substr(1))};
+  if (m_pos != m_end && *m_pos == '.')
+    return number_token(first);
+
+  if (m_pos == m_end || (*m_pos != 'x' && *m_pos != 'b')) {
+    m_pos = std::find_if(m_pos, m_end, [](auto c)
+    {
+      return c < '0' || c > '7';
+    });
+    // Not an octal digit, but not the start of another token either (e.g. the
+    // 9 in '019')
+    if (m_pos != m_end && is_digit(*m_pos)) {
+      m_pos = std::find_if_not(m_pos, m_end, is_digit);
+      return push(token::type::invalid_number, first);
+    }
+    return push_integer(first, first, 8);
+  }
+
+  // Hexadecimal or binary; "0x" or "0b" without any digits is left for the
+  // parser to complain about
+  auto base = *m_pos++ == 'x' ? 16u : 2u;
+  auto digits = m_pos;
+  m_pos = std::find_if(m_pos, m_end, [base](auto c)
+  {
+    return base == 16 ? !isxdigit(static_cast<unsigned char>(c))
+                      : c != '0' && c != '1';
+  });
+  push_integer(first, digits, base);
 }
 
 // }}}
 // '"' {{{
 
-char escaped(char nonescaped) {
-  switch (nonescaped) {
-  case 'a':  return '\a';
-  case 'b':  return '\b';
-  case 'n':  return '\n';
-  case 'f':  return '\f';
-  case 'r':  return '\r';
-  case 't':  return '\t';
-  case 'v':  return '\v';
-  case '"':  return '"';
-  case '\\': return '\\';
-  case '0':  return '\0';
-  default:   return nonescaped;
-  }
-}
-
-tok_res string_token(boost::string_ref line)
+// Escape sequences are left alone, to be decoded by the parser. A string with
+// no closing quote ends at the end of the line, and is left for the parser to
+// complain about
+void tokenizer::string_token(const char* first)
 {
-  std::string token{'"'};
-  line.remove_prefix(1);
-  while (line.front() != '"') {
-    if (line.front() == '\\') {
-      line.remove_prefix(1);
-      token += escaped(line.front());
-    } else {
-      token += line.front();
-    }
-    line.remove_prefix(1);
+  while (m_pos != m_end && *m_pos != '"' && *m_pos != '\n') {
+    if (*m_pos == '\\' && m_pos + 1 != m_end && m_pos[1] != '\n')
+      ++m_pos;
+    ++m_pos;
   }
-  return {token += '"', ltrim(line.substr(1))};
+  if (m_pos == m_end || *m_pos != '"')
+    return push(token::type::invalid, first);
+  ++m_pos;
+  push(token::type::string, first);
 }
 
 // }}}
-// '/' {{{
+// /./ {{{
 
-tok_res slash_token(boost::string_ref line)
+void tokenizer::name_token(const char* first)
 {
-  if (line.size() == 1 || line[1] != '/')
-    return {"/", ltrim(line.substr(1))};
-  line.remove_prefix(1 + std::find(begin(line), end(line), '\n') - begin(line));
-  return {"\n", line};
+  m_pos = std::find_if_not(m_pos, m_end, is_namechar);
+  boost::string_ref name{first, static_cast<size_t>(m_pos - first)};
+  auto which = token::type::name;
+  for (const auto& i : keywords) {
+    if (i.str == name) {
+      which = i.which;
+      break;
+    }
+  }
+  push(which, first);
 }
 
 // }}}
-// /./ {{{
 
-tok_res name_token(boost::string_ref line)
+void tokenizer::pair_token(const char* first,
+                           char second,
+                           token::type single,
+                           token::type pair)
 {
-  auto last = std::find_if(begin(line), end(line),
-                           [](auto c) { return isspace(c) || !isnamechar(c); });
-  std::string name{begin(line), last};
-  return {name, ltrim(line.substr(last - begin(line)))};
+  if (m_pos != m_end && *m_pos == second) {
+    ++m_pos;
+    push(pair, first);
+  } else {
+    push(single, first);
+  }
 }
 
 // }}}
 
-tok_res first_token(boost::string_ref line)
+std::vector<token> tokenizer::tokenize()
 {
-  tok_res token;
-  switch (line.front()) {
-  case '{':
-  case '}':
-  case '[':
-  case ']':
-  case '(':
-  case ')':
-  case ',':
-  case ':':
-  case ';':
-  case '+':
-  case '-':
-  case '~':
-  case '^':
-  case '%':
-  case '#':
-  case '.':
-  case '\'': return {{line.front()}, ltrim(line.substr(1))};
-  case '1':
-  case '2':
-  case '3':
-  case '4':
-  case '5':
-  case '6':
-  case '7':
-  case '8':
-  case '9': return digit_token(line);
-  case '0': return zero_token(line);
-  case '=': return eq_tokens(line);
-  case '!': return bang_tokens(line);
-  case '*': return star_tokens(line);
-  case '&': return and_tokens(line);
-  case '|': return or_tokens(line);
-  case '<': return lt_tokens(line);
-  case '>': return gt_tokens(line);
-  case '"': return string_token(line);
-  case '/': return slash_token(line);
-  default:  return name_token(line);
+  using type = token::type;
+
+  while (m_pos != m_end) {
+    auto first = m_pos++;
+    switch (*first) {
+    case '\n':
+      push(type::newline, first);
+      ++m_line;
+      m_line_start = m_pos;
+      break;
+
+    case '{':  push(type::open_brace, first);    break;
+    case '}':  push(type::close_brace, first);   break;
+    case '[':  push(type::open_bracket, first);  break;
+    case ']':  push(type::close_bracket, first); break;
+    case '(':  push(type::open_paren, first);    break;
+    case ')':  push(type::close_paren, first);   break;
+    case ',':  push(type::comma, first);         break;
+    case ':':  push(type::colon, first);         break;
+    case ';':  push(type::semicolon, first);     break;
+    case '+':  push(type::plus, first);          break;
+    case '-':  push(type::minus, first);         break;
+    case '~':  push(type::tilde, first);         break;
+    case '^':  push(type::caret, first);         break;
+    case '%':  push(type::percent, first);       break;
+    case '#':  push(type::hash, first);          break;
+    case '.':  push(type::dot, first);           break;
+    case '\'': push(type::quote, first);         break;
+
+    case '=': pair_token(first, '=', type::assign, type::equals);     break;
+    case '!': pair_token(first, '=', type::bang, type::not_equals);   break;
+    case '*': pair_token(first, '*', type::star, type::star_star);    break;
+    case '&': pair_token(first, '&', type::amp, type::amp_amp);       break;
+    case '|': pair_token(first, '|', type::pipe, type::pipe_pipe);    break;
+    case '<':
+      if (m_pos != m_end && *m_pos == '=')
+        pair_token(first, '=', type::less, type::less_equals);
+      else
+        pair_token(first, '<', type::less, type::lshift);
+      break;
+    case '>':
+      if (m_pos != m_end && *m_pos == '=')
+        pair_token(first, '=', type::greater, type::greater_equals);
+      else
+        pair_token(first, '>', type::greater, type::rshift);
+      break;
+
+    case '0': zero_token(first);   break;
+    case '"': string_token(first); break;
+
+    case '/':
+      // Comments run to the end of the line, leaving the newline itself
+      if (m_pos != m_end && *m_pos == '/')
+        m_pos = std::find(m_pos, m_end, '\n');
+      else
+        push(type::slash, first);
+      break;
+
+    default:
+      if (is_digit(*first))
+        number_token(first);
+      else if (is_namechar(*first))
+        name_token(first);
+      else if (!is_space(*first))
+        push(type::invalid, first);
+    }
   }
-}
 
-// }}}
+  // The last line gets a newline even if it doesn't end in one
+  if (m_line_start != m_end) {
+    push(type::newline, m_end);
+    m_tokens.back().str = "\n";
+  }
+  return move(m_tokens);
+}
 
 }
-#include <iostream>
 
-std::vector<std::string> parser::tokenize(std::istream& input)
+std::vector<token> parser::tokenize(boost::string_ref source)
 {
-  std::vector<std::string> tokens{};
-  std::string current_line;
-  while (input.peek() != EOF) {
-    getline(input, current_line);
-    boost::string_ref line{current_line};
-    line = ltrim(line); // remove leading whitespace from line
-    while (line.size()) {
-      auto res = first_token(line);
-      tokens.push_back(res.first);
-      line = res.second;
-    }
-    tokens.push_back("\n");
-  }
-  return tokens;
+  return tokenizer{source}.tokenize();
 }
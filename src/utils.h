@@ -70,16 +70,16 @@ inline bool isnamechar(char c)
 template <typename T>
 vector_ref<T> ltrim(vector_ref<T> vec, const T& item)
 {
-  auto last = find_if(begin(vec), end(vec),
-                      [&](const auto& i) { return i != item; });
-  return vec.subvec(static_cast<size_t>(last - begin(vec)));
+  auto last = std::find_if(vec.begin(), vec.end(),
+                           [&](const auto& i) { return i != item; });
+  return vec.subvec(static_cast<size_t>(last - vec.begin()));
 }
 
 template <typename T, typename F>
 vector_ref<T> ltrim_if(vector_ref<T> vec, const F& pred)
 {
-  auto last = find_if_not(begin(vec), end(vec), pred);
-  return vec.subvec(static_cast<size_t>(last - begin(vec)));
+  auto last = std::find_if_not(vec.begin(), vec.end(), pred);
+  return vec.subvec(static_cast<size_t>(last - vec.begin()));
 }
 
 // Expanded/smarter version of std::stoi
@@ -4,23 +4,55 @@
 #include "gc.h"
 #include "lang_utils.h"
 #include "ast/function_definition.h"
-#include "value/builtin_function.h"
-#include "value/function.h"
+#include "value/basic_function.h"
 
 using namespace vv;
 
 value::base::base(struct type* new_type)
-  : members  {},
-    type     {new_type},
-    m_marked {false}
+  : shape        {vv::shape::empty()},
+    member_slots {},
+    type         {new_type},
+    m_marked     {!marked_value},
+    m_shaded     {false}
 { }
 
 value::base::base()
-  : members  {},
-    type     {&builtin::type::object},
-    m_marked {false}
+  : shape        {vv::shape::empty()},
+    member_slots {},
+    type         {&builtin::type::object},
+    m_marked     {!marked_value},
+    m_shaded     {false}
 { }
 
+value::handle value::base::get_member(vv::symbol name) const
+{
+  auto slot = shape->find(name);
+  return slot == -1 ? handle{} : member_slots[static_cast<size_t>(slot)];
+}
+
+void value::base::set_member(vv::symbol name, handle val)
+{
+  gc::write_barrier(*this, val);
+  auto slot = shape->find(name);
+  if (slot == -1) {
+    shape = shape->add(name);
+    add_member_slot(val);
+  } else {
+    member_slots[static_cast<size_t>(slot)] = val;
+  }
+}
+
+void value::base::add_member_slot(handle val)
+{
+  if (member_slots.size() != member_slots.capacity()) {
+    member_slots.push_back(val);
+    return;
+  }
+  auto old_size = owned_size();
+  member_slots.push_back(val);
+  gc::resized(*this, old_size);
+}
+
 size_t value::base::hash() const
 {
   const static std::hash<const void*> hasher{};
@@ -32,18 +64,24 @@ bool value::base::equals(const value::base& other) const
   return this == &other;
 }
 
+size_t value::base::owned_size() const
+{
+  return member_slots.capacity() * sizeof(handle);
+}
+
+bool value::base::marked_value{true};
+
 void value::base::mark()
 {
-  m_marked = true;
-  if (type && !type->marked())
-    type->mark();
-  for (auto& i : members)
-    if (!i.second->marked())
-      i.second->mark();
+  m_marked = marked_value;
+  if (type)
+    gc::mark(*type);
+  for (auto i : member_slots)
+    gc::mark(i);
 }
 
 value::type::type(
-    const std::function<value::base*()>& new_constructor,
+    const std::function<handle()>& new_constructor,
     const std::unordered_map<vv::symbol, value::base*>& new_methods,
     value::base& new_parent,
     vv::symbol new_name)
@@ -53,53 +91,87 @@ value::type::type(
     parent      {new_parent},
     name        {new_name}
 {
+  vm::function_t shim{};
   if (auto init = find_method(this, {"init"})) {
-    // TODO: make function and builtin_function both inherit from a
-    // basic_function class, so I can quit it with all these dynamic_casts.
-    if (auto fn = dynamic_cast<builtin_function*>(init))
-      init_shim.argc = fn->argc;
-    else
-      init_shim.argc = static_cast<function*>(init)->argc;
-
-    for (auto i = 0; i != init_shim.argc; ++i) {
-      init_shim.body.emplace_back(vm::instruction::arg, i);
-      init_shim.body.emplace_back(vm::instruction::push);
+    shim.argc = static_cast<basic_function*>(init)->argc;
+
+    for (auto i = 0; i != shim.argc; ++i) {
+      shim.body.emplace_back(vm::instruction::arg, i);
+      shim.body.emplace_back(vm::instruction::push);
     }
 
-    init_shim.body.emplace_back( vm::instruction::self );
-    init_shim.body.emplace_back( vm::instruction::readm, vv::symbol{"init"} );
-    init_shim.body.emplace_back( vm::instruction::call, init_shim.argc );
-    init_shim.body.emplace_back( vm::instruction::self );
-    init_shim.body.emplace_back( vm::instruction::ret );
+    shim.body.emplace_back( vm::instruction::self );
+    auto init_cache = shim.constants.add(vm::member_cache{vv::symbol{"init"}});
+    shim.body.emplace_back( vm::instruction::readm, init_cache );
+    shim.body.emplace_back( vm::instruction::call, shim.argc );
+    shim.body.emplace_back( vm::instruction::self );
+    shim.body.emplace_back( vm::instruction::ret );
 
   } else {
-    init_shim.argc = 0;
-    init_shim.body = {
+    shim.body = {
       { vm::instruction::self },
       { vm::instruction::ret }
     };
   }
+  init_shim = std::make_shared<const vm::function_t>(std::move(shim));
 }
 
+value::type::~type()
+{
+  ++generation;
+}
+
+size_t value::type::generation{0};
+
 std::string value::type::value() const { return to_string(name); }
 
 void value::type::mark()
 {
   base::mark();
   for (const auto& i : methods)
-    if (!i.second->marked())
-      i.second->mark();
-  if (!parent.marked())
-    parent.mark();
+    gc::mark(*i.second);
+  gc::mark(parent);
+}
+
+value::type* value::handle::immediate_type() const
+{
+  if (is_int())
+    return &builtin::type::integer;
+  if (is_bool())
+    return &builtin::type::boolean;
+  if (is_nil())
+    return &builtin::type::nil;
+  return &builtin::type::floating_point;
+}
+
+std::string value::handle::value() const
+{
+  if (is_ptr())
+    return get()->value();
+  if (is_int())
+    return std::to_string(as_int());
+  if (is_bool())
+    return as_bool() ? "true" : "false";
+  if (is_nil())
+    return "nil";
+  return std::to_string(as_float());
 }
 
-size_t std::hash<vv::value::base*>::operator()(const vv::value::base* b) const
+size_t value::handle::hash() const
 {
-  return b->hash();
+  if (is_ptr())
+    return get()->hash();
+  // Floats are hashed by value, so 0.0 and -0.0 end up in the same bucket
+  if (is_float())
+    return std::hash<double>{}(as_float());
+  return std::hash<uint64_t>{}(m_bits);
 }
 
-bool std::equal_to<vv::value::base*>::operator()(const vv::value::base* left,
-                                                 const vv::value::base* right) const
+bool value::handle::equals(handle other) const
 {
-  return left->equals(*right);
+  if (is_ptr() && other.is_ptr())
+    return get()->equals(*other);
+  if (is_float() && other.is_float())
+    return as_float() == other.as_float();
+  return m_bits == other.m_bits;
 }
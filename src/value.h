@@ -1,9 +1,15 @@
 #ifndef VV_VALUE_H
 #define VV_VALUE_H
 
+#include "shape.h"
 #include "symbol.h"
 #include "vm/instruction.h"
 
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
 #include <unordered_map>
 #include <vector>
 
@@ -22,22 +28,101 @@ namespace value {
 
 struct array;
 struct array_iterator;
-struct boolean;
+struct base;
 struct builtin_function;
 struct dictionary;
 struct file;
-struct floating_point;
 struct function;
-struct integer;
 struct iterator;
-struct nil;
 struct range;
 struct string;
 struct string_iterator;
 struct symbol;
 struct type;
 
-struct base {
+// A Vivaldi value. Integers, Floats, Bools and nil are stored directly in the
+// handle, so arithmetic and comparisons never have to allocate anything;
+// everything else is a pointer to a GC-managed value::base.
+//
+// Handles are NaN-boxed, in 64 bits regardless of platform:
+//   0x0000'0000'0000'0000         null (i.e. no value at all; an unset variable)
+//   0x0000'0000'0000'0002         nil
+//   0x0000'0000'0000'000[45]      false, true
+//   0x0000'xxxx'xxxx'xxx[08]      pointer (always 8-byte aligned)
+//   0xffff'0000'xxxx'xxxx         Integer
+//   anything else                 Float, offset by 2^48
+// The offset moves every double (NaNs included, once they've been made
+// canonical) out of the ranges used by the other kinds.
+class handle {
+public:
+  // Null
+  handle() : m_bits{0} { }
+  handle(base* ptr)
+    : m_bits{static_cast<uint64_t>(reinterpret_cast<uintptr_t>(ptr))}
+  {
+    // Anything else would be taken for an immediate; see value::base
+    assert(!(m_bits & 0x7));
+  }
+
+  explicit handle(int val)
+    : m_bits{int_tag | static_cast<uint32_t>(val)}
+  { }
+  explicit handle(double val);
+  explicit handle(bool val) : m_bits{val ? true_bits : false_bits} { }
+
+  static handle nil() { return handle{nil_bits, raw_bits{}}; }
+
+  explicit operator bool() const { return m_bits != 0; }
+
+  bool is_ptr() const { return !(m_bits & (tag_mask | 0x7)); }
+  bool is_int() const { return (m_bits & tag_mask) == int_tag; }
+  bool is_float() const { return !is_int() && (m_bits & tag_mask) != 0; }
+  bool is_bool() const { return (m_bits & ~1ull) == false_bits; }
+  bool is_nil() const { return m_bits == nil_bits; }
+
+  int as_int() const { return static_cast<int>(static_cast<uint32_t>(m_bits)); }
+  double as_float() const;
+  bool as_bool() const { return m_bits == true_bits; }
+
+  // The value pointed to, or nullptr if this isn't a pointer
+  base* get() const
+  {
+    return is_ptr() ? reinterpret_cast<base*>(static_cast<uintptr_t>(m_bits))
+                    : nullptr;
+  }
+  base& operator*() const { return *get(); }
+
+  // Counterparts to the members of value::base, for any kind of value
+  value::type* type() const;
+  const vv::shape* shape() const;
+  std::string value() const;
+  size_t hash() const;
+  bool equals(handle other) const;
+
+  // Immediates have nothing to mark, and so always count as marked (as does
+  // null)
+  bool marked() const;
+
+private:
+  struct raw_bits { };
+  handle(uint64_t bits, raw_bits) : m_bits{bits} { }
+
+  value::type* immediate_type() const;
+
+  static const uint64_t tag_mask{0xffff000000000000};
+  static const uint64_t int_tag{0xffff000000000000};
+  static const uint64_t float_offset{0x0001000000000000};
+  static const uint64_t nil_bits{0x2};
+  static const uint64_t false_bits{0x4};
+  static const uint64_t true_bits{0x5};
+
+  uint64_t m_bits;
+};
+
+// Aligned to 8 bytes even where pointers are only 4, since that's how a handle
+// tells pointers from immediates. Values from the GC's pages would be anyway,
+// but statically allocated ones (builtin types and functions) wouldn't be
+struct alignas(8) base {
   base(type* type);
   base();
 
@@ -46,28 +131,59 @@ struct base {
 
   virtual ~base() { }
 
-  std::unordered_map<vv::symbol, value::base*> members;
+  // Returns the member called name set directly on this object, or nullptr if
+  // there isn't one
+  handle get_member(vv::symbol name) const;
+  void set_member(vv::symbol name, handle val);
+  // Appends the slot for a member just added to shape, counting any growth
+  // towards the heap (see gc::resized)
+  void add_member_slot(handle val);
+
+  // Members set directly on this object, stored in the slots given by shape
+  const vv::shape* shape;
+  std::vector<handle> member_slots;
   type* type;
 
   virtual size_t hash() const;
   virtual bool equals(const value::base& other) const;
 
+  // Roughly how many bytes have been allocated for this value's contents,
+  // outside of the value itself (e.g. an Array's elements); the GC counts them
+  // towards the size of the heap
+  virtual size_t owned_size() const;
+
+  // Marks this value, and pushes everything it points to onto the GC's mark
+  // stack (see gc::mark) rather than marking them directly, so arbitrarily
+  // deep structures can be marked without recursing
   virtual void mark();
-  bool marked() const { return m_marked; }
-  void unmark() { m_marked = false; }
+  bool marked() const { return m_marked == marked_value; }
+  void unmark() { m_marked = !marked_value; }
+
+  // What a value's mark bit is set to when it's marked; the GC flips it at the
+  // start of every major collection, unmarking everything at once
+  static bool marked_value;
+
+  // Whether this has been shaded gray by a write barrier, and is waiting on the
+  // mark stack to be marked (see gc::internal::shade)
+  bool shaded() const { return m_shaded; }
+  void set_shaded(bool shaded) { m_shaded = shaded; }
 
 private:
   bool m_marked;
+  bool m_shaded;
 };
 
 struct type : public base {
-  type(const std::function<value::base*()>& constructor,
+  type(const std::function<handle()>& constructor,
        const std::unordered_map<vv::symbol, value::base*>& methods,
        value::base& parent,
        vv::symbol name);
+  ~type();
 
+  // Never changed after construction, since member caches (see
+  // vm::member_cache) assume method lookups always return the same thing
   std::unordered_map<vv::symbol, value::base*> methods;
-  std::function<value::base*()> constructor;
+  std::function<handle()> constructor;
   // This shim is necessary because, of course, when you create a new object you
   // want to get that object back. Unfortunately it's not possible to guarantee
   // this in the init function, since someone could do something like
@@ -81,7 +197,7 @@ struct type : public base {
   //     self
   //   end
   // and the constructor calls that fake init function instead of 'init'
-  vm::function_t init_shim;
+  vm::function_ptr init_shim;
 
   value::base& parent;
   // Stored in class so value() can be prettier than just <type>
@@ -90,20 +206,60 @@ struct type : public base {
   std::string value() const override;
 
   void mark() override;
+
+  // Incremented every time a type is destroyed, so member caches know when any
+  // type pointers they hold might have been reused
+  static size_t generation;
 };
 
+inline value::handle::handle(double val)
+{
+  // NaNs can have any payload, so they're all made the same (bar the sign) to
+  // keep them from landing on a tag
+  if (val != val)
+    val = std::copysign(std::numeric_limits<double>::quiet_NaN(), val);
+  std::memcpy(&m_bits, &val, sizeof val);
+  m_bits += float_offset;
+}
+
+inline double value::handle::as_float() const
+{
+  auto bits = m_bits - float_offset;
+  double val;
+  std::memcpy(&val, &bits, sizeof val);
+  return val;
+}
+
+inline value::type* value::handle::type() const
+{
+  return is_ptr() ? get()->type : immediate_type();
+}
+
+inline const vv::shape* value::handle::shape() const
+{
+  return is_ptr() ? get()->shape : vv::shape::empty();
+}
+
+inline bool value::handle::marked() const
+{
+  return !is_ptr() || !m_bits || get()->marked();
+}
+
 }
 
 }
 
 template <>
-struct std::hash<vv::value::base*> {
-  size_t operator()(const vv::value::base* b) const;
+struct std::hash<vv::value::handle> {
+  size_t operator()(vv::value::handle h) const { return h.hash(); }
 };
 
 template <>
-struct std::equal_to<vv::value::base*> {
-  bool operator()(const vv::value::base* left, const vv::value::base* right) const;
+struct std::equal_to<vv::value::handle> {
+  bool operator()(vv::value::handle left, vv::value::handle right) const
+  {
+    return left.equals(right);
+  }
 };
 
 #endif
@@ -5,7 +5,7 @@
 
 using namespace vv;
 
-value::array::array(const std::vector<base*>& new_val)
+value::array::array(const std::vector<handle>& new_val)
   : base {&builtin::type::array},
     val {new_val}
 { }
@@ -15,17 +15,20 @@ std::string value::array::value() const
   std::string str{'['};
   if (val.size()) {
     for_each(begin(val), end(val) - 1,
-             [&](const auto& v) { str += v->value() += ", "; });
-    str += val.back()->value();
+             [&](const auto& v) { str += v.value() += ", "; });
+    str += val.back().value();
   }
   str += ']';
   return str;
 }
 
+size_t value::array::owned_size() const
+{
+  return base::owned_size() + val.capacity() * sizeof(handle);
+}
+
 void value::array::mark()
 {
   base::mark();
-  for (auto* i : val)
-    if (!i->marked())
-      i->mark();
+  gc::mark_elements(*this);
 }
@@ -10,12 +10,13 @@ namespace value {
 
 struct array : public base {
 public:
-  array(const std::vector<base*>& mems = {});
+  array(const std::vector<handle>& mems = {});
 
   std::string value() const override;
+  size_t owned_size() const override;
   void mark() override;
 
-  std::vector<base*> val;
+  std::vector<handle> val;
 };
 
 }
@@ -1,6 +1,7 @@
 #include "array_iterator.h"
 
 #include "builtins.h"
+#include "gc.h"
 #include "value/array.h"
 
 using namespace vv;
@@ -16,6 +17,5 @@ std::string value::array_iterator::value() const { return "<array iterator>"; }
 void value::array_iterator::mark()
 {
   base::mark();
-  if (!arr.marked())
-    arr.mark();
+  gc::mark(arr);
 }
@@ -0,0 +1,11 @@
+#include "basic_function.h"
+
+#include "builtins.h"
+
+using namespace vv;
+
+value::basic_function::basic_function(func_type type, int new_argc)
+  : base    {&builtin::type::function},
+    fn_type {type},
+    argc    {new_argc}
+{ }
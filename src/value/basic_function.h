@@ -0,0 +1,29 @@
+#ifndef VV_VALUE_BASIC_FUNCTION_H
+#define VV_VALUE_BASIC_FUNCTION_H
+
+#include "value.h"
+
+namespace vv {
+
+namespace value {
+
+// Common base of function and builtin_function. Every Function is one or the
+// other, so the VM can tell which kind it's calling from the tag here instead
+// of trying dynamic_casts.
+struct basic_function : public base {
+  enum class func_type {
+    vivaldi,
+    builtin
+  };
+
+  basic_function(func_type type, int argc);
+
+  func_type fn_type;
+  int argc;
+};
+
+}
+
+}
+
+#endif
@@ -5,12 +5,10 @@
 
 using namespace vv;
 
-value::builtin_function::builtin_function(
-    const std::function<base*(vm::machine&)>& new_body,
-    int new_argc)
-  : base {&builtin::type::function},
-    body {new_body},
-    argc {new_argc}
+value::builtin_function::builtin_function(const body_type& new_body,
+                                          int new_argc)
+  : basic_function {func_type::builtin, new_argc},
+    body           {new_body}
 { }
 
 std::string value::builtin_function::value() const
@@ -1,21 +1,60 @@
 #ifndef VV_VALUE_BUILTIN_FUNCTION_H
 #define VV_VALUE_BUILTIN_FUNCTION_H
 
-#include "value.h"
+#include "value/basic_function.h"
 #include "vm.h"
 
+#include <cassert>
+
 namespace vv {
 
 namespace value {
 
-struct builtin_function : public base {
+// Arguments to a builtin. They're left where the caller pushed them on the VM's
+// stack, and read from there by index rather than through a pointer, so they
+// stay valid when a builtin calls back into the VM: anything that pushes goes
+// above them, even if the stack has to be reallocated to make room. Self's
+// pushed just above them, so it stays reachable even once calling back into
+// the VM has replaced the calling frame's pushed_self; anything else a builtin
+// allocates or reads before calling back into the VM has to be kept on the
+// stack to survive.
+class arg_span {
+public:
+  arg_span(const std::vector<handle>& stack, size_t first, size_t size)
+    : m_stack {&stack},
+      m_first {first},
+      m_size  {size}
+  { }
+
+  size_t size() const { return m_size; }
+
+  handle operator[](int idx) const
+  {
+    // Self's still above them unless an exception thrown by something the
+    // builtin called has unwound the stack (to a handler in the builtin's
+    // caller, or further), after which the builtin has to return without
+    // reading them again
+    assert(m_first + m_size < m_stack->size());
+    return (*m_stack)[m_first + static_cast<size_t>(idx)];
+  }
+
+private:
+  const std::vector<handle>* m_stack;
+  size_t m_first;
+  size_t m_size;
+};
+
+// Functions implemented in C++. They're called directly, with self (or null,
+// outside of method calls) and their arguments, and don't get a call frame.
+struct builtin_function : public basic_function {
 public:
-  builtin_function(const std::function<base*(vm::machine&)>& body, int argc);
+  using body_type = std::function<handle(vm::machine&, handle, arg_span)>;
+
+  builtin_function(const body_type& body, int argc);
 
   std::string value() const override;
 
-  std::function<base*(vm::machine&)> body;
-  int argc;
+  body_type body;
 };
 
 }
@@ -1,10 +1,11 @@
 #include "dictionary.h"
 
 #include "builtins.h"
+#include "gc.h"
 
 using namespace vv;
 
-value::dictionary::dictionary(const std::unordered_map<base*, base*>& mems)
+value::dictionary::dictionary(const std::unordered_map<handle, handle>& mems)
   : base {&builtin::type::dictionary},
     val  {mems}
 { }
@@ -13,19 +14,27 @@ std::string value::dictionary::value() const
 {
   std::string str{"{"};
   for (const auto& pair: val)
-    str += ' ' + pair.first->value() += ": " + pair.second->value() += ',';
+    str += ' ' + pair.first.value() += ": " + pair.second.value() += ',';
   if (val.size())
     str.back() = ' ';
   return str += '}';
 }
 
+size_t value::dictionary::owned_size() const
+{
+  // Every entry's in a node of its own, along with a pointer to the next one
+  // and its hash
+  const auto node_size = sizeof(std::pair<const handle, handle>)
+                       + sizeof(void*) + sizeof(size_t);
+  return base::owned_size() + val.size() * node_size
+                            + val.bucket_count() * sizeof(void*);
+}
+
 void value::dictionary::mark()
 {
   base::mark();
   for (auto& pair : val) {
-    if (!pair.first->marked())
-      pair.first->mark();
-    if (!pair.second->marked())
-      pair.second->mark();
+    gc::mark(pair.first);
+    gc::mark(pair.second);
   }
 }
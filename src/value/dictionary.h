@@ -9,12 +9,13 @@ namespace value {
 
 struct dictionary : public base {
 public:
-  dictionary(const std::unordered_map<base*, base*>& mems = {});
+  dictionary(const std::unordered_map<handle, handle>& mems = {});
 
   std::string value() const override;
+  size_t owned_size() const override;
   void mark() override;
 
-  std::unordered_map<base*, base*> val;
+  std::unordered_map<handle, handle> val;
 };
 
 }
@@ -6,13 +6,22 @@
 
 using namespace vv;
 
-value::function::function(int new_argc,
-                          const std::vector<vm::command>& new_body,
+value::function::function(vm::function_ptr new_definition,
                           std::shared_ptr<vm::call_frame> new_enclosure)
-  : base      {&builtin::type::function},
-    argc      {new_argc},
-    body      {new_body},
-    enclosure {new_enclosure}
+  : basic_function {func_type::vivaldi, new_definition->argc},
+    definition     {move(new_definition)},
+    enclosure      {new_enclosure}
 { }
 
 std::string value::function::value() const { return "<function>"; }
+
+void value::function::mark()
+{
+  basic_function::mark();
+  gc::mark(self);
+  for (const auto& i : upvalues)
+    gc::mark(*i);
+  // Functions defined in a required file are all that keep its top-level
+  // variables alive once it's finished running
+  vm::mark(*enclosure);
+}
@@ -1,7 +1,7 @@
 #ifndef VV_VALUE_FUNCTION_H
 #define VV_VALUE_FUNCTION_H
 
-#include "value.h"
+#include "value/basic_function.h"
 #include "utils.h"
 #include "vm/call_frame.h"
 #include "vm/instruction.h"
@@ -10,16 +10,23 @@ namespace vv {
 
 namespace value {
 
-struct function : public base {
-  function(int argc,
-           const std::vector<vm::command>& body,
+struct function : public basic_function {
+  function(vm::function_ptr definition,
            std::shared_ptr<vm::call_frame> enclosure);
 
   std::string value() const override;
+  void mark() override;
 
-  int argc;
-  std::vector<vm::command> body;
+  // Shared with every other closure created from the same definition
+  vm::function_ptr definition;
+  // Top-level frame the function was defined in, for reading globals
   std::shared_ptr<vm::call_frame> enclosure;
+  // Variables captured from enclosing functions, in the order given by
+  // definition->captures
+  std::vector<vm::cell> upvalues;
+  // self in the frame the function was defined in, if any (e.g. for closures
+  // created inside methods)
+  value::handle self;
 };
 
 }
@@ -1,31 +1,30 @@
 #include "range.h"
 
 #include "builtins.h"
+#include "gc.h"
 
 using namespace vv;
 
-value::range::range(value::base& new_start, value::base& new_end)
+value::range::range(handle new_start, handle new_end)
   : base  {&builtin::type::range},
-    start {&new_start},
-    end   {&new_end}
+    start {new_start},
+    end   {new_end}
 { }
 
 value::range::range()
   : base  {&builtin::type::range},
-    start {nullptr},
-    end   {nullptr}
+    start {},
+    end   {}
 { }
 
 std::string value::range::value() const
 {
-  return start->value() + " to " + end->value();
+  return start.value() + " to " + end.value();
 }
 
 void value::range::mark()
 {
   base::mark();
-  if (!start->marked())
-    start->mark();
-  if (!end->marked())
-    end->mark();
+  gc::mark(start);
+  gc::mark(end);
 }
@@ -8,12 +8,12 @@ namespace vv {
 namespace value {
 
 struct range : public base {
-  range(value::base& start, value::base& end);
+  range(handle start, handle end);
   range();
   std::string value() const override;
 
-  value::base* start;
-  value::base* end;
+  handle start;
+  handle end;
 
   void mark() override;
 };
@@ -24,3 +24,8 @@ bool value::string::equals(const base& other) const
     return false;
   return static_cast<const string&>(other).val == val;
 }
+
+size_t value::string::owned_size() const
+{
+  return base::owned_size() + val.capacity();
+}
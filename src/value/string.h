@@ -16,6 +16,7 @@ public:
   std::string value() const override;
   size_t hash() const override;
   bool equals(const base& other) const override;
+  size_t owned_size() const override;
 
   std::string val;
 };
@@ -1,6 +1,7 @@
 #include "string_iterator.h"
 
 #include "builtins.h"
+#include "gc.h"
 #include "value/string.h"
 
 using namespace vv;
@@ -19,6 +20,5 @@ std::string value::string_iterator::value() const
 void value::string_iterator::mark()
 {
   base::mark();
-  if (!str.marked())
-    str.mark();
+  gc::mark(str);
 }
@@ -8,74 +8,427 @@
 #include "value.h"
 #include "value/array.h"
 #include "value/builtin_function.h"
-#include "value/boolean.h"
 #include "value/dictionary.h"
-#include "value/integer.h"
-#include "value/floating_point.h"
 #include "value/function.h"
-#include "value/nil.h"
+#include "value/range.h"
 #include "value/string.h"
 #include "value/symbol.h"
 
-#include <boost/variant/get.hpp>
+#include <functional>
 
 using namespace vv;
 
-vm::machine::machine(std::shared_ptr<call_frame> frame,
+vm::opcode_profile vm::g_opcode_profile{};
+
+namespace {
+
+// Target of the instruction pointer once there's nothing left to run (e.g.
+// after an uncaught exception)
+const vm::command halt_command{vm::instruction::halt};
+
+// Value of m_nested_depth outside of any call_method
+const size_t not_nested{static_cast<size_t>(-1)};
+
+// Thrown by except when an exception isn't caught inside a function run by
+// call_method, to get back out of the dispatch loop running it; it's then
+// thrown again, as an ordinary exception, from the builtin's caller
+struct escaped_call {};
+
+void record_pair(vm::instruction first, vm::instruction second)
+{
+  // Nothing runs after a halt, so it doubles as the instruction before the
+  // first one
+  if (first != vm::instruction::halt) {
+    auto& count = vm::g_opcode_profile.pairs[static_cast<size_t>(first)]
+                                            [static_cast<size_t>(second)];
+    ++count;
+  }
+}
+
+#ifdef VV_THREADED_DISPATCH
+// A dispatch table sending every instruction to the same handler
+template <size_t N>
+std::array<const void*, N> filled_table(const void* handler)
+{
+  std::array<const void*, N> table;
+  table.fill(handler);
+  return table;
+}
+#endif
+
+bool is_number(value::handle val)
+{
+  return val.is_int() || val.is_float();
+}
+
+double to_double(value::handle val)
+{
+  return val.is_int() ? val.as_int() : val.as_float();
+}
+
+// Whether iter_init and iter_next can iterate over iterable themselves, rather
+// than calling its methods
+bool iterates_directly(value::handle iterable)
+{
+  // Members set on the object itself might override its methods
+  if (iterable.shape() != shape::empty())
+    return false;
+
+  auto type = iterable.type();
+  if (type == &builtin::type::range) {
+    const auto& rng = static_cast<value::range&>(*iterable);
+    return rng.start.is_int() && rng.end.is_int();
+  }
+  return type == &builtin::type::array || type == &builtin::type::string;
+}
+
+// Kind of operands, for type feedback on arithmetic and comparisons
+unsigned char operand_kind(value::handle left, value::handle right)
+{
+  if (left.is_int() && right.is_int())
+    return vm::feedback::ints;
+  if (left.is_float() && right.is_float())
+    return vm::feedback::floats;
+  return vm::feedback::other;
+}
+
+// Kind of callee, for type feedback on calls
+unsigned char callee_kind(value::handle callee)
+{
+  if (callee.type() != &builtin::type::function)
+    return vm::feedback::other;
+  auto type = static_cast<value::basic_function&>(*callee).fn_type;
+  return type == value::basic_function::func_type::builtin
+       ? vm::feedback::builtin
+       : vm::feedback::function;
+}
+
+// self as seen by code running in frame--- either passed in directly for a
+// method call, or captured by the closure being run
+value::handle current_self(const vm::call_frame& frame)
+{
+  if (frame.self || !frame.caller)
+    return frame.self;
+  return static_cast<value::function&>(*frame.caller).self;
+}
+
+// The innermost try...catch block frame's currently inside, if any. By the
+// time anything's thrown, instr_ptr's already moved past the instruction
+// throwing it (or, in frames further up, past the call that's still running)
+const vm::handler* find_handler(const vm::call_frame& frame)
+{
+  if (!frame.code || frame.code->handlers.empty())
+    return nullptr;
+  auto pc = frame.instr_ptr - frame.code->body.data() - 1;
+  for (const auto& i : frame.code->handlers) {
+    if (i.start <= pc && pc < i.end)
+      return &i;
+  }
+  return nullptr;
+}
+
+}
+
+vm::machine::machine(std::shared_ptr<call_frame> base,
                      const std::function<void(vm::machine&)>& exception_handler)
-  : frame               {frame},
-    retval              {nullptr},
-    m_base              {frame},
+  : frame               {base.get()},
+    retval              {},
+    m_base              {base},
+    m_depth             {0},
+    m_nested_depth      {not_nested},
+    m_stack_size        {0},
+    m_exceptions        {0},
     m_exception_handler {exception_handler}
 {
-  gc::set_current_frame(frame);
-  gc::set_current_retval(retval);
+  gc::add_root(*this);
+  // Variables declared in top-level blocks live in slots too (see
+  // ast::resolver)
+  if (frame->code)
+    make_locals(*frame->code);
+}
+
+vm::machine::~machine()
+{
+  gc::stack_resized(m_stack_size, 0);
+  gc::remove_root(*this);
 }
 
 void vm::machine::run()
 {
-  using boost::get;
-
-  while (frame->instr_ptr.size()) {
-    // Get next instruction (and argument, if it exists), and increment the
-    // instruction pointer
-    auto instr = frame->instr_ptr.front().instr;
-    const auto& arg = frame->instr_ptr.front().arg;
-    frame->instr_ptr = frame->instr_ptr.subvec(1);
-
-    // HACK--- avoid weirdness like the following:
-    //   let i = 1
-    //   let add = i.add // pushed_self is now i
-    //   add(2)          // => 3
-    //   5 + 1           // pushed self is now 5
-    //   add(2)          // => 7
-    if (instr != instruction::call)
+  // Running out of memory is the one thing thrown as a C++ exception, since it
+  // can happen wherever anything's allocated; it's caught here and thrown
+  // again as an ordinary exception, and execution carries on from wherever
+  // that's caught (or halts, if it isn't)
+  for (;;) {
+    try {
+      dispatch();
+      return;
+    } catch (const gc::out_of_memory&) {
+      retval = gc::out_of_memory_error();
+      except();
+      // If it was the stack that ran out (e.g. from unbounded recursion), the
+      // frames and stack space left over would otherwise stay counted
+      m_frames.resize(m_depth);
+      stack.shrink_to_fit();
+      account_stack(m_depth);
+    }
+  }
+}
+
+void vm::machine::dispatch()
+{
+  // HACK--- pushed_self is cleared before every instruction but call, to avoid
+  // weirdness like the following:
+  //   let i = 1
+  //   let add = i.add // pushed_self is now i
+  //   add(2)          // => 3
+  //   5 + 1           // pushed self is now 5
+  //   add(2)          // => 7
+
+#ifdef VV_THREADED_DISPATCH
+
+  // Direct-threaded dispatch: rather than looping back to a single switch,
+  // every instruction ends by jumping straight to the handler for the next one.
+  // Besides saving the bounds check and the trip around the loop, this gives
+  // the branch predictor one indirect jump per instruction to learn from,
+  // instead of one for the entire VM.
+  //
+  // Must be kept in the same order as vm::instruction.
+  static const void* const dispatch_table[] = {
+    &&op_push_bool, &&op_push_flt,  &&op_push_fn,  &&op_push_int,
+    &&op_push_nil,  &&op_push_str,  &&op_push_sym, &&op_push_type,
+
+    &&op_make_arr,  &&op_make_dict,
+
+    &&op_read,      &&op_write,     &&op_let,
+
+    &&op_load_local,   &&op_store_local,   &&op_load_cell, &&op_store_cell,
+    &&op_make_cell,    &&op_load_upvalue,  &&op_store_upvalue,
+
+    &&op_self,      &&op_push_arg,  &&op_arg,      &&op_readm,
+    &&op_writem,    &&op_call,      &&op_tail_call, &&op_new_obj,
+
+    &&op_eblk,      &&op_lblk,      &&op_ret,
+
+    &&op_push,      &&op_pop,
+
+    &&op_req,
+
+    &&op_jmp,       &&op_jmp_false, &&op_jmp_true,
+    &&op_iter_init, &&op_iter_next,
+    &&op_try_begin, &&op_try_end, &&op_except,
+
+    &&op_add, &&op_sub, &&op_mul, &&op_div, &&op_mod,
+    &&op_eq,  &&op_neq, &&op_lt,  &&op_gt,  &&op_le,  &&op_ge,
+
+    &&op_readm_call, &&op_push_int_arg, &&op_load_local_arg,
+
+    &&op_call_function, &&op_call_builtin,
+    &&op_add_int, &&op_sub_int, &&op_mul_int, &&op_eq_int,
+    &&op_lt_int,  &&op_gt_int,  &&op_le_int,  &&op_ge_int,
+    &&op_add_flt, &&op_sub_flt, &&op_mul_flt, &&op_eq_flt,
+    &&op_lt_flt,  &&op_gt_flt,  &&op_le_flt,  &&op_ge_flt,
+
+    &&op_halt
+  };
+  static_assert(sizeof dispatch_table / sizeof *dispatch_table
+                  == opcode_profile::size,
+                "dispatch table out of sync with vm::instruction");
+
+  // When profiling, every instruction is sent through op_profile on its way to
+  // its actual handler, so normal dispatch doesn't pay for the check
+  static const auto profile_table
+    = filled_table<opcode_profile::size>(&&op_profile);
+  const auto table = g_opcode_profile.enabled ? profile_table.data()
+                                              : dispatch_table;
+  auto prev = instruction::halt;
+
+  const command* cmd;
+
+#define VV_DISPATCH()                                                         \
+  do {                                                                        \
+    cmd = frame->instr_ptr++;                                                 \
+    goto *table[static_cast<size_t>(cmd->instr)];                             \
+  } while (false)
+
+#define VV_CONSTANT(kind)                                                     \
+  frame->code->constants.kind[static_cast<size_t>(cmd->as_int)]
+
+#define VV_OP(name, ...)                                                      \
+  op_ ## name:                                                                \
+    frame->pushed_self = {};                                                  \
+    name(__VA_ARGS__);                                                        \
+    VV_DISPATCH()
+
+  VV_DISPATCH();
+
+op_profile:
+  record_pair(prev, cmd->instr);
+  prev = cmd->instr;
+  goto *dispatch_table[static_cast<size_t>(cmd->instr)];
+
+  VV_OP(push_bool, cmd->as_bool);
+  VV_OP(push_flt,  VV_CONSTANT(floats));
+  VV_OP(push_fn,   VV_CONSTANT(functions));
+  VV_OP(push_int,  cmd->as_int);
+  VV_OP(push_nil);
+  VV_OP(push_str,  VV_CONSTANT(strings));
+  VV_OP(push_sym,  cmd->as_sym);
+  VV_OP(push_type, VV_CONSTANT(types));
+
+  VV_OP(make_arr,  cmd->as_int);
+  VV_OP(make_dict, cmd->as_int);
+
+  VV_OP(read,  cmd->as_sym);
+  VV_OP(write, cmd->as_sym);
+  VV_OP(let,   cmd->as_sym);
+
+  VV_OP(load_local,    cmd->as_int);
+  VV_OP(store_local,   cmd->as_int);
+  VV_OP(load_cell,     cmd->as_int);
+  VV_OP(store_cell,    cmd->as_int);
+  VV_OP(make_cell,     cmd->as_int);
+  VV_OP(load_upvalue,  cmd->as_int);
+  VV_OP(store_upvalue, cmd->as_int);
+
+  VV_OP(self);
+  VV_OP(push_arg);
+  VV_OP(arg,    cmd->as_int);
+  VV_OP(readm,  VV_CONSTANT(member_caches));
+  VV_OP(writem, VV_CONSTANT(member_write_caches));
+op_call:
+  observe(*cmd, callee_kind(retval));
+  call(cmd->as_int);
+  VV_DISPATCH();
+op_tail_call:
+  tail_call(cmd->as_int);
+  VV_DISPATCH();
+  VV_OP(new_obj, cmd->as_int);
+
+  VV_OP(eblk);
+  VV_OP(lblk);
+  VV_OP(ret);
+
+  VV_OP(push);
+  VV_OP(pop);
+
+  VV_OP(req, VV_CONSTANT(strings));
+
+  VV_OP(jmp,       cmd->as_int);
+  VV_OP(jmp_false, cmd->as_int);
+  VV_OP(jmp_true,  cmd->as_int);
+  VV_OP(iter_init, cmd->as_int);
+  VV_OP(iter_next, cmd->as_int);
+
+  // Never actually reached, since vm::optimize strips them out
+op_try_begin:
+op_try_end:
+  VV_DISPATCH();
+  VV_OP(except);
+
+  VV_OP(add, VV_CONSTANT(member_caches));
+  VV_OP(sub, VV_CONSTANT(member_caches));
+  VV_OP(mul, VV_CONSTANT(member_caches));
+  VV_OP(div, VV_CONSTANT(member_caches));
+  VV_OP(mod, VV_CONSTANT(member_caches));
+  VV_OP(eq,  VV_CONSTANT(member_caches));
+  VV_OP(neq, VV_CONSTANT(member_caches));
+  VV_OP(lt,  VV_CONSTANT(member_caches));
+  VV_OP(gt,  VV_CONSTANT(member_caches));
+  VV_OP(le,  VV_CONSTANT(member_caches));
+  VV_OP(ge,  VV_CONSTANT(member_caches));
+
+  VV_OP(readm_call,     VV_CONSTANT(member_caches), frame->instr_ptr->as_int);
+  VV_OP(push_int_arg,   cmd->as_int);
+  VV_OP(load_local_arg, cmd->as_int);
+
+op_call_function:
+  call_function(cmd->as_int);
+  VV_DISPATCH();
+op_call_builtin:
+  call_builtin(cmd->as_int);
+  VV_DISPATCH();
+
+  VV_OP(add_int);
+  VV_OP(sub_int);
+  VV_OP(mul_int);
+  VV_OP(eq_int);
+  VV_OP(lt_int);
+  VV_OP(gt_int);
+  VV_OP(le_int);
+  VV_OP(ge_int);
+
+  VV_OP(add_flt);
+  VV_OP(sub_flt);
+  VV_OP(mul_flt);
+  VV_OP(eq_flt);
+  VV_OP(lt_flt);
+  VV_OP(gt_flt);
+  VV_OP(le_flt);
+  VV_OP(ge_flt);
+
+op_halt:
+  --frame->instr_ptr;
+  return;
+
+#undef VV_OP
+#undef VV_CONSTANT
+#undef VV_DISPATCH
+
+#else
+
+  // Portable fallback, for compilers without computed gotos
+  auto prev = instruction::halt;
+  for (;;) {
+    const auto& cmd = *frame->instr_ptr++;
+    const auto& consts = frame->code->constants;
+    const auto arg = static_cast<size_t>(cmd.as_int);
+
+    if (g_opcode_profile.enabled) {
+      record_pair(prev, cmd.instr);
+      prev = cmd.instr;
+    }
+
+    auto instr = generic(cmd.instr);
+    if (instr != instruction::call && instr != instruction::tail_call)
       frame->pushed_self = {};
 
-    switch (instr) {
-    case instruction::push_bool: push_bool(get<bool>(arg));       break;
-    case instruction::push_flt:  push_flt(get<double>(arg));      break;
-    case instruction::push_fn:   push_fn(get<function_t>(arg));   break;
-    case instruction::push_int:  push_int(get<int>(arg));         break;
-    case instruction::push_nil:  push_nil();                      break;
-    case instruction::push_str:  push_str(get<std::string>(arg)); break;
-    case instruction::push_sym:  push_sym(get<symbol>(arg));      break;
-    case instruction::push_type: push_type(get<type_t>(arg));     break;
-
-    case instruction::make_arr:  make_arr(get<int>(arg));  break;
-    case instruction::make_dict: make_dict(get<int>(arg)); break;
-
-    case instruction::read:  read(get<symbol>(arg));  break;
-    case instruction::write: write(get<symbol>(arg)); break;
-    case instruction::let:   let(get<symbol>(arg));   break;
-
-    case instruction::self:     self();                   break;
-    case instruction::push_arg: push_arg();               break;
-    case instruction::arg:      this->arg(get<int>(arg)); break;
-    case instruction::readm:    readm(get<symbol>(arg));  break;
-    case instruction::writem:   writem(get<symbol>(arg)); break;
-    case instruction::call:     call(get<int>(arg));      break;
-    case instruction::new_obj:  new_obj(get<int>(arg));   break;
+    switch (cmd.instr) {
+    case instruction::push_bool: push_bool(cmd.as_bool);               break;
+    case instruction::push_flt:  push_flt(consts.floats[arg]);         break;
+    case instruction::push_fn:   push_fn(consts.functions[arg]);       break;
+    case instruction::push_int:  push_int(cmd.as_int);                 break;
+    case instruction::push_nil:  push_nil();                           break;
+    case instruction::push_str:  push_str(consts.strings[arg]);        break;
+    case instruction::push_sym:  push_sym(cmd.as_sym);                 break;
+    case instruction::push_type: push_type(consts.types[arg]);         break;
+
+    case instruction::make_arr:  make_arr(cmd.as_int);  break;
+    case instruction::make_dict: make_dict(cmd.as_int); break;
+
+    case instruction::read:  read(cmd.as_sym);  break;
+    case instruction::write: write(cmd.as_sym); break;
+    case instruction::let:   let(cmd.as_sym);   break;
+
+    case instruction::load_local:    load_local(cmd.as_int);    break;
+    case instruction::store_local:   store_local(cmd.as_int);   break;
+    case instruction::load_cell:     load_cell(cmd.as_int);     break;
+    case instruction::store_cell:    store_cell(cmd.as_int);    break;
+    case instruction::make_cell:     make_cell(cmd.as_int);     break;
+    case instruction::load_upvalue:  load_upvalue(cmd.as_int);  break;
+    case instruction::store_upvalue: store_upvalue(cmd.as_int); break;
+
+    case instruction::self:     self();               break;
+    case instruction::push_arg: push_arg();           break;
+    case instruction::arg:      this->arg(cmd.as_int); break;
+    case instruction::readm:    readm(consts.member_caches[arg]); break;
+    case instruction::writem:   writem(consts.member_write_caches[arg]); break;
+    case instruction::call:
+      observe(cmd, callee_kind(retval));
+      call(cmd.as_int);
+      break;
+    case instruction::tail_call: tail_call(cmd.as_int); break;
+    case instruction::new_obj:  new_obj(cmd.as_int);  break;
 
     case instruction::eblk: eblk(); break;
     case instruction::lblk: lblk(); break;
@@ -84,44 +437,106 @@ void vm::machine::run()
     case instruction::push: push(); break;
     case instruction::pop:  pop();  break;
 
-    case instruction::req: req(get<std::string>(arg)); break;
+    case instruction::req: req(consts.strings[arg]); break;
+
+    case instruction::jmp:       jmp(cmd.as_int);       break;
+    case instruction::jmp_false: jmp_false(cmd.as_int); break;
+    case instruction::jmp_true:  jmp_true(cmd.as_int);  break;
+    case instruction::iter_init: iter_init(cmd.as_int); break;
+    case instruction::iter_next: iter_next(cmd.as_int); break;
 
-    case instruction::jmp:       jmp(get<int>(arg));       break;
-    case instruction::jmp_false: jmp_false(get<int>(arg)); break;
-    case instruction::jmp_true:  jmp_true(get<int>(arg));  break;
+    case instruction::try_begin: break;
+    case instruction::try_end:   break;
+    case instruction::except:    except(); break;
 
-    case instruction::push_catch: push_catch();            break;
-    case instruction::pop_catch:  pop_catch();             break;
-    case instruction::except:     except();                break;
+    case instruction::add: add(consts.member_caches[arg]); break;
+    case instruction::sub: sub(consts.member_caches[arg]); break;
+    case instruction::mul: mul(consts.member_caches[arg]); break;
+    case instruction::div: div(consts.member_caches[arg]); break;
+    case instruction::mod: mod(consts.member_caches[arg]); break;
+    case instruction::eq:  eq(consts.member_caches[arg]);  break;
+    case instruction::neq: neq(consts.member_caches[arg]); break;
+    case instruction::lt:  lt(consts.member_caches[arg]);  break;
+    case instruction::gt:  gt(consts.member_caches[arg]);  break;
+    case instruction::le:  le(consts.member_caches[arg]);  break;
+    case instruction::ge:  ge(consts.member_caches[arg]);  break;
+
+    case instruction::readm_call:
+      readm_call(consts.member_caches[arg], frame->instr_ptr->as_int);
+      break;
+    case instruction::push_int_arg:   push_int_arg(cmd.as_int);   break;
+    case instruction::load_local_arg: load_local_arg(cmd.as_int); break;
+
+    case instruction::call_function: call_function(cmd.as_int); break;
+    case instruction::call_builtin:  call_builtin(cmd.as_int);  break;
+
+    case instruction::add_int: add_int(); break;
+    case instruction::sub_int: sub_int(); break;
+    case instruction::mul_int: mul_int(); break;
+    case instruction::eq_int: eq_int(); break;
+    case instruction::lt_int: lt_int(); break;
+    case instruction::gt_int: gt_int(); break;
+    case instruction::le_int: le_int(); break;
+    case instruction::ge_int: ge_int(); break;
+
+    case instruction::add_flt: add_flt(); break;
+    case instruction::sub_flt: sub_flt(); break;
+    case instruction::mul_flt: mul_flt(); break;
+    case instruction::eq_flt: eq_flt(); break;
+    case instruction::lt_flt: lt_flt(); break;
+    case instruction::gt_flt: gt_flt(); break;
+    case instruction::le_flt: le_flt(); break;
+    case instruction::ge_flt: ge_flt(); break;
+
+    case instruction::halt: --frame->instr_ptr; return;
     }
   }
+
+#endif
 }
 
 // Instruction implementations {{{
 
 void vm::machine::push_bool(bool val)
 {
-  retval = gc::alloc<value::boolean>( val );
+  retval = value::handle{val};
 }
 
 void vm::machine::push_flt(double val)
 {
-  retval = gc::alloc<value::floating_point>( val );
+  retval = value::handle{val};
 }
 
-void vm::machine::push_fn(const function_t& val)
+void vm::machine::push_fn(const function_ptr& val)
 {
-  retval = gc::alloc<value::function>( val.argc, val.body, frame );
+  // Function frames are always enclosed by a top-level frame, which is the only
+  // one the new closure needs to hold on to; everything else comes from cells
+  auto enclosure = frame == m_base.get()
+                 ? m_base
+                 : static_cast<value::function&>(*frame->caller).enclosure;
+  auto fn = gc::alloc<value::function>( val, enclosure );
+
+  static_cast<value::function*>(fn)->self = current_self(*frame);
+  auto& upvalues = static_cast<value::function*>(fn)->upvalues;
+  for (const auto& i : val->captures) {
+    if (i.local) {
+      upvalues.push_back(frame->cells[static_cast<size_t>(i.index)]);
+    } else {
+      const auto& closure = static_cast<value::function&>(*frame->caller);
+      upvalues.push_back(closure.upvalues[static_cast<size_t>(i.index)]);
+    }
+  }
+  retval = fn;
 }
 
 void vm::machine::push_int(int val)
 {
-  retval = gc::alloc<value::integer>( val );
+  retval = value::handle{val};
 }
 
 void vm::machine::push_nil()
 {
-  retval = gc::alloc<value::nil>( );
+  retval = value::handle::nil();
 }
 
 void vm::machine::push_str(const std::string& val)
@@ -142,33 +557,32 @@ void vm::machine::push_type(const type_t& type)
   std::unordered_map<symbol, value::base*> methods;
   for (const auto& i : type.methods) {
     push_fn(i.second);
-    auto method = retval;
+    auto method = retval.get();
     push();
     methods[i.first] = method;
   }
   retval = gc::alloc<value::type>( nullptr, methods, *parent, type.name );
 
   // Clear pushed arguments without touching retval
-  frame->pushed.erase(end(frame->pushed) - methods.size() - 1,
-                      end(frame->pushed));
+  stack.erase(end(stack) - static_cast<long>(methods.size()) - 1, end(stack));
   let(type.name);
 }
 
 void vm::machine::make_arr(int size)
 {
-  std::vector<value::base*> args{end(frame->pushed) - size, end(frame->pushed)};
+  std::vector<value::handle> args{end(stack) - size, end(stack)};
   retval = gc::alloc<value::array>( args );
-  frame->pushed.erase(end(frame->pushed) - size, end(frame->pushed));
+  stack.erase(end(stack) - size, end(stack));
 }
 
 void vm::machine::make_dict(int size)
 {
-  std::unordered_map<value::base*, value::base*> dict;
-  for (auto i = end(frame->pushed) - size; i != end(frame->pushed); i += 2) {
+  std::unordered_map<value::handle, value::handle> dict;
+  for (auto i = end(stack) - size; i != end(stack); i += 2) {
     dict[i[0]] = i[1];
   }
   retval = gc::alloc<value::dictionary>( dict );
-  frame->pushed.erase(end(frame->pushed) - size, end(frame->pushed));
+  stack.erase(end(stack) - size, end(stack));
 }
 
 void vm::machine::read(symbol sym)
@@ -195,6 +609,10 @@ void vm::machine::write(symbol sym)
                           [&](const auto& vars) { return vars.count(sym); });
     if (holder != rend(cur_frame->local)) {
       holder->at(sym) = retval;
+      // Another file's top-level frame isn't a root, so it's only marked along
+      // with the functions defined in it (see value::function::mark)
+      if (cur_frame != frame && cur_frame != m_base.get())
+        gc::cell_barrier(retval);
       return;
     }
     cur_frame = cur_frame->enclosing;
@@ -208,13 +626,58 @@ void vm::machine::let(symbol sym)
   frame->local.back()[sym] = retval;
 }
 
+void vm::machine::load_local(int slot)
+{
+  retval = stack[frame->frame_ptr + static_cast<size_t>(slot)];
+  // Variables declared in a branch not taken (e.g. 'if x: let y = 1') still
+  // have slots, so make sure this one's actually been set
+  if (!retval)
+    unset_variable(frame->code->locals[static_cast<size_t>(slot)]);
+}
+
+void vm::machine::store_local(int slot)
+{
+  stack[frame->frame_ptr + static_cast<size_t>(slot)] = retval;
+}
+
+void vm::machine::load_cell(int slot)
+{
+  retval = *frame->cells[static_cast<size_t>(slot)];
+  if (!retval)
+    unset_variable(frame->code->locals[static_cast<size_t>(slot)]);
+}
+
+void vm::machine::store_cell(int slot)
+{
+  *frame->cells[static_cast<size_t>(slot)] = retval;
+  gc::cell_barrier(retval);
+}
+
+void vm::machine::make_cell(int slot)
+{
+  frame->cells[static_cast<size_t>(slot)] = std::make_shared<value::handle>();
+}
+
+void vm::machine::load_upvalue(int idx)
+{
+  const auto& closure = static_cast<value::function&>(*frame->caller);
+  retval = *closure.upvalues[static_cast<size_t>(idx)];
+  if (!retval)
+    unset_variable(closure.definition->captures[static_cast<size_t>(idx)].name);
+}
+
+void vm::machine::store_upvalue(int idx)
+{
+  auto& closure = static_cast<value::function&>(*frame->caller);
+  *closure.upvalues[static_cast<size_t>(idx)] = retval;
+  gc::cell_barrier(retval);
+}
+
 void vm::machine::self()
 {
-  auto cur_frame = frame;
-  while (cur_frame && !cur_frame->self)
-    cur_frame = cur_frame->enclosing;
-  if (cur_frame) {
-    retval = &*cur_frame->self;
+  auto self = current_self(*frame);
+  if (self) {
+    retval = self;
   } else {
     push_str("self does not exist outside of objects");
     except();
@@ -223,7 +686,7 @@ void vm::machine::self()
 
 void vm::machine::push_arg()
 {
-  frame->pushed.push_back(retval);
+  stack.push_back(retval);
 }
 
 void vm::machine::arg(int idx)
@@ -233,13 +696,15 @@ void vm::machine::arg(int idx)
 
 void vm::machine::readm(symbol sym)
 {
-  frame->pushed_self = *retval;
-  if (retval->members.count(sym)) {
-    retval = retval->members[sym];
-    return;
+  frame->pushed_self = retval;
+  if (auto obj = retval.get()) {
+    if (auto member = obj->get_member(sym)) {
+      retval = member;
+      return;
+    }
   }
 
-  auto member = find_method(retval->type, sym);
+  auto member = find_method(retval.type(), sym);
   if (member) {
     retval = member;
     return;
@@ -248,65 +713,163 @@ void vm::machine::readm(symbol sym)
   except();
 }
 
+void vm::machine::readm(member_cache& cache)
+{
+  auto shape = retval.shape();
+  auto type = retval.type();
+  auto entry = cache.find(shape, type);
+  member_cache::entry missed;
+  if (!entry) {
+    // Members set on the object itself take precedence over methods
+    auto slot = shape->find(cache.name);
+    auto method = slot == -1 ? find_method(type, cache.name) : nullptr;
+    if (slot == -1 && !method) {
+      readm(cache.name); // no such member; let it throw
+      return;
+    }
+    missed = { shape, type, slot, method };
+    cache.insert(missed);
+    entry = &missed;
+  }
+
+  frame->pushed_self = retval;
+  if (entry->slot == -1)
+    retval = entry->method;
+  else
+    retval = retval.get()->member_slots[static_cast<size_t>(entry->slot)];
+}
+
 void vm::machine::writem(symbol sym)
 {
-  auto value = frame->pushed.back();
-  frame->pushed.pop_back();
+  auto value = stack.back();
+  stack.pop_back();
 
-  retval->members[sym] = value;
+  auto obj = retval.get();
+  if (!obj) {
+    immediate_member();
+    return;
+  }
+  obj->set_member(sym, value);
   retval = value;
 }
 
-// TODO: make suck less.
-void vm::machine::call(int argc)
+void vm::machine::writem(member_write_cache& cache)
 {
-  std::vector<value::base*> args;
+  auto value = stack.back();
+  stack.pop_back();
 
-  if (auto fn = dynamic_cast<value::function*>(retval)) {
-    if (argc != fn->argc) {
-      push_str("Wrong number of arguments--- expected "
-              + std::to_string(fn->argc) + ", got "
-              + std::to_string(argc));
-      except();
-      return;
-    };
+  auto obj = retval.get();
+  if (!obj) {
+    immediate_member();
+    return;
+  }
+  if (!cache.write(*obj, value)) {
+    auto from = obj->shape;
+    obj->set_member(cache.name, value);
+    cache.insert(from, obj->shape, obj->shape->find(cache.name));
+  }
+  retval = value;
+}
 
-    frame = std::make_shared<call_frame>(frame, fn->enclosure, argc, fn->body);
-    frame->caller = *fn;
+void vm::machine::call(int argc)
+{
+  // Function is never subclassed (and its constructor can't be called), so
+  // anything of that type is a basic_function
+  if (retval.type() != &builtin::type::function) {
+    push_str("Only functions can be called");
+    except();
+    return;
+  }
+  auto& callee = static_cast<value::basic_function&>(*retval);
+  if (argc != callee.argc) {
+    push_str("Wrong number of arguments--- expected "
+            + std::to_string(callee.argc) + ", got "
+            + std::to_string(argc));
+    except();
+    return;
+  }
 
-    gc::set_current_frame(frame);
+  if (callee.fn_type == value::basic_function::func_type::builtin)
+    invoke(static_cast<value::builtin_function&>(callee), argc);
+  else
+    invoke(static_cast<value::function&>(callee), argc);
+}
 
-  } else if (auto fn = dynamic_cast<value::builtin_function*>(retval)) {
-    if (argc != fn->argc) {
-      push_str("Wrong number of arguments--- expected "
-              + std::to_string(fn->argc) + ", got "
-              + std::to_string(argc));
-      except();
-      return;
-    };
+bool vm::machine::call_method(symbol name, int argc)
+{
+  auto depth = m_depth;
+  auto exceptions = m_exceptions;
+  readm(name);
+  if (m_exceptions == exceptions)
+    call(argc);
+  if (m_exceptions != exceptions)
+    return false;
+  // Builtins have already run by now, with no frame of their own
+  if (m_depth == depth)
+    return true;
 
-    frame = std::make_shared<call_frame>(frame, m_base, argc, frame->instr_ptr);
-    frame->caller = *fn;
+  // Otherwise, run the new frame until it returns, at which point the caller's
+  // frame is back, and its next instruction (standing in for the rest of the
+  // builtin) is a halt
+  auto& caller = *frame->parent;
+  auto resume = caller.instr_ptr;
+  caller.instr_ptr = &halt_command;
+  auto nested = m_nested_depth;
+  m_nested_depth = depth;
+  auto escaped = false;
+  try {
+    run();
+  } catch (const escaped_call&) {
+    escaped = true;
+  }
+  m_nested_depth = nested;
+  caller.instr_ptr = resume;
 
-    auto except_flag = frame.get();
-    gc::set_current_frame(frame);
-    retval = fn->body(*this);
-    if (except_flag == frame.get())
-      ret();
-  } else {
-    push_str("Only functions can be called");
+  if (escaped)
     except();
+  return !escaped;
+}
+
+void vm::machine::tail_call(int argc)
+{
+  // Anything that can't replace the current function is just called as usual,
+  // and returned from by the following ret: builtins (which don't have frames
+  // to begin with), and anything that'll throw. Calls inside try bodies are
+  // never made tail calls in the first place, since the frame's needed to catch
+  // their exceptions
+  auto callable = retval.type() == &builtin::type::function;
+  if (!callable
+   || static_cast<value::basic_function&>(*retval).argc != argc
+   || static_cast<value::basic_function&>(*retval).fn_type
+        == value::basic_function::func_type::builtin
+   || !frame->parent) {
+    call(argc);
+    return;
   }
+
+  auto& fn = static_cast<value::function&>(*retval);
+  const auto& definition = *fn.definition;
+  auto self = frame->pushed_self;
+  // Slide the arguments down to where the current function's started
+  auto frame_ptr = frame->frame_ptr;
+  move(end(stack) - argc, end(stack),
+       begin(stack) + static_cast<long>(frame_ptr));
+  stack.resize(frame_ptr + static_cast<size_t>(argc));
+
+  frame->reset(frame->parent, fn.enclosure.get(), static_cast<size_t>(argc),
+               frame_ptr, definition.body.data(), &definition);
+  frame->self = self;
+  enter_function(fn);
 }
 
 void vm::machine::new_obj(int argc)
 {
-  if (retval->type != &builtin::type::custom_type) {
+  if (retval.type() != &builtin::type::custom_type) {
     push_str("Objects can only be constructed from Types");
     except();
     return;
   }
-  auto type = static_cast<value::type*>(retval);
+  auto type = static_cast<value::type*>(retval.get());
 
   // Since everything inherits from Object, we're guaranteed to find a
   // constructor
@@ -318,14 +881,16 @@ void vm::machine::new_obj(int argc)
   // constructors that return nullptr, hence this message. The alternative would
   // be them trying to except within their constructors, and tying that behavior
   // back in with the VM can get pretty hairy (as in vm::call)
-  if (!retval) {
+  // Immediates can't be given another type, so neither can they be subclassed
+  if (!retval || (!retval.is_ptr() && retval.type() != type)) {
     push_str("Cannot construct object of type " + type->value());
     except();
     return;
   }
-  retval->type = type;
+  if (auto obj = retval.get())
+    obj->type = type;
 
-  frame->pushed_self = *retval;
+  frame->pushed_self = retval;
   push_fn(type->init_shim);
   call(argc);
 }
@@ -343,10 +908,7 @@ void vm::machine::lblk()
 void vm::machine::ret()
 {
   if (frame->parent) {
-    frame->parent->pushed.erase(end(frame->parent->pushed) - frame->args,
-                                end(frame->parent->pushed));
-    frame = frame->parent;
-    gc::set_current_frame(frame);
+    pop_frame();
   } else {
     push_str("The top-level environment can't be returned from");
     except();
@@ -355,13 +917,13 @@ void vm::machine::ret()
 
 void vm::machine::push()
 {
-  frame->pushed.push_back(retval);
+  stack.push_back(retval);
 }
 
 void vm::machine::pop()
 {
-  retval = frame->pushed.back();
-  frame->pushed.pop_back();
+  retval = stack.back();
+  stack.pop_back();
 }
 
 void vm::machine::req(const std::string& filename)
@@ -378,7 +940,7 @@ void vm::machine::req(const std::string& filename)
 
 void vm::machine::jmp(int offset)
 {
-  frame->instr_ptr = frame->instr_ptr.shifted_by(offset - 1);
+  frame->instr_ptr += offset - 1;
 }
 
 void vm::machine::jmp_false(int offset)
@@ -393,32 +955,473 @@ void vm::machine::jmp_true(int offset)
     jmp(offset);
 }
 
-void vm::machine::push_catch()
+void vm::machine::iter_init(int offset)
 {
-  frame->catcher = *retval;
+  if (!iterates_directly(retval)) {
+    stack.push_back(value::handle::nil());
+    ++frame->instr_ptr;
+    return;
+  }
+  // Ranges keep track of their own progress, so the index is only used for
+  // Arrays and Strings
+  stack.emplace_back(0);
+  stack.push_back(retval);
+  iter_element(offset);
 }
 
-void vm::machine::pop_catch()
+void vm::machine::iter_next(int offset)
 {
-  frame->catcher = {};
+  auto& idx = end(stack)[-2];
+  if (idx.is_nil()) {
+    ++frame->instr_ptr;
+    return;
+  }
+
+  auto iterable = stack.back();
+  if (iterable.type() == &builtin::type::range) {
+    // Ranges are their own iterators, so the loop body might have changed one
+    // into something that can't be iterated over directly any more (e.g. by
+    // calling init with Floats); if so, carry on through its methods instead
+    if (!iterates_directly(iterable)) {
+      idx = value::handle::nil();
+      ++frame->instr_ptr;
+      return;
+    }
+    auto& rng = static_cast<value::range&>(*iterable);
+    rng.start = value::handle{rng.start.as_int() + 1};
+  } else {
+    idx = value::handle{idx.as_int() + 1};
+  }
+  iter_element(offset);
 }
 
 void vm::machine::except()
 {
-  while (frame->parent && !frame->catcher)
-    frame = frame->parent;
+  ++m_exceptions;
+  // Frames from the builtin's caller down are off limits to a function run by
+  // call_method; its instruction pointer is parked on a halt meanwhile
+  const handler* handler{};
+  while (m_depth != m_nested_depth
+      && !(handler = find_handler(*frame)) && frame->parent)
+    pop_frame();
 
-  if (!frame->catcher) {
+  if (m_depth == m_nested_depth)
+    throw escaped_call{};
+  if (!handler) {
     m_exception_handler(*this);
     // If we're still here, stop executing code since obviously some invariant's
     // broken
-    frame->instr_ptr = frame->instr_ptr.subvec(frame->instr_ptr.size());
+    frame->instr_ptr = &halt_command;
+    return;
+  }
+
+  // Put the frame back the way it was at the start of the try body, and hand
+  // the exception (still in retval) over to the catch body
+  const auto& code = *frame->code;
+  auto pc = static_cast<size_t>(frame->instr_ptr - code.body.data() - 1);
+  auto blocks = code.blocks.empty() ? 0 : code.blocks[pc];
+  while (blocks-- > handler->blocks)
+    frame->local.pop_back();
+  auto locals = std::max(code.locals.size(), frame->args);
+  stack.resize(frame->frame_ptr + locals
+                                + static_cast<size_t>(handler->stack));
+  frame->instr_ptr = code.body.data() + handler->target;
+}
+
+void vm::machine::add(member_cache& fallback)
+{
+  binary_operator(fallback, std::plus<>{});
+}
+
+void vm::machine::sub(member_cache& fallback)
+{
+  binary_operator(fallback, std::minus<>{});
+}
+
+void vm::machine::mul(member_cache& fallback)
+{
+  binary_operator(fallback, std::multiplies<>{});
+}
+
+void vm::machine::div(member_cache& fallback)
+{
+  // Leave dividing by zero to the method, which knows what to complain about
+  auto right = stack.back();
+  if ((right.is_int() && right.as_int() == 0)
+   || (right.is_float() && right.as_float() == 0))
+    call_operator(fallback);
+  else
+    binary_operator(fallback, std::divides<>{});
+}
+
+void vm::machine::mod(member_cache& fallback)
+{
+  // Only defined for Integers
+  auto right = stack.back();
+  if (retval.is_int() && right.is_int() && right.as_int() != 0) {
+    retval = value::handle{retval.as_int() % right.as_int()};
+    stack.pop_back();
   } else {
+    call_operator(fallback);
+  }
+}
+
+void vm::machine::eq(member_cache& fallback)
+{
+  binary_operator(fallback, std::equal_to<>{});
+}
+
+void vm::machine::neq(member_cache& fallback)
+{
+  binary_operator(fallback, std::not_equal_to<>{});
+}
+
+void vm::machine::lt(member_cache& fallback)
+{
+  binary_operator(fallback, std::less<>{});
+}
+
+void vm::machine::gt(member_cache& fallback)
+{
+  binary_operator(fallback, std::greater<>{});
+}
+
+void vm::machine::le(member_cache& fallback)
+{
+  binary_operator(fallback, std::less_equal<>{});
+}
+
+void vm::machine::ge(member_cache& fallback)
+{
+  binary_operator(fallback, std::greater_equal<>{});
+}
+
+void vm::machine::readm_call(member_cache& cache, int args)
+{
+  auto exceptions = m_exceptions;
+  readm(cache);
+  // If readm excepted, we've already jumped to a catch body (or halted)
+  if (exceptions == m_exceptions) {
+    ++frame->instr_ptr;
+    call(args);
+  }
+}
+
+void vm::machine::push_int_arg(int val)
+{
+  push_int(val);
+  push_arg();
+  ++frame->instr_ptr;
+}
+
+void vm::machine::load_local_arg(int slot)
+{
+  auto exceptions = m_exceptions;
+  load_local(slot);
+  if (exceptions == m_exceptions) {
     push_arg();
-    retval = &*frame->catcher;
-    call(1);
-    pop_catch();
+    ++frame->instr_ptr;
+  }
+}
+
+void vm::machine::call_function(int argc)
+{
+  auto kind = callee_kind(retval);
+  if (kind != feedback::function
+   || static_cast<value::basic_function&>(*retval).argc != argc) {
+    deoptimize();
+    return;
+  }
+  invoke(static_cast<value::function&>(*retval), argc);
+}
+
+void vm::machine::call_builtin(int argc)
+{
+  auto kind = callee_kind(retval);
+  if (kind != feedback::builtin
+   || static_cast<value::basic_function&>(*retval).argc != argc) {
+    deoptimize();
+    return;
   }
+  invoke(static_cast<value::builtin_function&>(*retval), argc);
+}
+
+void vm::machine::add_int()
+{
+  int_operator(std::plus<>{});
+}
+
+void vm::machine::sub_int()
+{
+  int_operator(std::minus<>{});
+}
+
+void vm::machine::mul_int()
+{
+  int_operator(std::multiplies<>{});
+}
+
+void vm::machine::eq_int()
+{
+  int_operator(std::equal_to<>{});
+}
+
+void vm::machine::lt_int()
+{
+  int_operator(std::less<>{});
+}
+
+void vm::machine::gt_int()
+{
+  int_operator(std::greater<>{});
+}
+
+void vm::machine::le_int()
+{
+  int_operator(std::less_equal<>{});
+}
+
+void vm::machine::ge_int()
+{
+  int_operator(std::greater_equal<>{});
+}
+
+void vm::machine::add_flt()
+{
+  float_operator(std::plus<>{});
+}
+
+void vm::machine::sub_flt()
+{
+  float_operator(std::minus<>{});
+}
+
+void vm::machine::mul_flt()
+{
+  float_operator(std::multiplies<>{});
+}
+
+void vm::machine::eq_flt()
+{
+  float_operator(std::equal_to<>{});
+}
+
+void vm::machine::lt_flt()
+{
+  float_operator(std::less<>{});
+}
+
+void vm::machine::gt_flt()
+{
+  float_operator(std::greater<>{});
+}
+
+void vm::machine::le_flt()
+{
+  float_operator(std::less_equal<>{});
+}
+
+void vm::machine::ge_flt()
+{
+  float_operator(std::greater_equal<>{});
 }
 
 // }}}
+
+void vm::machine::push_frame(size_t args,
+                             call_frame* enclosing,
+                             const command* instr_ptr,
+                             const function_t* code)
+{
+  auto frame_ptr = stack.size() - args;
+  if (m_depth == m_frames.size()) {
+    // The stack only grows by more than a frame's temporaries when there's a
+    // new frame to go with it, so it's counted along with the frames
+    account_stack(m_depth + 1);
+    m_frames.push_back(std::make_unique<call_frame>(frame, enclosing, args,
+                                                    frame_ptr, instr_ptr,
+                                                    code));
+  } else {
+    m_frames[m_depth]->reset(frame, enclosing, args, frame_ptr, instr_ptr,
+                             code);
+  }
+  frame = m_frames[m_depth++].get();
+}
+
+void vm::machine::account_stack(size_t frames)
+{
+  auto old_size = m_stack_size;
+  m_stack_size = frames * sizeof(call_frame)
+               + stack.capacity() * sizeof(value::handle);
+  gc::stack_resized(old_size, m_stack_size);
+}
+
+void vm::machine::pop_frame()
+{
+  stack.resize(frame->frame_ptr);
+  frame = frame->parent;
+  --m_depth;
+}
+
+void vm::machine::iter_element(int offset)
+{
+  auto idx = static_cast<size_t>(end(stack)[-2].as_int());
+  auto iterable = stack.back();
+  auto type = iterable.type();
+
+  if (type == &builtin::type::range) {
+    const auto& rng = static_cast<value::range&>(*iterable);
+    if (rng.start.as_int() >= rng.end.as_int())
+      return;
+    retval = rng.start;
+
+  } else if (type == &builtin::type::array) {
+    const auto& arr = static_cast<value::array&>(*iterable).val;
+    if (idx >= arr.size())
+      return;
+    retval = arr[idx];
+
+  } else {
+    const auto& str = static_cast<value::string&>(*iterable).val;
+    if (idx >= str.size())
+      return;
+    retval = gc::alloc<value::string>( std::string{str[idx]} );
+  }
+  jmp(offset);
+}
+
+void vm::machine::invoke(const value::builtin_function& fn, int argc)
+{
+  // Builtins run straight away, without a frame of their own. If one excepts,
+  // unwinding starts from the calling frame, and its arguments are discarded
+  // along with the rest of that frame's temporaries; otherwise they're popped
+  // here. Self's pushed above the arguments for as long as the builtin runs,
+  // since the calling frame's pushed_self is overwritten by any method the
+  // builtin itself reads and calls
+  auto frame_ptr = stack.size() - static_cast<size_t>(argc);
+  auto self = frame->pushed_self;
+  stack.push_back(self);
+  auto exceptions = m_exceptions;
+  retval = fn.body(*this, self, {stack, frame_ptr, static_cast<size_t>(argc)});
+  if (exceptions == m_exceptions)
+    stack.resize(frame_ptr);
+}
+
+void vm::machine::invoke(value::function& fn, int argc)
+{
+  const auto& definition = *fn.definition;
+  push_frame(static_cast<size_t>(argc), fn.enclosure.get(),
+             definition.body.data(), &definition);
+  enter_function(fn);
+}
+
+void vm::machine::enter_function(value::function& fn)
+{
+  frame->caller = fn;
+  make_locals(*fn.definition);
+}
+
+void vm::machine::make_locals(const function_t& code)
+{
+  // Arguments are already in the first slots; make room for the rest. Cells
+  // are made as the blocks declaring them are entered (see make_cell), so each
+  // time a block's run, any closures it creates get variables of their own
+  auto locals = std::max(code.locals.size(), frame->args);
+  stack.resize(frame->frame_ptr + locals);
+  frame->cells.clear();
+  if (!code.cells.empty())
+    frame->cells.resize(code.locals.size());
+}
+
+void vm::machine::unset_variable(symbol name)
+{
+  push_str("no such variable: " + to_string(name));
+  except();
+}
+
+template <typename F>
+void vm::machine::binary_operator(member_cache& fallback, const F& op)
+{
+  // Mixing Integers and Floats gives the same result either way round, as
+  // it does in the methods
+  auto left = retval;
+  auto right = stack.back();
+  observe(frame->instr_ptr[-1], operand_kind(left, right));
+  if (left.is_int() && right.is_int())
+    retval = value::handle{op(left.as_int(), right.as_int())};
+  else if (is_number(left) && is_number(right))
+    retval = value::handle{op(to_double(left), to_double(right))};
+  else {
+    call_operator(fallback);
+    return;
+  }
+  stack.pop_back();
+}
+
+template <typename F>
+void vm::machine::int_operator(const F& op)
+{
+  auto right = stack.back();
+  if (!retval.is_int() || !right.is_int()) {
+    deoptimize();
+    return;
+  }
+  retval = value::handle{op(retval.as_int(), right.as_int())};
+  stack.pop_back();
+}
+
+template <typename F>
+void vm::machine::float_operator(const F& op)
+{
+  auto right = stack.back();
+  if (!retval.is_float() || !right.is_float()) {
+    deoptimize();
+    return;
+  }
+  retval = value::handle{op(retval.as_float(), right.as_float())};
+  stack.pop_back();
+}
+
+void vm::machine::observe(const command& cmd, unsigned char kind)
+{
+  cmd.seen |= kind;
+  if (cmd.seen == kind)
+    cmd.instr = quickened(cmd.instr, kind);
+}
+
+void vm::machine::deoptimize()
+{
+  --frame->instr_ptr;
+  frame->instr_ptr->instr = generic(frame->instr_ptr->instr);
+}
+
+void vm::machine::call_operator(member_cache& cache)
+{
+  auto exceptions = m_exceptions;
+  readm(cache);
+  if (exceptions == m_exceptions)
+    call(1);
+}
+
+void vm::machine::immediate_member()
+{
+  push_str("Members cannot be set on " + retval.type()->value() + "s");
+  except();
+}
+
+void vm::mark(machine& vm)
+{
+  mark(*vm.m_base);
+  for (auto i = vm.m_depth; i--;) {
+    const auto& frame = vm.m_frames[i];
+    mark(*frame);
+    // Functions defined in other files are enclosed by those files' top-level
+    // frames
+    if (frame->enclosing != vm.m_base.get())
+      mark(*frame->enclosing);
+  }
+
+  for (auto i : vm.stack)
+    gc::mark(i);
+  gc::mark(vm.retval);
+}
@@ -3,20 +3,36 @@
 
 #include "vm/call_frame.h"
 
+#include <array>
+
 namespace vv {
 
 namespace vm {
 
+// How often each instruction's been run immediately after each other one,
+// recorded under --profile-opcodes. The most frequent pairs are the ones worth
+// fusing into superinstructions (see vm::optimize).
+struct opcode_profile {
+  static const size_t size{static_cast<size_t>(instruction::halt) + 1};
+
+  bool enabled;
+  // Indexed by the first instruction, then the second
+  std::array<std::array<size_t, size>, size> pairs;
+};
+
+extern opcode_profile g_opcode_profile;
+
 class machine {
 public:
   machine(std::shared_ptr<call_frame> base,
           const std::function<void(vm::machine&)>& exception_handler);
+  ~machine();
 
   void run();
 
   void push_bool(bool val);
   void push_flt(double val);
-  void push_fn(const function_t& val);
+  void push_fn(const function_ptr& val);
   void push_int(int val);
   void push_nil();
   void push_str(const std::string& val);
@@ -30,12 +46,30 @@ public:
   void write(symbol sym);
   void let(symbol sym);
 
+  void load_local(int slot);
+  void store_local(int slot);
+  void load_cell(int slot);
+  void store_cell(int slot);
+  void make_cell(int slot);
+  void load_upvalue(int idx);
+  void store_upvalue(int idx);
+
   void self();
   void push_arg();
   void arg(int idx);
   void readm(symbol sym);
+  void readm(member_cache& cache);
   void writem(symbol sym);
+  void writem(member_write_cache& cache);
   void call(int args);
+  // For builtins calling back into the VM: calls retval's method with the
+  // given name, like readm and call, except that a function (rather than a
+  // builtin) is run until it returns, instead of just being set up to run once
+  // the calling builtin has. Returns false if it excepted, in which case the
+  // exception's already been passed on to the builtin's caller, and the builtin
+  // should return straight away
+  bool call_method(symbol name, int args);
+  void tail_call(int args);
   void new_obj(int args);
 
   void eblk();
@@ -50,19 +84,121 @@ public:
   void jmp(int offset);
   void jmp_false(int offset);
   void jmp_true(int offset);
+  void iter_init(int offset);
+  void iter_next(int offset);
 
-  void push_catch();
-  void pop_catch();
   void except();
 
-  std::shared_ptr<call_frame> frame;
-  value::base* retval;
+  void add(member_cache& fallback);
+  void sub(member_cache& fallback);
+  void mul(member_cache& fallback);
+  void div(member_cache& fallback);
+  void mod(member_cache& fallback);
+  void eq(member_cache& fallback);
+  void neq(member_cache& fallback);
+  void lt(member_cache& fallback);
+  void gt(member_cache& fallback);
+  void le(member_cache& fallback);
+  void ge(member_cache& fallback);
+
+  void readm_call(member_cache& cache, int args);
+  void push_int_arg(int val);
+  void load_local_arg(int slot);
+
+  void call_function(int args);
+  void call_builtin(int args);
+
+  void add_int();
+  void sub_int();
+  void mul_int();
+  void eq_int();
+  void lt_int();
+  void gt_int();
+  void le_int();
+  void ge_int();
+
+  void add_flt();
+  void sub_flt();
+  void mul_flt();
+  void eq_flt();
+  void lt_flt();
+  void gt_flt();
+  void le_flt();
+  void ge_flt();
+
+  call_frame* frame;
+  value::handle retval;
+  // Arguments, local variables and temporaries of every frame on the call stack
+  std::vector<value::handle> stack;
+
+  friend void mark(machine& vm);
 
 private:
+  // Runs instructions until reaching a halt; see run
+  void dispatch();
+
+  // Gets a frame from the pool and makes it current
+  void push_frame(size_t args, call_frame* enclosing, const command* instr_ptr,
+                  const function_t* code);
+  // Discards the current frame, along with its arguments and temporaries
+  void pop_frame();
+  // Counts the stack, and the given number of frames, towards the heap (see
+  // gc::stack_resized)
+  void account_stack(size_t frames);
+  // Puts the current element of the for loop whose state is on top of the
+  // stack in retval and jumps to the loop body, or, at the end of the loop,
+  // does nothing
+  void iter_element(int offset);
+  // Calls fn, with the provided number of pushed arguments
+  void invoke(const value::builtin_function& fn, int args);
+  void invoke(value::function& fn, int args);
+  // Sets up the newly pushed (or reused) frame for a call to fn
+  void enter_function(value::function& fn);
+  // Makes room in the current frame for code's local variables
+  void make_locals(const function_t& code);
+
+  // Raises a "no such variable" exception for a slot, cell or upvalue that
+  // hasn't been assigned yet
+  void unset_variable(symbol name);
+  // Raises an exception for an attempt to set a member on retval, which holds
+  // an immediate (see value::handle)
+  void immediate_member();
+
+  // Shared implementation of the arithmetic and comparison instructions
+  template <typename F>
+  void binary_operator(member_cache& fallback, const F& op);
+  // And of their quickened forms
+  template <typename F>
+  void int_operator(const F& op);
+  template <typename F>
+  void float_operator(const F& op);
+  // Records operands of the given kind as seen by cmd, quickening it if
+  // they're the only kind it's seen
+  void observe(const command& cmd, unsigned char kind);
+  // Turns the current (quickened) instruction back into its generic form, and
+  // backs up so it's rerun as such
+  void deoptimize();
+  // Calls the method for a binary operator, for operands that aren't both
+  // numbers
+  void call_operator(member_cache& cache);
+
   std::shared_ptr<call_frame> m_base;
+  // Frames for function calls; the first m_depth are currently in use, and the
+  // rest are kept around to be reused
+  std::vector<std::unique_ptr<call_frame>> m_frames;
+  size_t m_depth;
+  // Depth of the frame that called the builtin in the innermost
+  // call_method, if any; exceptions aren't unwound past it from inside
+  size_t m_nested_depth;
+  // Size of the stack and frames, as last passed to gc::stack_resized
+  size_t m_stack_size;
+  // Incremented by every call to except
+  size_t m_exceptions;
   std::function<void(machine&)> m_exception_handler;
 };
 
+void mark(machine& vm);
+
 }
 
 }
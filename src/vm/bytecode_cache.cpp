@@ -0,0 +1,502 @@
+#include "bytecode_cache.h"
+
+#include "build_id.h"
+
+#include <boost/filesystem.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+using namespace vv;
+
+bool vm::g_cache_enabled{true};
+
+namespace {
+
+using vm::instruction;
+
+// Bumped whenever the format itself changes
+const uint32_t format_version{2};
+
+const char magic[4]{'V', 'V', 'B', 'C'};
+
+// Laid out at the start of every cached file, followed by the symbol table and
+// then the file's top-level function
+struct header {
+  char magic[4];
+  uint32_t version;
+  // Of the build that wrote it (a hash of every source file, generated by
+  // CMake), since any change to code generation, the optimizer or the
+  // instruction set can make cached code wrong without changing its format
+  uint64_t build;
+  // Number of instructions, as a cheap check that the instruction set's the
+  // same one the code was generated for
+  uint32_t instructions;
+  uint32_t symbols;
+
+  // The source file's, as of when it was compiled
+  uint64_t size;
+  int64_t mtime;
+  uint64_t hash;
+
+  // Of everything after the header, since nothing in it's checked for making
+  // sense (e.g. jumps landing inside the function) once it's read
+  uint64_t checksum;
+};
+
+const uint32_t instruction_count{static_cast<uint32_t>(instruction::halt) + 1};
+
+// Size and modification time (in nanoseconds) of a file
+struct file_info {
+  uint64_t size;
+  int64_t mtime;
+};
+
+bool stat_file(const std::string& filename, file_info& info)
+{
+  struct stat st;
+  if (stat(filename.c_str(), &st))
+    return false;
+#ifdef __APPLE__
+  const auto& mtime = st.st_mtimespec;
+#else
+  const auto& mtime = st.st_mtim;
+#endif
+  info.size = static_cast<uint64_t>(st.st_size);
+  info.mtime = int64_t{mtime.tv_sec} * 1000000000 + mtime.tv_nsec;
+  return true;
+}
+
+// FNV-1a
+uint64_t hash(boost::string_ref source)
+{
+  uint64_t val{14695981039346656037ull};
+  for (auto c : source) {
+    val ^= static_cast<unsigned char>(c);
+    val *= 1099511628211ull;
+  }
+  return val;
+}
+
+boost::filesystem::path cache_path(const std::string& filename)
+{
+  boost::filesystem::path source{filename};
+  return source.parent_path() / ".vvcache" / (source.filename().string() + 'c');
+}
+
+// Overwrites the source modification time stored in the cached file at path,
+// so a file that's been touched without changing isn't hashed on every run
+void update_mtime(const boost::filesystem::path& path, int64_t mtime)
+{
+  std::fstream file{path.string(), std::ios::in | std::ios::out
+                                                | std::ios::binary};
+  file.seekp(offsetof(header, mtime));
+  file.write(reinterpret_cast<const char*>(&mtime), sizeof(mtime));
+}
+
+// Only push_sym and the instructions naming variables take symbols, and only
+// push_bool takes a bool; everything else is an int
+bool takes_symbol(instruction instr)
+{
+  return instr == instruction::push_sym
+      || instr == instruction::read
+      || instr == instruction::write
+      || instr == instruction::let;
+}
+
+// Writing {{{
+
+class writer {
+public:
+  void put_function(const vm::function_t& code);
+
+  // Everything written so far, preceded by the header and the symbol table
+  std::string finish(header head) const;
+
+private:
+  template <typename T>
+  void put(T val)
+  {
+    m_out.append(reinterpret_cast<const char*>(&val), sizeof(val));
+  }
+  void put_count(size_t count) { put(static_cast<uint32_t>(count)); }
+  void put_string(const std::string& str);
+  void put_symbol(symbol sym);
+
+  std::string m_out;
+  std::unordered_map<symbol, uint32_t> m_symbol_idxs;
+  std::vector<symbol> m_symbols;
+};
+
+void writer::put_string(const std::string& str)
+{
+  put_count(str.size());
+  m_out += str;
+}
+
+void writer::put_symbol(symbol sym)
+{
+  auto idx = m_symbol_idxs.find(sym);
+  if (idx == end(m_symbol_idxs)) {
+    idx = m_symbol_idxs.emplace(sym, m_symbols.size()).first;
+    m_symbols.push_back(sym);
+  }
+  put(idx->second);
+}
+
+void writer::put_function(const vm::function_t& code)
+{
+  put(static_cast<int32_t>(code.argc));
+
+  put_count(code.body.size());
+  for (const auto& i : code.body) {
+    auto instr = vm::generic(i.instr);
+    put(static_cast<uint8_t>(instr));
+    if (takes_symbol(instr))
+      put_symbol(i.as_sym);
+    else if (instr == instruction::push_bool)
+      put(static_cast<int32_t>(i.as_bool));
+    else
+      put(static_cast<int32_t>(i.as_int));
+  }
+
+  const auto& consts = code.constants;
+  put_count(consts.strings.size());
+  for (const auto& i : consts.strings)
+    put_string(i);
+  put_count(consts.floats.size());
+  for (auto i : consts.floats)
+    put(i);
+  put_count(consts.functions.size());
+  for (const auto& i : consts.functions)
+    put_function(*i);
+  put_count(consts.types.size());
+  for (const auto& i : consts.types) {
+    put_symbol(i.name);
+    put_symbol(i.parent);
+    put_count(i.methods.size());
+    for (const auto& method : i.methods) {
+      put_symbol(method.first);
+      put_function(*method.second);
+    }
+  }
+  put_count(consts.member_caches.size());
+  for (const auto& i : consts.member_caches)
+    put_symbol(i.name);
+  put_count(consts.member_write_caches.size());
+  for (const auto& i : consts.member_write_caches)
+    put_symbol(i.name);
+
+  put_count(code.locals.size());
+  for (auto i : code.locals)
+    put_symbol(i);
+  put_count(code.cells.size());
+  for (auto i : code.cells)
+    put(static_cast<int32_t>(i));
+  put_count(code.captures.size());
+  for (const auto& i : code.captures) {
+    put_symbol(i.name);
+    put(static_cast<int32_t>(i.local));
+    put(static_cast<int32_t>(i.index));
+  }
+  put_count(code.handlers.size());
+  for (const auto& i : code.handlers)
+    put(i);
+  put_count(code.blocks.size());
+  for (auto i : code.blocks)
+    put(static_cast<int32_t>(i));
+}
+
+std::string writer::finish(header head) const
+{
+  head.symbols = static_cast<uint32_t>(m_symbols.size());
+  writer symbols;
+  for (auto i : m_symbols)
+    symbols.put_string(to_string(i));
+  auto body = symbols.m_out + m_out;
+  head.checksum = hash(body);
+
+  std::string file{reinterpret_cast<const char*>(&head), sizeof(head)};
+  return file + body;
+}
+
+// }}}
+// Reading {{{
+
+// Reads from a mapped cache file. Anything that doesn't fit (whether because
+// the file's been truncated or it's otherwise corrupt) marks the whole file as
+// bad rather than being read past the end.
+class reader {
+public:
+  reader(const char* first, const char* last)
+    : m_pos {first},
+      m_end {last},
+      m_ok  {true}
+  { }
+
+  bool read_symbols(uint32_t count);
+  vm::function_t get_function();
+
+  bool ok() const { return m_ok && m_pos == m_end; }
+
+private:
+  template <typename T>
+  T get()
+  {
+    T val{};
+    if (static_cast<size_t>(m_end - m_pos) < sizeof(val)) {
+      m_ok = false;
+      return val;
+    }
+    memcpy(&val, m_pos, sizeof(val));
+    m_pos += sizeof(val);
+    return val;
+  }
+  // Reads the number of records to follow, each at least min_size bytes long,
+  // which had better actually be there
+  uint32_t get_count(size_t min_size);
+  std::string get_string();
+  symbol get_symbol();
+
+  const char* m_pos;
+  const char* m_end;
+  bool m_ok;
+  std::vector<symbol> m_symbols;
+};
+
+uint32_t reader::get_count(size_t min_size)
+{
+  auto count = get<uint32_t>();
+  if (count > static_cast<size_t>(m_end - m_pos) / min_size) {
+    m_ok = false;
+    return 0;
+  }
+  return count;
+}
+
+std::string reader::get_string()
+{
+  auto size = get_count(1);
+  std::string str{m_pos, size};
+  m_pos += size;
+  return str;
+}
+
+symbol reader::get_symbol()
+{
+  auto idx = get<uint32_t>();
+  if (idx >= m_symbols.size()) {
+    m_ok = false;
+    return {};
+  }
+  return m_symbols[idx];
+}
+
+bool reader::read_symbols(uint32_t count)
+{
+  m_symbols.reserve(std::min<size_t>(count, static_cast<size_t>(m_end - m_pos)));
+  for (; count-- && m_ok;)
+    m_symbols.emplace_back(get_string());
+  return m_ok;
+}
+
+vm::function_t reader::get_function()
+{
+  vm::function_t code{};
+  code.argc = get<int32_t>();
+
+  auto body_size = get_count(5);
+  code.body.reserve(body_size);
+  for (auto i = body_size; i-- && m_ok;) {
+    auto instr_val = get<uint8_t>();
+    if (instr_val >= instruction_count)
+      m_ok = false;
+    auto instr = static_cast<instruction>(instr_val);
+    if (takes_symbol(instr))
+      code.body.emplace_back(instr, get_symbol());
+    else if (instr == instruction::push_bool)
+      code.body.emplace_back(instr, get<int32_t>() != 0);
+    else
+      code.body.emplace_back(instr, static_cast<int>(get<int32_t>()));
+  }
+
+  auto& consts = code.constants;
+  for (auto i = get_count(4); i-- && m_ok;)
+    consts.strings.push_back(get_string());
+  for (auto i = get_count(sizeof(double)); i-- && m_ok;)
+    consts.floats.push_back(get<double>());
+  for (auto i = get_count(4); i-- && m_ok;)
+    consts.functions.push_back(std::make_shared<vm::function_t>(get_function()));
+  for (auto i = get_count(12); i-- && m_ok;) {
+    vm::type_t type{};
+    type.name = get_symbol();
+    type.parent = get_symbol();
+    for (auto j = get_count(8); j-- && m_ok;) {
+      auto name = get_symbol();
+      type.methods[name] = std::make_shared<vm::function_t>(get_function());
+    }
+    consts.types.push_back(std::move(type));
+  }
+  for (auto i = get_count(4); i-- && m_ok;)
+    consts.member_caches.emplace_back(get_symbol());
+  for (auto i = get_count(4); i-- && m_ok;)
+    consts.member_write_caches.emplace_back(get_symbol());
+
+  for (auto i = get_count(4); i-- && m_ok;)
+    code.locals.push_back(get_symbol());
+  for (auto i = get_count(4); i-- && m_ok;)
+    code.cells.push_back(get<int32_t>());
+  for (auto i = get_count(12); i-- && m_ok;) {
+    auto name = get_symbol();
+    auto local = get<int32_t>() != 0;
+    code.captures.push_back({ name, local, get<int32_t>() });
+  }
+  for (auto i = get_count(sizeof(vm::handler)); i-- && m_ok;)
+    code.handlers.push_back(get<vm::handler>());
+  for (auto i = get_count(4); i-- && m_ok;)
+    code.blocks.push_back(get<int32_t>());
+
+  return code;
+}
+
+// A read-only mapping of an entire file, unmapped on destruction
+class mapped_file {
+public:
+  explicit mapped_file(const std::string& filename);
+  ~mapped_file();
+
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+
+  const char* data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+private:
+  const char* m_data;
+  size_t m_size;
+};
+
+mapped_file::mapped_file(const std::string& filename)
+  : m_data {nullptr},
+    m_size {0}
+{
+  auto fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1)
+    return;
+  struct stat st;
+  if (!fstat(fd, &st) && st.st_size > 0) {
+    auto size = static_cast<size_t>(st.st_size);
+    auto data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      m_data = static_cast<const char*>(data);
+      m_size = size;
+    }
+  }
+  close(fd);
+}
+
+mapped_file::~mapped_file()
+{
+  if (m_data)
+    munmap(const_cast<char*>(m_data), m_size);
+}
+
+// }}}
+
+}
+
+boost::optional<vm::function_t> vm::load_cached(const std::string& filename)
+{
+  file_info source;
+  if (!g_cache_enabled || !stat_file(filename, source))
+    return {};
+  auto path = cache_path(filename);
+  mapped_file file{path.string()};
+  if (file.size() < sizeof(header))
+    return {};
+
+  header head;
+  memcpy(&head, file.data(), sizeof(head));
+  if (memcmp(head.magic, magic, sizeof(magic))
+      || head.version != format_version
+      || head.build != VV_BUILD_ID
+      || head.instructions != instruction_count
+      || head.size != source.size)
+    return {};
+
+  // Same size but touched since, so it's down to whether the contents are the
+  // same
+  if (head.mtime != source.mtime) {
+    std::ifstream in{filename};
+    std::string contents{std::istreambuf_iterator<char>{in}, {}};
+    if (hash(contents) != head.hash)
+      return {};
+  }
+
+  boost::string_ref body{file.data() + sizeof(head), file.size() - sizeof(head)};
+  if (hash(body) != head.checksum)
+    return {};
+
+  reader in{body.data(), body.data() + body.size()};
+  if (!in.read_symbols(head.symbols))
+    return {};
+  auto code = in.get_function();
+  if (!in.ok())
+    return {};
+  if (head.mtime != source.mtime)
+    update_mtime(path, source.mtime);
+  return code;
+}
+
+void vm::store_cached(const std::string& filename,
+                      boost::string_ref source,
+                      const function_t& code)
+{
+  file_info info;
+  // Don't bother if the file's already been changed since source was read
+  if (!g_cache_enabled || !stat_file(filename, info)
+                       || info.size != source.size())
+    return;
+
+  writer out;
+  out.put_function(code);
+  header head{};
+  memcpy(head.magic, magic, sizeof(magic));
+  head.version = format_version;
+  head.build = VV_BUILD_ID;
+  head.instructions = instruction_count;
+  head.size = info.size;
+  head.mtime = info.mtime;
+  head.hash = hash(source);
+  auto contents = out.finish(head);
+
+  // Written to a temporary file first and then moved into place, so nothing
+  // ever sees (or maps) a partially written file
+  boost::system::error_code err;
+  auto path = cache_path(filename);
+  create_directories(path.parent_path(), err);
+  if (err)
+    return;
+  auto tmp = path;
+  tmp += ".tmp" + std::to_string(getpid());
+  std::ofstream tmp_file{tmp.string(), std::ios::binary};
+  tmp_file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+  // Anything still buffered is only written on closing, which can fail just
+  // the same (e.g. on a full disk)
+  tmp_file.close();
+  if (!tmp_file) {
+    remove(tmp, err);
+    return;
+  }
+  rename(tmp, path, err);
+  if (err)
+    remove(tmp, err);
+}
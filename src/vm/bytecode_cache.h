@@ -0,0 +1,47 @@
+#ifndef VV_VM_BYTECODE_CACHE_H
+#define VV_VM_BYTECODE_CACHE_H
+
+#include "instruction.h"
+
+#include <boost/optional/optional.hpp>
+#include <boost/utility/string_ref.hpp>
+
+#include <string>
+
+namespace vv {
+
+namespace vm {
+
+// On-disk cache of compiled files, so running (or requiring) a file that
+// hasn't changed since it was last run skips tokenizing, parsing and code
+// generation entirely. Each file's code is stored in a .vvcache directory
+// alongside it, e.g. test/array.vv's in test/.vvcache/array.vvc.
+//
+// A cached file is used only if it was written by the same build of Vivaldi,
+// and either the source file's size and modification time are the same as when
+// it was compiled, or (if they aren't, e.g. after a fresh checkout) its
+// contents hash the same, in which case the new modification time's stored so
+// the next run doesn't have to hash them again. Everything in a
+// cached file is fixed-size records, besides a table of every symbol used,
+// which are interned once on loading; the file's mapped straight into memory
+// and read in a single pass.
+//
+// Caching is on by default, and turned off by --no-cache or by setting
+// VV_NO_CACHE. Failing to read or write the cache (e.g. in a read-only
+// directory) isn't an error, just a cache miss.
+
+extern bool g_cache_enabled;
+
+// Compiled top-level code for filename, if there's an up-to-date cached copy
+boost::optional<function_t> load_cached(const std::string& filename);
+
+// Caches code, freshly compiled from source (the contents of filename)
+void store_cached(const std::string& filename,
+                  boost::string_ref source,
+                  const function_t& code);
+
+}
+
+}
+
+#endif
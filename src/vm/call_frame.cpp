@@ -1,45 +1,60 @@
 #include "call_frame.h"
 
+#include "gc.h"
+
 using namespace vv;
 
-vm::call_frame::call_frame(std::shared_ptr<call_frame> new_parent,
-                           std::shared_ptr<call_frame> new_enclosing,
-                           size_t                      new_args,
-                           vector_ref<command>         new_instr_ptr)
-  : parent    {new_parent},
-    enclosing {new_enclosing},
-    local     {{}},
-    args      {new_args},
-    instr_ptr {new_instr_ptr}
+vm::call_frame::call_frame(call_frame*       new_parent,
+                           call_frame*       new_enclosing,
+                           size_t            new_args,
+                           size_t            new_frame_ptr,
+                           const command*    new_instr_ptr,
+                           const function_t* new_code)
+{
+  reset(new_parent, new_enclosing, new_args, new_frame_ptr, new_instr_ptr,
+        new_code);
+}
+
+void vm::call_frame::reset(call_frame*       new_parent,
+                           call_frame*       new_enclosing,
+                           size_t            new_args,
+                           size_t            new_frame_ptr,
+                           const command*    new_instr_ptr,
+                           const function_t* new_code)
 {
-  if (parent)
-    self = parent->pushed_self;
+  parent = new_parent;
+  enclosing = new_enclosing;
+  local.resize(1);
+  local.front().clear();
+  cells.clear();
+  self = parent ? parent->pushed_self : value::handle{};
+  frame_ptr = new_frame_ptr;
+  args = new_args;
+  pushed_self = {};
+  caller = boost::none;
+  instr_ptr = new_instr_ptr;
+  code = new_code;
+  marked_in = 0;
 }
 
 void vm::mark(call_frame& frame)
 {
-  // Tedious; just call mark on every extant member (unless it's already marked,
-  // in which case don't--- both because it's redundant and because of circular
-  // references)
-  if (frame.parent)
-    mark(*frame.parent);
-  if (frame.enclosing && frame.parent != frame.enclosing)
-    mark(*frame.enclosing);
+  // Tedious; just queue every extant member. Other frames, and anything on the
+  // stack, are marked by the machine they belong to
+  if (frame.marked_in == gc::internal::g_collection)
+    return;
+  frame.marked_in = gc::internal::g_collection;
 
   for (auto& i : frame.local)
     for (auto& val : i)
-      if (!val.second->marked())
-        val.second->mark();
-  if (frame.self && !frame.self->marked())
-    frame.self->mark();
-
-  for (auto* i : frame.pushed)
-    if (!i->marked())
-      i->mark();
-  if (frame.catcher && !frame.catcher->marked())
-    frame.catcher->mark();
-  if (frame.caller && !frame.caller->marked())
-    frame.caller->mark();
-  if (frame.pushed_self && !frame.pushed_self->marked())
-    frame.pushed_self->mark();
+      gc::mark(val.second);
+  gc::mark(frame.self);
+
+  for (const auto& i : frame.cells)
+    if (i)
+      gc::mark(*i);
+
+  if (frame.caller)
+    gc::mark(*frame.caller);
+  gc::mark(frame.pushed_self);
 }
@@ -15,49 +15,73 @@ namespace vv {
 
 namespace vm {
 
-// Vivaldi's call 'stack' is something vaguely like a cactus stack. It's
-// basically a singly-linked list (the "parent" pointer in the below
-// definition), but closures require their own frame pointer, so it ends up
-// being a strange sort of tree where each branch connects back to the trunk at
-// some point. The only way I've figured out how to memory-manage this
-// ridiculous data structure is via reference counting, hence all the
-// shared_ptr's below. Unsurprisingly, using this system, the majority of
-// execution time is spent allocating or deallocating stack frames. If a better
-// approach to closures presents itself, I'll jump on it.
+// A local variable captured by a closure. It's shared between the frame
+// declaring it and every closure referring to it, so it can outlive the former
+using cell = std::shared_ptr<value::handle>;
+
+// Vivaldi's call stack is an actual stack: every function call gets a frame
+// from the VM's frame pool (see vm::machine), and its arguments, local
+// variables and temporaries all live in a contiguous region of the VM's value
+// stack. The only frames allocated on the heap are top-level ones (one per
+// file, plus the REPL's), since closures point back to them to read globals;
+// any function locals closures use are captured in cells instead, so function
+// frames can be reused as soon as they return.
 
 // TODO: simplify radically; a lot of stuff in here is either redundant,
 // inefficient, or just exists as a hack to prevent GC'ing the wrong things
 class call_frame {
 public:
-  call_frame(std::shared_ptr<call_frame> parent,
-             std::shared_ptr<call_frame> enclosing,
-             size_t                      args,
-             vector_ref<command>         instr_ptr);
+  call_frame(call_frame*       parent,
+             call_frame*       enclosing,
+             size_t            args,
+             size_t            frame_ptr,
+             const command*    instr_ptr,
+             const function_t* code);
+
+  // Reinitializes a pooled frame for a new call, keeping hold of any memory its
+  // members have already allocated
+  void reset(call_frame*       parent,
+             call_frame*       enclosing,
+             size_t            args,
+             size_t            frame_ptr,
+             const command*    instr_ptr,
+             const function_t* code);
 
   // Frame from which current function was called
-  const std::shared_ptr<call_frame> parent;
-  // Frame in which current function (ie closure) was defined
-  const std::shared_ptr<call_frame> enclosing;
-  // Local variables
-  std::vector<std::unordered_map<symbol, value::base*>> local;
-  // self, if this is a method call
-  boost::optional<value::base&> self;
-
-  // Arguments to be passed in eventual function call, as well as temporaries
-  std::vector<value::base*> pushed;
-  // Number of function arguments --- stored in parent's pushed_args
+  call_frame* parent;
+  // Top-level frame in which current function (ie closure) was defined
+  call_frame* enclosing;
+  // Local variables, looked up by name (i.e. at the top level)
+  std::vector<std::unordered_map<symbol, value::handle>> local;
+  // Cells for those slots whose variables are captured by closures (and empty
+  // pointers for the rest)
+  std::vector<cell> cells;
+  // self, if this is a method call (otherwise null)
+  value::handle self;
+
+  // Index in the VM's stack of the first argument. Arguments double as the
+  // first local slots, followed by the rest of the local variables and then
+  // any temporaries (including arguments to be passed in eventual calls)
+  size_t frame_ptr;
+  // Number of function arguments
   size_t args;
-  // Self to be passed in eventual method call
-  boost::optional<value::base&> pushed_self;
+  // Self to be passed in eventual method call, if any
+  value::handle pushed_self;
 
-  // Catch expression provided by try...catch blocks
-  boost::optional<value::base&> catcher;
   // Function from whom the current instruction pointer originates (stored here
-  // solely to avoid GC'ing it)
+  // to avoid GC'ing it, and to find its upvalues)
   boost::optional<value::base&> caller;
 
-  // Current instruction pointer
-  vector_ref<command> instr_ptr;
+  // Current instruction pointer; function bodies are terminated by a ret, and
+  // top-level code by a halt, so no end pointer's necessary
+  const command* instr_ptr;
+  // Function (or top-level code) instr_ptr points into
+  const function_t* code;
+
+  // Number of the last collection (see gc::internal::g_collection) to mark
+  // this frame. Top-level frames can be the enclosing frame of any number of
+  // others, but are only marked once per collection
+  size_t marked_in;
 
 };
 
@@ -0,0 +1,40 @@
+#include "emitter.h"
+
+using namespace vv;
+
+vm::emitter::emitter(function_t& code)
+  : m_code   {code},
+    m_labels {}
+{ }
+
+void vm::emitter::emit(instruction instr, label target)
+{
+  auto idx = m_code.body.size();
+  auto& info = m_labels[target.id];
+  if (info.idx == -1) {
+    info.uses.push_back(idx);
+    m_code.body.emplace_back(instr, 0);
+  } else {
+    m_code.body.emplace_back(instr, info.idx - static_cast<int>(idx));
+  }
+}
+
+vm::emitter::label vm::emitter::make_label()
+{
+  m_labels.push_back({ -1, {} });
+  return { m_labels.size() - 1 };
+}
+
+void vm::emitter::place(label target)
+{
+  auto& info = m_labels[target.id];
+  info.idx = static_cast<int>(m_code.body.size());
+  for (auto i : info.uses)
+    m_code.body[i].as_int = info.idx - static_cast<int>(i);
+  info.uses.clear();
+}
+
+vm::constant_pool& vm::emitter::constants()
+{
+  return m_code.constants;
+}
@@ -0,0 +1,60 @@
+#ifndef VV_VM_EMITTER_H
+#define VV_VM_EMITTER_H
+
+#include "instruction.h"
+
+#include <utility>
+#include <vector>
+
+namespace vv {
+
+namespace vm {
+
+// Assembles a body of code as it's generated. Every node in the AST appends its
+// instructions straight onto the same body, rather than returning a vector of
+// its own for its parent to copy, so generating code takes time linear in its
+// size no matter how deeply it's nested.
+//
+// Jumps (and anything else taking the offset of another instruction) go to
+// labels instead of hand-computed offsets. A label can be jumped to before it's
+// placed; every jump to it is patched once it is.
+class emitter {
+public:
+  struct label {
+    size_t id;
+  };
+
+  // Appends to code's body, adding literals to its constant pool
+  explicit emitter(function_t& code);
+
+  template <typename... Args>
+  void emit(Args&&... args)
+  {
+    m_code.body.emplace_back(std::forward<Args>(args)...);
+  }
+  // Emits instr, with the offset from it to target as its argument
+  void emit(instruction instr, label target);
+
+  label make_label();
+  // Places target at the next instruction to be emitted
+  void place(label target);
+
+  constant_pool& constants();
+
+private:
+  struct label_info {
+    // Index target's been placed at, or -1 if it hasn't been yet
+    int idx;
+    // Instructions waiting to be patched once it has
+    std::vector<size_t> uses;
+  };
+
+  function_t& m_code;
+  std::vector<label_info> m_labels;
+};
+
+}
+
+}
+
+#endif
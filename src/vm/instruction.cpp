@@ -1,49 +1,200 @@
 #include "instruction.h"
 
-using namespace vv;
-
-namespace {
+#include <array>
 
-vm::nil_t nil{};
-
-}
+using namespace vv;
 
 vm::command::command(instruction new_instr, int new_arg)
-  : instr {new_instr},
-    arg   {new_arg}
+  : instr  {new_instr},
+    seen   {0},
+    as_int {new_arg}
 { }
 
 vm::command::command(instruction new_instr, symbol new_arg)
-  : instr {new_instr},
-    arg   {new_arg}
+  : instr  {new_instr},
+    seen   {0},
+    as_sym {new_arg}
 { }
 
 vm::command::command(instruction new_instr, bool new_arg)
-  : instr {new_instr},
-    arg   {new_arg}
+  : instr   {new_instr},
+    seen    {0},
+    as_bool {new_arg}
 { }
 
-vm::command::command(instruction new_instr, const std::string& new_arg)
-  : instr {new_instr},
-    arg   {new_arg}
+vm::command::command(instruction new_instr)
+  : instr  {new_instr},
+    seen   {0},
+    as_int {0}
 { }
 
-vm::command::command(instruction new_instr, double new_arg)
-  : instr {new_instr},
-    arg   {new_arg}
-{ }
+int vm::constant_pool::add(const std::string& val)
+{
+  strings.push_back(val);
+  return static_cast<int>(strings.size() - 1);
+}
 
-vm::command::command(instruction new_instr, const function_t& new_arg)
-  : instr {new_instr},
-    arg   {new_arg}
-{ }
+int vm::constant_pool::add(double val)
+{
+  floats.push_back(val);
+  return static_cast<int>(floats.size() - 1);
+}
 
-vm::command::command(instruction new_instr, const type_t& new_arg)
-  : instr {new_instr},
-    arg   {new_arg}
-{ }
+int vm::constant_pool::add(function_t&& val)
+{
+  functions.push_back(std::make_shared<const function_t>(std::move(val)));
+  return static_cast<int>(functions.size() - 1);
+}
 
-vm::command::command(instruction new_instr)
-  : instr {new_instr},
-    arg   {nil}
-{ }
+int vm::constant_pool::add(type_t&& val)
+{
+  types.push_back(std::move(val));
+  return static_cast<int>(types.size() - 1);
+}
+
+int vm::constant_pool::add(member_cache&& val)
+{
+  member_caches.push_back(std::move(val));
+  return static_cast<int>(member_caches.size() - 1);
+}
+
+int vm::constant_pool::add(member_write_cache&& val)
+{
+  member_write_caches.push_back(std::move(val));
+  return static_cast<int>(member_write_caches.size() - 1);
+}
+
+std::string vm::to_string(instruction instr)
+{
+  switch (instr) {
+  case instruction::push_bool:      return "push_bool";
+  case instruction::push_flt:       return "push_flt";
+  case instruction::push_fn:        return "push_fn";
+  case instruction::push_int:       return "push_int";
+  case instruction::push_nil:       return "push_nil";
+  case instruction::push_str:       return "push_str";
+  case instruction::push_sym:       return "push_sym";
+  case instruction::push_type:      return "push_type";
+  case instruction::make_arr:       return "make_arr";
+  case instruction::make_dict:      return "make_dict";
+  case instruction::read:           return "read";
+  case instruction::write:          return "write";
+  case instruction::let:            return "let";
+  case instruction::load_local:     return "load_local";
+  case instruction::store_local:    return "store_local";
+  case instruction::load_cell:      return "load_cell";
+  case instruction::store_cell:     return "store_cell";
+  case instruction::make_cell:      return "make_cell";
+  case instruction::load_upvalue:   return "load_upvalue";
+  case instruction::store_upvalue:  return "store_upvalue";
+  case instruction::self:           return "self";
+  case instruction::push_arg:       return "push_arg";
+  case instruction::arg:            return "arg";
+  case instruction::readm:          return "readm";
+  case instruction::writem:         return "writem";
+  case instruction::call:           return "call";
+  case instruction::tail_call:      return "tail_call";
+  case instruction::new_obj:        return "new_obj";
+  case instruction::eblk:           return "eblk";
+  case instruction::lblk:           return "lblk";
+  case instruction::ret:            return "ret";
+  case instruction::push:           return "push";
+  case instruction::pop:            return "pop";
+  case instruction::req:            return "req";
+  case instruction::jmp:            return "jmp";
+  case instruction::jmp_false:      return "jmp_false";
+  case instruction::jmp_true:       return "jmp_true";
+  case instruction::iter_init:      return "iter_init";
+  case instruction::iter_next:      return "iter_next";
+  case instruction::try_begin:      return "try_begin";
+  case instruction::try_end:        return "try_end";
+  case instruction::except:         return "except";
+  case instruction::add:            return "add";
+  case instruction::sub:            return "sub";
+  case instruction::mul:            return "mul";
+  case instruction::div:            return "div";
+  case instruction::mod:            return "mod";
+  case instruction::eq:             return "eq";
+  case instruction::neq:            return "neq";
+  case instruction::lt:             return "lt";
+  case instruction::gt:             return "gt";
+  case instruction::le:             return "le";
+  case instruction::ge:             return "ge";
+  case instruction::readm_call:     return "readm_call";
+  case instruction::push_int_arg:   return "push_int_arg";
+  case instruction::load_local_arg: return "load_local_arg";
+  case instruction::call_function:  return "call_function";
+  case instruction::call_builtin:   return "call_builtin";
+  case instruction::add_int:        return "add_int";
+  case instruction::sub_int:        return "sub_int";
+  case instruction::mul_int:        return "mul_int";
+  case instruction::eq_int:         return "eq_int";
+  case instruction::lt_int:         return "lt_int";
+  case instruction::gt_int:         return "gt_int";
+  case instruction::le_int:         return "le_int";
+  case instruction::ge_int:         return "ge_int";
+  case instruction::add_flt:        return "add_flt";
+  case instruction::sub_flt:        return "sub_flt";
+  case instruction::mul_flt:        return "mul_flt";
+  case instruction::eq_flt:         return "eq_flt";
+  case instruction::lt_flt:         return "lt_flt";
+  case instruction::gt_flt:         return "gt_flt";
+  case instruction::le_flt:         return "le_flt";
+  case instruction::ge_flt:         return "ge_flt";
+  case instruction::halt:           return "halt";
+  }
+  return "";
+}
+
+vm::instruction vm::quickened(instruction generic, unsigned char seen)
+{
+  if (generic == instruction::call) {
+    return seen == feedback::function ? instruction::call_function :
+           seen == feedback::builtin  ? instruction::call_builtin  :
+                                        generic;
+  }
+
+  const std::array<std::array<instruction, 3>, 8> binary_operators{{
+    {{ instruction::add, instruction::add_int, instruction::add_flt }},
+    {{ instruction::sub, instruction::sub_int, instruction::sub_flt }},
+    {{ instruction::mul, instruction::mul_int, instruction::mul_flt }},
+    {{ instruction::eq,  instruction::eq_int,  instruction::eq_flt }},
+    {{ instruction::lt,  instruction::lt_int,  instruction::lt_flt }},
+    {{ instruction::gt,  instruction::gt_int,  instruction::gt_flt }},
+    {{ instruction::le,  instruction::le_int,  instruction::le_flt }},
+    {{ instruction::ge,  instruction::ge_int,  instruction::ge_flt }}
+  }};
+  for (const auto& i : binary_operators) {
+    if (i[0] == generic) {
+      return seen == feedback::ints   ? i[1] :
+             seen == feedback::floats ? i[2] :
+                                        generic;
+    }
+  }
+  return generic;
+}
+
+vm::instruction vm::generic(instruction quickened)
+{
+  switch (quickened) {
+  case instruction::call_function:
+  case instruction::call_builtin:  return instruction::call;
+  case instruction::add_int:
+  case instruction::add_flt: return instruction::add;
+  case instruction::sub_int:
+  case instruction::sub_flt: return instruction::sub;
+  case instruction::mul_int:
+  case instruction::mul_flt: return instruction::mul;
+  case instruction::eq_int:
+  case instruction::eq_flt:  return instruction::eq;
+  case instruction::lt_int:
+  case instruction::lt_flt:  return instruction::lt;
+  case instruction::gt_int:
+  case instruction::gt_flt:  return instruction::gt;
+  case instruction::le_int:
+  case instruction::le_flt:  return instruction::le;
+  case instruction::ge_int:
+  case instruction::ge_flt:  return instruction::ge;
+  default:                          return quickened;
+  }
+}
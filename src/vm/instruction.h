@@ -2,9 +2,9 @@
 #define VV_VM_INSTRUCTIONS_H
 
 #include "symbol.h"
+#include "vm/member_cache.h"
 
-#include <boost/variant/variant.hpp>
-
+#include <memory>
 #include <unordered_map>
 #include <vector>
 
@@ -12,37 +12,23 @@ namespace vv {
 
 namespace vm {
 
-struct command;
-
-struct function_t {
-  int argc;
-  std::vector<command> body;
-};
-
-struct type_t {
-  symbol name;
-  symbol parent;
-  std::unordered_map<symbol, function_t> methods;
-};
-
-struct nil_t { };
-
-enum class instruction {
+enum class instruction : unsigned char {
   /// pushes the provided Bool literal into retval
   push_bool,
-  /// pushes the provided Float literal into retval
+  /// pushes the Float literal at the provided constant pool index into retval
   push_flt,
-  /// pushes the provided Function literal into retval
+  /// pushes the Function literal at the provided constant pool index into
+  /// retval
   push_fn,
   /// pushes the provided Integer literal into retval
   push_int,
   /// pushes a Nil literal into retval
   push_nil,
-  /// pushes the provided String literal into retval
+  /// pushes the String literal at the provided constant pool index into retval
   push_str,
   /// pushes the provided Symbol literal into retval
   push_sym,
-  /// Pushes the provided Type literal into retval
+  /// Pushes the Type literal at the provided constant pool index into retval
   push_type,
 
   /// sets retval to an Array made out of the provided number of pushed args
@@ -57,18 +43,43 @@ enum class instruction {
   /// creates a new variable with value retval
   let,
 
+  /// reads the local variable in the provided slot into retval
+  load_local,
+  /// writes retval to the local variable in the provided slot
+  store_local,
+  /// reads the local variable in the provided slot's cell (i.e. a local that's
+  /// been captured by some closure) into retval
+  load_cell,
+  /// writes retval to the local variable in the provided slot's cell
+  store_cell,
+  /// gives the local variable in the provided slot a new, empty cell, so
+  /// closures created from then on don't share it with those created earlier
+  /// (e.g. in a previous iteration of a loop)
+  make_cell,
+  /// reads the provided variable captured by the current closure into retval
+  load_upvalue,
+  /// writes retval to the provided variable captured by the current closure
+  store_upvalue,
+
   /// reads self into retval
   self,
   /// pushes retval onto arg stack
   push_arg,
   /// retrieves the nth passed argument, where n is the provided integer
   arg,
-  /// reads a member into retval
+  /// reads a member into retval, using the member cache at the provided
+  /// constant pool index (which also holds the member's name)
   readm,
-  /// sets a member to retval
+  /// sets a member of retval to the top of the stack, using the member write
+  /// cache at the provided constant pool index (which also holds the member's
+  /// name)
   writem,
   /// calls retval, using the provided number of pushed arguments
   call,
+  /// calls retval in place of the current function, reusing its frame, using
+  /// the provided number of pushed arguments; always followed by a ret, which
+  /// is only reached if the call can't be made in place (e.g. for builtins)
+  tail_call,
   /// creates new object of the type in retval
   new_obj,
 
@@ -84,7 +95,8 @@ enum class instruction {
   /// pops a temporary off the stack into retval
   pop,
 
-  /// loads and run a file with the provided name
+  /// loads and run a file named by the String at the provided constant pool
+  /// index
   req,
 
   /// unconditionally jumps the provided number of commands
@@ -93,35 +105,241 @@ enum class instruction {
   jmp_false,
   /// jump the provided number of commands if retval is trutyh
   jmp_true,
-  /// pushes retval as a new function for catching exceptions
-  push_catch,
-  /// pops an exception catcher and discards it, leaving retval unchanged
-  pop_catch,
+  /// starts a for loop over retval, pushing the loop's state (two values) onto
+  /// the stack. Arrays, Strings and Ranges of Integers are iterated over
+  /// directly: if there's a first element, it's put in retval and the provided
+  /// number of commands is jumped; if not, the loop continues on to the
+  /// following command, which is always a jmp to the end of the loop. Anything
+  /// else skips that jmp, continuing on to code iterating with the usual
+  /// start/at_end/get/increment methods.
+  iter_init,
+  /// moves on to the next element of the for loop whose state is on top of the
+  /// stack, jumping as for iter_init
+  iter_next,
+  /// marks the start of a try body, whose catch body starts the provided
+  /// number of commands away. Only emitted by code generation: vm::optimize
+  /// strips it out, recording the try body in the function's handler table
+  try_begin,
+  /// marks the end of the innermost try body; stripped out along with its
+  /// try_begin
+  try_end,
   /// throws retval as an exception
-  except
+  except,
+
+  // Binary operators, with retval as the left-hand side and the top of the
+  // stack as the right. If both are Integers or Floats, the result's computed
+  // directly; otherwise the operator's method is called as usual, using the
+  // member cache at the provided constant pool index.
+
+  /// calls add
+  add,
+  /// calls subtract
+  sub,
+  /// calls times
+  mul,
+  /// calls divides
+  div,
+  /// calls modulo
+  mod,
+  /// calls equals
+  eq,
+  /// calls unequal
+  neq,
+  /// calls less
+  lt,
+  /// calls greater
+  gt,
+  /// calls less_equals
+  le,
+  /// calls greater_equals
+  ge,
+
+  // Superinstructions, each fused from a pair of the above by vm::optimize.
+  // The second instruction of the pair is left in place, and skipped once the
+  // superinstruction's done its work.
+
+  /// readm followed by call; the member cache index is provided, and the
+  /// number of arguments is taken from the call
+  readm_call,
+  /// push_int followed by push_arg
+  push_int_arg,
+  /// load_local followed by push_arg
+  load_local_arg,
+
+  // Quickened instructions, which generic instructions rewrite themselves into
+  // once they've only ever seen one kind of operand (see command::seen). Each
+  // checks its operands are still of that kind, and if they aren't, turns back
+  // into the generic instruction and reruns itself as such.
+
+  /// call, for Vivaldi functions
+  call_function,
+  /// call, for builtin functions
+  call_builtin,
+  /// add, for Integers
+  add_int,
+  /// sub, for Integers
+  sub_int,
+  /// mul, for Integers
+  mul_int,
+  /// eq, for Integers
+  eq_int,
+  /// lt, for Integers
+  lt_int,
+  /// gt, for Integers
+  gt_int,
+  /// le, for Integers
+  le_int,
+  /// ge, for Integers
+  ge_int,
+  /// add, for Floats
+  add_flt,
+  /// sub, for Floats
+  sub_flt,
+  /// mul, for Floats
+  mul_flt,
+  /// eq, for Floats
+  eq_flt,
+  /// lt, for Floats
+  lt_flt,
+  /// gt, for Floats
+  gt_flt,
+  /// le, for Floats
+  le_flt,
+  /// ge, for Floats
+  ge_flt,
+
+  /// stops execution; terminates top-level code
+  halt
 };
 
+// Name of the instruction, as written above
+std::string to_string(instruction instr);
+
+// Kinds of operands recorded in command::seen
+namespace feedback {
+
+// Arithmetic and comparisons: both sides Integers, both sides Floats, or
+// anything else
+const unsigned char ints{1 << 0};
+const unsigned char floats{1 << 1};
+// Calls: Vivaldi functions, builtins, or anything else
+const unsigned char function{1 << 2};
+const unsigned char builtin{1 << 3};
+
+const unsigned char other{1 << 7};
+
+}
+
+// The quickened form of generic, for operands of kind seen, or generic itself
+// if there isn't one
+instruction quickened(instruction generic, unsigned char seen);
+// The generic form of a quickened instruction
+instruction generic(instruction quickened);
+
 struct command {
 public:
   command(instruction instr, int arg);
   command(instruction instr, symbol arg);
   command(instruction instr, bool arg);
-  command(instruction instr, const std::string& arg);
-  command(instruction instr, double arg);
-  command(instruction instr, const function_t& arg);
-  command(instruction instr, const type_t& arg);
   command(instruction instr);
 
-  instruction instr;
-  boost::variant<int,
-                symbol,
-                bool,
-                std::string,
-                double,
-                function_t,
-                type_t,
-                nil_t>
-    arg;
+  // Mutable, since instructions are rewritten in place as they're quickened
+  mutable instruction instr;
+  // Type feedback: every kind of operand the instruction's been run with, for
+  // those instructions that can be quickened
+  mutable unsigned char seen;
+
+  // Every argument is a single fixed-width word, so the dispatch loop can read
+  // it directly: Integers, Bools and Symbols are stored inline, and everything
+  // else is an index into the current function's constant pool.
+  union {
+    int    as_int;
+    symbol as_sym;
+    bool   as_bool;
+  };
+};
+
+struct function_t;
+struct type_t;
+
+// Compiled functions are immutable once generated, so every closure created
+// from the same definition shares a single copy
+using function_ptr = std::shared_ptr<const function_t>;
+
+// Literals that don't fit inside a command. Each function body gets its own
+// pool, so nested functions are stored alongside (rather than inside) the
+// instructions that create them.
+struct constant_pool {
+  int add(const std::string& val);
+  int add(double val);
+  int add(function_t&& val);
+  int add(type_t&& val);
+  int add(member_cache&& val);
+  int add(member_write_cache&& val);
+
+  std::vector<std::string> strings;
+  std::vector<double> floats;
+  std::vector<function_ptr> functions;
+  std::vector<type_t> types;
+  // Not constant at all, but they belong to individual instructions in the
+  // same way everything else here does
+  mutable std::vector<member_cache> member_caches;
+  mutable std::vector<member_write_cache> member_write_caches;
+};
+
+// Where a closure finds one of the variables it captures, at the point it's
+// created
+struct capture {
+  symbol name;
+  // If true, index is the slot of a cell in the frame creating the closure;
+  // otherwise it's one of the creating closure's own upvalues
+  bool local;
+  int index;
+};
+
+// A try...catch block, as recorded in the handler table of the function it's
+// in. Nothing's done on entering or leaving a try body; instead, when an
+// exception's thrown, each frame's instruction pointer is looked up in its
+// function's table, and the first frame found inside a try body jumps to its
+// catch body.
+struct handler {
+  // Indices of the try body's first instruction, and of the one after its last
+  int start;
+  int end;
+  // Index of the catch body's first instruction, which expects the exception in
+  // retval
+  int target;
+  // Temporaries on the stack (on top of the function's locals), and blocks
+  // entered, at the start of the try body; anything past that is discarded
+  // before jumping to target
+  int stack;
+  int blocks;
+};
+
+struct function_t {
+  int argc;
+  std::vector<command> body;
+  constant_pool constants;
+  // Names of the variables stored in each of the function's local slots
+  std::vector<symbol> locals;
+  // Slots of the locals captured by closures, which are stored in cells rather
+  // than directly in the frame
+  std::vector<int> cells;
+  // Variables from enclosing functions used by this one
+  std::vector<capture> captures;
+  // Every try...catch block in the body, with inner blocks before the ones
+  // containing them
+  std::vector<handler> handlers;
+  // Number of blocks entered, and not yet left, on reaching each instruction,
+  // so an exception knows how many to leave on the way to its handler. Only
+  // filled in for bodies that both enter blocks and have handlers
+  std::vector<int> blocks;
+};
+
+struct type_t {
+  symbol name;
+  symbol parent;
+  std::unordered_map<symbol, function_ptr> methods;
 };
 
 }
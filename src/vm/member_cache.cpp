@@ -0,0 +1,82 @@
+#include "member_cache.h"
+
+#include "gc.h"
+#include "value.h"
+
+using namespace vv;
+
+vm::member_cache_stats vm::g_member_cache_stats{};
+
+vm::member_cache::member_cache(symbol new_name)
+  : name          {new_name},
+    m_entries     {},
+    m_count       {0},
+    m_generation  {value::type::generation},
+    m_megamorphic {false}
+{ }
+
+const vm::member_cache::entry*
+vm::member_cache::find(const vv::shape* shape, const value::type* type)
+{
+  if (m_generation != value::type::generation) {
+    m_count = 0;
+    m_generation = value::type::generation;
+  }
+
+  for (size_t i = 0; i != m_count; ++i) {
+    if (m_entries[i].shape == shape && m_entries[i].type == type) {
+      if (i == 0)
+        ++g_member_cache_stats.monomorphic_hits;
+      else
+        ++g_member_cache_stats.polymorphic_hits;
+      return &m_entries[i];
+    }
+  }
+  ++g_member_cache_stats.misses;
+  return nullptr;
+}
+
+void vm::member_cache::insert(const entry& receiver)
+{
+  if (m_count == size) {
+    if (!m_megamorphic)
+      ++g_member_cache_stats.megamorphic_sites;
+    m_megamorphic = true;
+    return;
+  }
+  m_entries[m_count++] = receiver;
+}
+
+vm::member_write_cache::member_write_cache(symbol new_name)
+  : name   {new_name},
+    m_from {nullptr},
+    m_to   {nullptr},
+    m_slot {-1}
+{ }
+
+bool vm::member_write_cache::write(value::base& obj, value::handle val)
+{
+  if (obj.shape != m_from) {
+    ++g_member_cache_stats.write_misses;
+    return false;
+  }
+
+  ++g_member_cache_stats.write_hits;
+  gc::write_barrier(obj, val);
+  if (m_from == m_to) {
+    obj.member_slots[static_cast<size_t>(m_slot)] = val;
+  } else {
+    obj.shape = m_to;
+    obj.add_member_slot(val);
+  }
+  return true;
+}
+
+void vm::member_write_cache::insert(const vv::shape* from,
+                                    const vv::shape* to,
+                                    int slot)
+{
+  m_from = from;
+  m_to = to;
+  m_slot = slot;
+}
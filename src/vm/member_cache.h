@@ -0,0 +1,101 @@
+#ifndef VV_VM_MEMBER_CACHE_H
+#define VV_VM_MEMBER_CACHE_H
+
+#include "symbol.h"
+
+#include <array>
+
+namespace vv {
+
+class shape;
+
+namespace value {
+struct base;
+class handle;
+struct type;
+}
+
+namespace vm {
+
+// Inline cache for a single readm call site. Looking up a member means checking
+// the receiver's own members, then walking its type and all its parents, doing
+// a hash lookup in each one; the vast majority of call sites only ever see one
+// or two kinds of receiver, though, so the result for each of the last few is
+// remembered here.
+//
+// Receivers are keyed on both shape and type: the shape determines whether (and
+// in which slot) the object has a member by that name, and if it doesn't, the
+// type determines which method it gets. Shapes never die, and method tables
+// never change once a type's been created, but a type can be collected and
+// another allocated at the same address, so caches are flushed whenever
+// value::type::generation changes.
+class member_cache {
+public:
+  // Number of receivers cached before a call site's considered megamorphic, at
+  // which point it stops caching new ones
+  static const size_t size{4};
+
+  struct entry {
+    const vv::shape* shape;
+    const value::type* type;
+    // Slot of the member in the receiver, or -1 if it's a method
+    int slot;
+    value::base* method;
+  };
+
+  explicit member_cache(symbol name);
+
+  // Returns the entry cached for a receiver, or nullptr on a miss
+  const entry* find(const vv::shape* shape, const value::type* type);
+  void insert(const entry& receiver);
+
+  symbol name;
+
+private:
+  std::array<entry, size> m_entries;
+  size_t m_count;
+  size_t m_generation;
+  bool m_megamorphic;
+};
+
+// Inline cache for a single writem call site. Objects that get the same
+// members set in the same order go through the same shapes, so remembering
+// the last transition (or lack of one, when the member already exists) covers
+// most sites, e.g. every self.foo = ... in an init method.
+class member_write_cache {
+public:
+  explicit member_write_cache(symbol name);
+
+  // Sets the member on obj, if obj's shape is the one cached; otherwise
+  // returns false
+  bool write(value::base& obj, value::handle val);
+  void insert(const vv::shape* from, const vv::shape* to, int slot);
+
+  symbol name;
+
+private:
+  const vv::shape* m_from;
+  const vv::shape* m_to;
+  int m_slot;
+};
+
+// Running totals across every member cache, for --ic-stats
+struct member_cache_stats {
+  // Hits on the first cached receiver, and on any of the others
+  size_t monomorphic_hits;
+  size_t polymorphic_hits;
+  size_t misses;
+  // Call sites that have seen more than member_cache::size receivers
+  size_t megamorphic_sites;
+
+  size_t write_hits;
+  size_t write_misses;
+};
+
+extern member_cache_stats g_member_cache_stats;
+
+}
+
+}
+
+#endif
@@ -0,0 +1,387 @@
+#include "optimizer.h"
+
+#include <algorithm>
+
+using namespace vv;
+
+namespace {
+
+using vm::instruction;
+
+// Superinstructions, and the pairs of instructions they replace. These are the
+// most frequent pairs in --profile-opcodes runs over the examples, tests and
+// benchmarks; readm followed by call alone accounts for 10--17% of pairs in
+// every one of them.
+struct fusion {
+  instruction first;
+  instruction second;
+  instruction fused;
+};
+
+const fusion fusions[] = {
+  { instruction::readm,      instruction::call,     instruction::readm_call },
+  { instruction::push_int,   instruction::push_arg, instruction::push_int_arg },
+  { instruction::load_local, instruction::push_arg,
+    instruction::load_local_arg }
+};
+
+bool is_jump(instruction instr)
+{
+  return instr == instruction::jmp
+      || instr == instruction::jmp_false
+      || instr == instruction::jmp_true;
+}
+
+// Instructions whose argument is the offset of another instruction, i.e.
+// jumps, the for loop instructions that jump back to the loop's body, and the
+// start of try bodies, which point to their catch bodies
+bool has_offset(instruction instr)
+{
+  return is_jump(instr)
+      || instr == instruction::iter_init
+      || instr == instruction::iter_next
+      || instr == instruction::try_begin;
+}
+
+// Literals, which set retval and do nothing else
+bool is_literal(instruction instr)
+{
+  switch (instr) {
+  case instruction::push_bool:
+  case instruction::push_flt:
+  case instruction::push_int:
+  case instruction::push_nil:
+  case instruction::push_str:
+  case instruction::push_sym:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Instructions that set retval without reading it first
+bool overwrites_retval(instruction instr)
+{
+  switch (instr) {
+  case instruction::push_fn:
+  case instruction::read:
+  case instruction::load_local:
+  case instruction::load_cell:
+  case instruction::load_upvalue:
+  case instruction::self:
+  case instruction::arg:
+  case instruction::pop:
+    return true;
+  default:
+    return is_literal(instr);
+  }
+}
+
+size_t target(const std::vector<vm::command>& body, size_t idx)
+{
+  return static_cast<size_t>(static_cast<int>(idx) + body[idx].as_int);
+}
+
+// Where the jump at idx ends up, skipping any jumps it lands on whose outcome
+// is already known: an unconditional jump is always taken, and a conditional
+// one is taken if and only if the jump that got there was
+size_t final_target(const std::vector<vm::command>& body, size_t idx)
+{
+  auto instr = body[idx].instr;
+  auto dest = target(body, idx);
+  // Jumps can form a cycle (e.g. an empty infinite loop), so give up eventually
+  for (auto steps = body.size(); steps-- && dest < body.size();) {
+    auto next = body[dest].instr;
+    if (next == instruction::jmp || next == instr)
+      dest = target(body, dest);
+    // jmp_false landing on a jmp_true, or vice versa
+    else if (is_jump(next) && instr != instruction::jmp)
+      ++dest;
+    else
+      break;
+  }
+  return dest;
+}
+
+void thread_jumps(std::vector<vm::command>& body)
+{
+  for (size_t i = 0; i != body.size(); ++i) {
+    if (!is_jump(body[i].instr))
+      continue;
+    auto dest = final_target(body, i);
+    // Jumping to a return might as well just return
+    auto returns = dest < body.size() && body[dest].instr == instruction::ret;
+    if (body[i].instr == instruction::jmp && returns)
+      body[i] = body[dest];
+    else
+      body[i].as_int = static_cast<int>(dest) - static_cast<int>(i);
+  }
+}
+
+// Marks every instruction that can be removed without changing what the code
+// does
+std::vector<bool> find_redundant(const std::vector<vm::command>& body)
+{
+  std::vector<bool> redundant(body.size());
+  // Blocks entered so far and not yet left, and whether each has declared any
+  // variables
+  std::vector<std::pair<size_t, bool>> blocks;
+
+  for (size_t i = 0; i != body.size(); ++i) {
+    auto instr = body[i].instr;
+
+    if (instr == instruction::jmp && target(body, i) == i + 1) {
+      redundant[i] = true;
+
+    } else if (is_literal(instr) && i + 1 != body.size()
+                                 && overwrites_retval(body[i + 1].instr)) {
+      redundant[i] = true;
+
+    } else if (instr == instruction::eblk) {
+      blocks.emplace_back(i, false);
+
+    } else if (instr == instruction::let || instr == instruction::push_type) {
+      if (blocks.size())
+        blocks.back().second = true;
+
+    } else if (instr == instruction::lblk && blocks.size()) {
+      // A block without any variables of its own is indistinguishable from
+      // the one around it
+      if (!blocks.back().second)
+        redundant[blocks.back().first] = redundant[i] = true;
+      blocks.pop_back();
+    }
+  }
+  return redundant;
+}
+
+// Returns the new index of every instruction (and of the end of the body), for
+// anything else referring to them
+std::vector<int> remove(std::vector<vm::command>& body,
+                        const std::vector<bool>& redundant)
+{
+  // The index each instruction will have once the redundant ones are gone.
+  // Removed instructions get the index of the next one that's kept, which is
+  // where jumps to them end up
+  std::vector<int> new_idx(body.size() + 1);
+  int kept{};
+  for (size_t i = 0; i != body.size(); ++i) {
+    new_idx[i] = kept;
+    if (!redundant[i])
+      ++kept;
+  }
+  new_idx.back() = kept;
+
+  std::vector<vm::command> compacted;
+  for (size_t i = 0; i != body.size(); ++i) {
+    if (redundant[i])
+      continue;
+    compacted.push_back(body[i]);
+    if (has_offset(body[i].instr)) {
+      auto dest = std::min(target(body, i), body.size());
+      compacted.back().as_int = new_idx[dest] - new_idx[i];
+    }
+  }
+  body = move(compacted);
+  return new_idx;
+}
+
+// Returns the superinstruction replacing first and second, or first if there
+// isn't one
+instruction fused(instruction first, instruction second)
+{
+  for (const auto& i : fusions) {
+    if (i.first == first && i.second == second)
+      return i.fused;
+  }
+  return first;
+}
+
+// Effect of each instruction on the number of temporaries on the stack, if
+// execution carries on to the next one. Superinstructions leave the second half
+// of their work to be counted at the instruction they skip
+int stack_effect(const vm::command& cmd)
+{
+  switch (cmd.instr) {
+  case instruction::push:
+  case instruction::push_arg:
+    return 1;
+  case instruction::pop:
+  case instruction::writem:
+  case instruction::add:
+  case instruction::sub:
+  case instruction::mul:
+  case instruction::div:
+  case instruction::mod:
+  case instruction::eq:
+  case instruction::neq:
+  case instruction::lt:
+  case instruction::gt:
+  case instruction::le:
+  case instruction::ge:
+    return -1;
+  case instruction::make_arr:
+  case instruction::make_dict:
+  case instruction::call:
+  case instruction::tail_call:
+  case instruction::new_obj:
+    return -cmd.as_int;
+  default:
+    return 0;
+  }
+}
+
+// Number of temporaries on the stack on reaching each instruction (or -1, for
+// unreachable ones). Code generation only ever jumps to a given instruction
+// with the same number, and only jumps backwards to instructions that have
+// already been reached some other way, so a single pass is enough
+std::vector<int> stack_depths(const std::vector<vm::command>& body)
+{
+  std::vector<int> depths(body.size() + 1, -1);
+  auto reach = [&](size_t idx, int depth)
+  {
+    if (idx < depths.size() && depths[idx] == -1)
+      depths[idx] = depth;
+  };
+
+  reach(0, 0);
+  for (size_t i = 0; i != body.size(); ++i) {
+    auto depth = depths[i];
+    if (depth == -1)
+      continue;
+
+    switch (body[i].instr) {
+    case instruction::ret:
+    case instruction::halt:
+    case instruction::except:
+      break;
+    case instruction::jmp:
+      reach(target(body, i), depth);
+      break;
+    // Either jumps to the body or falls through to the jmp to the end, both
+    // with the loop's state pushed, or skips that jmp having pushed only part
+    // of it
+    case instruction::iter_init:
+      reach(target(body, i), depth + 2);
+      reach(i + 1, depth + 2);
+      reach(i + 2, depth + 1);
+      break;
+    case instruction::iter_next:
+      reach(target(body, i), depth);
+      reach(i + 1, depth);
+      reach(i + 2, depth);
+      break;
+    default:
+      if (has_offset(body[i].instr))
+        reach(target(body, i), depth);
+      reach(i + 1, depth + stack_effect(body[i]));
+    }
+  }
+  return depths;
+}
+
+// Replaces the try_begin and try_end markers around each try body with an
+// entry in code's handler table
+void build_handler_table(vm::function_t& code)
+{
+  auto& body = code.body;
+  auto depths = stack_depths(body);
+  std::vector<bool> markers(body.size());
+  // try_begins yet to be matched with a try_end
+  std::vector<vm::handler> open;
+  int blocks{};
+
+  for (size_t i = 0; i != body.size(); ++i) {
+    switch (body[i].instr) {
+    case instruction::eblk: ++blocks; break;
+    case instruction::lblk: --blocks; break;
+
+    case instruction::try_begin:
+      markers[i] = true;
+      open.push_back({ static_cast<int>(i), 0,
+                       static_cast<int>(target(body, i)),
+                       std::max(depths[i], 0), blocks });
+      break;
+
+    // Inner try bodies end first, so they end up first in the table
+    case instruction::try_end:
+      markers[i] = true;
+      open.back().end = static_cast<int>(i);
+      code.handlers.push_back(open.back());
+      open.pop_back();
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  if (code.handlers.empty())
+    return;
+  auto new_idx = remove(body, markers);
+  for (auto& i : code.handlers) {
+    i.start = new_idx[static_cast<size_t>(i.start)];
+    i.end = new_idx[static_cast<size_t>(i.end)];
+    i.target = new_idx[static_cast<size_t>(i.target)];
+  }
+
+  // Blocks are only entered by top-level code, so most bodies don't need to
+  // keep track of them
+  if (none_of(begin(body), end(body), [](const vm::command& i)
+                                      { return i.instr == instruction::eblk; }))
+    return;
+  code.blocks.reserve(body.size());
+  blocks = 0;
+  for (const auto& i : body) {
+    code.blocks.push_back(blocks);
+    if (i.instr == instruction::eblk)
+      ++blocks;
+    else if (i.instr == instruction::lblk)
+      --blocks;
+  }
+}
+
+}
+
+void vm::optimize(function_t& code)
+{
+  auto& body = code.body;
+  // Removing one instruction can make another redundant (e.g. a jump over an
+  // empty block becoming a jump to the next instruction), so keep going until
+  // there's nothing left to remove
+  for (;;) {
+    thread_jumps(body);
+    auto redundant = find_redundant(body);
+    if (none_of(begin(redundant), end(redundant), [](bool i) { return i; }))
+      break;
+    remove(body, redundant);
+  }
+
+  // Calls whose result is returned straight away don't need a frame of their
+  // own. The ret stays, for when the call can't be made in place after all.
+  // Inside a try body, though, the frame's still needed to catch exceptions
+  int try_depth{};
+  for (size_t i = 0; i + 1 < body.size(); ++i) {
+    if (body[i].instr == instruction::try_begin)
+      ++try_depth;
+    else if (body[i].instr == instruction::try_end)
+      --try_depth;
+    else if (!try_depth && body[i].instr == instruction::call
+                        && body[i + 1].instr == instruction::ret)
+      body[i].instr = instruction::tail_call;
+  }
+
+  // The second instruction of each pair is left where it is, both so jumps
+  // don't need to be adjusted and so the superinstruction can read its
+  // argument; the superinstruction skips over it, but anything jumping
+  // straight to it still runs it as normal
+  for (size_t i = 0; i + 1 < body.size(); ++i) {
+    auto instr = fused(body[i].instr, body[i + 1].instr);
+    if (instr != body[i].instr) {
+      body[i].instr = instr;
+      ++i;
+    }
+  }
+
+  build_handler_table(code);
+}
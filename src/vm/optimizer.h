@@ -0,0 +1,27 @@
+#ifndef VV_VM_OPTIMIZER_H
+#define VV_VM_OPTIMIZER_H
+
+#include "instruction.h"
+
+namespace vv {
+
+namespace vm {
+
+// Peephole pass over a freshly generated body of code (a function's, or a
+// file's top-level code). Code generation works one expression at a time, so
+// it leaves behind plenty that only looks redundant once everything's been
+// stitched together: chains of jumps, jumps to the next instruction, literals
+// overwritten before they're used, and blocks that never declare anything.
+// Once those are gone, calls in tail position are turned into tail calls, and
+// the most frequently paired instructions are fused into superinstructions, to
+// save a dispatch apiece.
+//
+// Not entirely optional: it's also what turns try...catch markers into the
+// function's handler table, so every body has to go through it before it's run.
+void optimize(function_t& code);
+
+}
+
+}
+
+#endif
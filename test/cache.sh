@@ -0,0 +1,140 @@
+#!/bin/sh
+# Tests the bytecode cache; usage: cache.sh <vivaldi> <scratch directory>
+#
+# A program has to print the same thing whether it's compiled from scratch or
+# loaded from the cache, and a cache file that's stale, corrupt or written by
+# something else has to be recompiled rather than run.
+
+vivaldi=$1
+dir=$2
+cache=.vvcache/program.vvc
+failed=0
+
+fail()
+{
+  echo "failed: $1"
+  failed=1
+}
+
+# Runs program.vv, with any arguments given, and checks what it printed
+check()
+{
+  "$vivaldi" "$@" program.vv > out.txt 2>&1
+  cmp -s out.txt expected.txt || fail "output of program.vv $*"
+}
+
+# Overwrites the byte at offset $2 of file $1
+patch_byte()
+{
+  printf 'X' | dd of="$1" bs=1 seek="$2" conv=notrunc 2> /dev/null
+}
+
+rm -rf "$dir"
+mkdir -p "$dir"
+cd "$dir" || exit 1
+
+cat > program.vv << 'EOF'
+class Counter
+  fn init(start): self.count = start
+  fn next(): do
+    self.count = self.count + 1
+    self.count
+  end
+end
+
+fn make_adder(x): fn (y): x + y
+let add = make_adder(10)
+
+let counter = new Counter(1)
+let words = ["cached", "bytecode"]
+let sum = 0
+for i in 0 to 5: sum = sum + counter.next()
+let caught = try: except "thrown" catch e: e
+
+puts(words[0] + " " + words[1])
+puts(add(sum))
+puts(1.5 * 2)
+puts(caught)
+puts('symbol)
+puts({1: 2}[1])
+EOF
+cat > expected.txt << 'EOF'
+cached bytecode
+30
+3.000000
+thrown
+'symbol
+2
+EOF
+
+check
+[ -f "$cache" ] || fail "writing the cache"
+cp "$cache" good.vvc
+check
+cmp -s "$cache" good.vvc || fail "rewriting an up-to-date cache"
+
+# Truncated, corrupt, or written by another version or build of Vivaldi: each
+# is recompiled, and the cache file rewritten
+: > "$cache"
+check
+cmp -s "$cache" good.vvc || fail "recompiling with an empty cache file"
+
+head -c 64 good.vvc > "$cache"
+check
+cmp -s "$cache" good.vvc || fail "recompiling with a truncated cache file"
+
+size=$(wc -c < good.vvc)
+for corrupt in 0:magic 4:version 8:build $((size - 1)):contents; do
+  cp good.vvc "$cache"
+  patch_byte "$cache" "${corrupt%%:*}"
+  check
+  cmp -s "$cache" good.vvc || fail "recompiling with a bad ${corrupt#*:}"
+done
+
+# Cache hits can't be seen from a program's output, so a cache file written for
+# one program is passed off as another's, of the same size and modification
+# time: the second prints what the first does if (and only if) it's a hit
+mkdir hits
+cd hits || exit 1
+echo 'puts("a")' > a.vv
+echo 'puts("b")' > b.vv
+"$vivaldi" a.vv > /dev/null
+touch -r a.vv b.vv
+cp .vvcache/a.vvc .vvcache/b.vvc
+[ "$("$vivaldi" b.vv)" = a ] || fail "loading from the cache"
+[ "$("$vivaldi" --no-cache b.vv)" = b ] || fail "ignoring the cache for --no-cache"
+[ "$(VV_NO_CACHE=1 "$vivaldi" b.vv)" = b ] || fail "ignoring the cache for VV_NO_CACHE"
+
+# Changed without changing size: caught by the modification time, and then the
+# hash
+echo 'puts("c")' > b.vv
+[ "$("$vivaldi" b.vv)" = c ] || fail "recompiling a changed file"
+
+# Touched without changing: loaded after hashing it, and the new modification
+# time stored so it isn't hashed again next time
+cp .vvcache/a.vvc before.vvc
+touch -t 200001010000 a.vv
+[ "$("$vivaldi" a.vv)" = a ] || fail "loading a touched file"
+cmp -s .vvcache/a.vvc before.vvc && fail "storing a touched file's new time"
+cp .vvcache/a.vvc after.vvc
+"$vivaldi" a.vv > /dev/null
+cmp -s .vvcache/a.vvc after.vvc || fail "loading a touched file again"
+cd ..
+
+# Failing to write a cache file in full (e.g. on a full disk) mustn't leave its
+# temporary file behind; writing anything at all fails with a file size limit
+# of zero
+rm -rf .vvcache
+(trap '' XFSZ; ulimit -f 0; "$vivaldi" program.vv > /dev/null)
+[ -n "$(ls .vvcache)" ] && fail "cleaning up after failing to write the cache"
+
+rm -rf .vvcache hits/.vvcache
+check --no-cache
+[ -d .vvcache ] && fail "writing the cache with --no-cache"
+VV_NO_CACHE=1
+export VV_NO_CACHE
+check
+[ -d .vvcache ] && fail "writing the cache with VV_NO_CACHE"
+
+[ $failed = 0 ] && rm -rf "$dir"
+exit $failed